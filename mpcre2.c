@@ -30,10 +30,13 @@
  * but have not in general provided the extra helper functions that would make them useful.
  * This work is left as an exercise for the reader.
  *
- * The PCRE2 library makes extensive use of C pointers.  The strategy MPCRE2 uses here is to pass pointers
- * in and out of C as strings formatted as decimal integers equivalent to the pointer values.  This strategy
- * means these values are visible in M and that an M program could alter these values.  Don't do that.  With
- * great power comes great responsibility, and it would certainly crash the M runtime.
+ * The PCRE2 library makes extensive use of C pointers.  Compiled patterns, match data, contexts, JIT stacks
+ * and serialized patterns are passed to M as short handles such as "c12.3", which name a typed slot in a table
+ * kept on the C side along with a generation number for that slot.  A handle which has been freed, or which
+ * has been altered in M, is rejected with an error rather than being used.  The less common pointers (output
+ * vectors, substring buffers and lists, character tables and callbacks from other plugins) are still passed as
+ * strings formatted as decimal integers equivalent to the pointer values.  An M program could alter these
+ * values.  Don't do that.  With great power comes great responsibility, and it would certainly crash the M runtime.
  *
  * The mapping of libpcre2 function names to M is straight-forward but ugly.  Since M identifiers cannot use
  * underscores and since the libpcre2 function names make extensive use of underscores, an M identifier is
@@ -50,14 +53,30 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
 
 /**
 * @brief This macro must be defined before including pcre2.h.  It sets our default code unit size to 8 (byte) 
 */
 #define PCRE2_CODE_UNIT_WIDTH 8
 #include <pcre2.h>
+#include <zlib.h>
 #include "gtmxc_types.h"
 
+/**
+ * @brief Pseudo compile option asking mpcre2 to JIT compile the pattern right after compiling it
+ *
+ * This bit is not used by any PCRE2 compile option (as of 10.42), and it is
+ * removed from the options before they are passed to pcre2_compile().
+ */
+#define MPCRE2_AUTO_JIT 0x10000000u
+
 /**
  * This type is used in tables which translate M strings to C macro values
  */
@@ -99,6 +118,7 @@ static struct opt_tab compile_opts [] = {
 	{ "PCRE2_UNGREEDY", PCRE2_UNGREEDY },
 	{ "PCRE2_USE_OFFSET_LIMIT", PCRE2_USE_OFFSET_LIMIT },
 	{ "PCRE2_UTF", PCRE2_UTF },
+	{ "MPCRE2_AUTO_JIT", MPCRE2_AUTO_JIT },
 };
 static int n_compile_opts = sizeof(compile_opts) / sizeof(struct opt_tab);	///< The number of compile options implemented
 
@@ -210,6 +230,29 @@ static struct opt_tab info_opts [] = {
 };
 static int n_info_opts = sizeof(info_opts) / sizeof(struct opt_tab);		///< The number of info options supported
 
+/**
+ * This type names an option table, so M can ask for a bitmask from any of them
+ */
+typedef struct opt_tab_ref {
+	const char *name;		///< M name of the option table
+	struct opt_tab *table;		///< The option table
+	int *count;			///< The number of entries in the table
+} opt_tab_ref_t;
+
+/**
+ * This table maps the option table names accepted by mpcre2_option_mask() to the tables
+ */
+static struct opt_tab_ref opt_tables [] = {
+	{ "compile", compile_opts, &n_compile_opts },
+	{ "extra compile", extra_compile_opts, &n_extra_compile_opts },
+	{ "match", match_opts, &n_match_opts },
+	{ "jit", jit_opts, &n_jit_opts },
+	{ "bsr", bsr_opts, &n_bsr_opts },
+	{ "newline", newline_opts, &n_newline_opts },
+	{ "info", info_opts, &n_info_opts },
+};
+static int n_opt_tables = sizeof(opt_tables) / sizeof(struct opt_tab_ref);	///< The number of option tables
+
 /*
  * This section has a number of utility functions used by the rest of the
  * plugin code which are not exported to M and not accessible outside of this file.
@@ -320,7 +363,8 @@ static void m_pcre2_free(void *ptr, void *memory_data) {
  * @brief Decode a string handle into a pointer
  *
  * We pass pointers out to M as strings, and deode strings from M into pointers.
- * This function does the decode.  There is some special casing which translates
+ * This function does the decode for the raw pointers which do not go through
+ * the handle registry (see handle_decode()).  There is some special casing which translates
  * the strings "0", or "NULL" into NULL pointers.  Otherwise the string is
  * assumed to contain a base-10 number which is cast into a void pointer.
  *
@@ -371,6 +415,408 @@ static void pointer_encode(void *ptr, char *buf, int size) {
 	snprintf(buf, size, "%llu", (unsigned long long) ptr);
 }
 
+/*
+ * This section implements the handle registry.  PCRE2 objects which M holds on
+ * to (compiled patterns, match data, contexts, JIT stacks and serialized
+ * patterns) are not passed to M as raw pointers.  Instead each one lives in a
+ * typed slot of a table, and M gets a short handle such as "c12.3" naming the
+ * slot ("c" for a compiled pattern, slot 12) and the generation of the slot (3).
+ * Decoding a handle is an array index and a type and generation check, and a
+ * stale or mangled handle is reported as an error rather than crashing the process.
+ */
+
+/**
+ * @brief Number of slots the handle registry starts out with
+ */
+#define MPCRE2_REGISTRY_INITIAL_SLOTS 64
+
+/**
+ * These are the kinds of objects the handle registry holds
+ */
+enum handle_type {
+	HANDLE_FREE,			///< Slot is not in use
+	HANDLE_CODE,			///< pcre2_code
+	HANDLE_MATCH_DATA,		///< pcre2_match_data
+	HANDLE_GENERAL_CONTEXT,		///< pcre2_general_context
+	HANDLE_COMPILE_CONTEXT,		///< pcre2_compile_context
+	HANDLE_MATCH_CONTEXT,		///< pcre2_match_context
+	HANDLE_JIT_STACK,		///< pcre2_jit_stack
+	HANDLE_SERIALIZED,		///< Serialized patterns from pcre2_serialize_encode()
+	HANDLE_DFA_STREAM,		///< DFA match streams from pcre2dfastreamcreate
+	HANDLE_MATCH_STREAM,		///< Match streams from pcre2matchstreamcreate
+	HANDLE_SUBSTITUTE_RESULT,	///< Output of pcre2substitutelarge
+	HANDLE_SUBSTITUTE_MAP,		///< Key to value tables for pcre2substitutemap
+	HANDLE_RULE_SET,		///< Rule sets for pcre2rulesetapply
+	HANDLE_TEMPLATE,		///< Replacement templates from pcre2templatecompile
+};
+
+/**
+ * This type describes a kind of handle
+ */
+typedef struct handle_type_info {
+	char tag;			///< First character of handles of this type
+	const char *name;		///< Name used in error messages
+} handle_type_info_t;
+
+/**
+ * This table gives the tag and name for each handle type, indexed by enum handle_type
+ */
+static struct handle_type_info handle_types [] = {
+	{ '-', "free" },
+	{ 'c', "code" },
+	{ 'd', "match data" },
+	{ 'g', "general context" },
+	{ 'k', "compile context" },
+	{ 'm', "match context" },
+	{ 'j', "JIT stack" },
+	{ 's', "serialized bytes" },
+	{ 'f', "DFA stream" },
+	{ 'p', "match stream" },
+	{ 'r', "substitute result" },
+	{ 'h', "substitute map" },
+	{ 'u', "rule set" },
+	{ 't', "replacement template" },
+};
+
+/**
+ * This type is one slot in the handle registry
+ */
+typedef struct handle_slot {
+	void *ptr;			///< The object, or the next free slot index when free
+	void *aux;			///< State mpcre2 keeps about the object (a code_state_t for patterns), or NULL
+	uint32_t gen;			///< Generation, bumped each time the slot is released
+	uint32_t type;			///< An enum handle_type value
+} handle_slot_t;
+
+/**
+ * This type holds what mpcre2 keeps about a compiled pattern beyond the pcre2_code
+ * itself.  It hangs off the pattern's registry slot and is freed with the handle.
+ */
+typedef struct code_state {
+	int jit;			///< Non-zero once the pattern has JIT code
+	int jit_tried;			///< Non-zero once we have tried to JIT compile the pattern ourselves
+	int utf;			///< Non-zero if the pattern was compiled in UTF mode
+	unsigned long matches;		///< Number of matches run against the pattern
+	pcre2_match_data *md;		///< Match data kept for "AUTO", or NULL
+	char md_handle[24];		///< Handle for md
+} code_state_t;
+
+/**
+ * This type holds the handle registry
+ */
+typedef struct handle_registry {
+	handle_slot_t *slots;		///< The slots
+	uint32_t n_slots;		///< Number of slots allocated
+	uint32_t first_free;		///< Index of the first free slot, n_slots if none
+} handle_registry_t;
+
+static handle_registry_t registry = { NULL, 0, 0 };	///< The handle registry
+
+/**
+ * @brief Create the mpcre2 state for a compiled pattern
+ *
+ * @param code The compiled pattern
+ *
+ * @return The new state, or NULL if we could not get the memory
+ */
+static code_state_t *code_state_create(pcre2_code *code) {
+
+	code_state_t *state;
+	uint32_t all_options = 0;
+	size_t jit_size = 0;
+
+	state = m_pcre2_malloc(sizeof(code_state_t), NULL);
+	if (!state) {
+		return NULL;
+	}
+
+	pcre2_pattern_info(code, PCRE2_INFO_ALLOPTIONS, &all_options);
+	pcre2_pattern_info(code, PCRE2_INFO_JITSIZE, &jit_size);
+
+	state->utf = (all_options & PCRE2_UTF) != 0;
+	state->jit = jit_size > 0;
+	state->jit_tried = state->jit;
+	state->matches = 0;
+	state->md = NULL;
+	state->md_handle[0] = '\0';
+
+	return state;
+}
+
+static void *handle_release(const char *hstr, uint32_t type);
+
+/**
+ * @brief Free the mpcre2 state for a compiled pattern
+ *
+ * This also frees the pattern's "AUTO" match data, if it has one.
+ *
+ * @param state The state
+ *
+ * @return None
+ */
+static void code_state_free(code_state_t *state) {
+
+	if (state->md) {
+		handle_release(state->md_handle, HANDLE_MATCH_DATA);
+		pcre2_match_data_free(state->md);
+	}
+
+	m_pcre2_free(state, NULL);
+}
+
+/**
+ * @brief Find the registry slot for a handle
+ *
+ * This does no allocation and no library calls: the slot number and generation
+ * are read straight out of the string, and the slot is checked for type and generation.
+ *
+ * @param hstr The handle
+ * @param type The type of handle expected
+ *
+ * @return The slot, or NULL if the handle is not a live handle of the right type
+ */
+static handle_slot_t *handle_lookup(const char *hstr, uint32_t type) {
+
+	const char *cpt;
+	uint32_t slot = 0;
+	uint32_t gen = 0;
+	handle_slot_t *hs;
+
+	if (hstr[0] != handle_types[type].tag) {
+		return NULL;
+	}
+
+	/*
+	 * Numbers too big for a uint32_t would wrap, perhaps onto a live slot, so they are refused
+	 */
+	for (cpt = hstr + 1; *cpt >= '0' && *cpt <= '9'; cpt++) {
+		if (slot > (UINT32_MAX - (uint32_t) (*cpt - '0')) / 10) {
+			return NULL;
+		}
+		slot = (slot * 10) + (*cpt - '0');
+	}
+	if (cpt == hstr + 1 || *cpt != '.') {
+		return NULL;
+	}
+
+	for (cpt++; *cpt >= '0' && *cpt <= '9'; cpt++) {
+		if (gen > (UINT32_MAX - (uint32_t) (*cpt - '0')) / 10) {
+			return NULL;
+		}
+		gen = (gen * 10) + (*cpt - '0');
+	}
+	if (*cpt != '\0' || slot >= registry.n_slots) {
+		return NULL;
+	}
+
+	hs = &registry.slots[slot];
+	if (hs->type != type || hs->gen != gen) {
+		return NULL;
+	}
+
+	return hs;
+}
+
+/**
+ * @brief Check for one of the strings M passes instead of a handle to mean "none"
+ *
+ * @param hstr The handle
+ *
+ * @return 1 for "0" or "NULL", 0 otherwise
+ */
+static int handle_is_null(const char *hstr) {
+
+	return (hstr[0] == '0' && hstr[1] == '\0') || strcmp(hstr, "NULL") == 0;
+}
+
+/**
+ * @brief Decode a handle into a pointer
+ *
+ * The strings "0" and "NULL" decode to NULL without complaint.  Anything else
+ * which is not a live handle of the expected type is reported and also decodes
+ * to NULL, which callers turn into an error return.
+ *
+ * @param hstr The handle
+ * @param type The type of handle expected
+ *
+ * @return The object pointer, or NULL
+ */
+static void *handle_decode(const char *hstr, uint32_t type) {
+
+	handle_slot_t *hs;
+
+	if (handle_is_null(hstr)) {
+		return NULL;
+	}
+
+	hs = handle_lookup(hstr, type);
+	if (!hs) {
+		fprintf(stderr, "Invalid or stale %s handle %s\n", handle_types[type].name, hstr);
+		return NULL;
+	}
+
+	return hs->ptr;
+}
+
+/**
+ * @brief Decode a compiled pattern handle along with its mpcre2 state
+ *
+ * The state is created the first time it is asked for.  If that fails the
+ * pattern is still returned, with a NULL state, and callers simply do without.
+ *
+ * @param code_str The handle
+ * @param state Where to store the state pointer
+ *
+ * @return The compiled pattern, or NULL
+ */
+static pcre2_code *code_decode(const char *code_str, code_state_t **state) {
+
+	handle_slot_t *hs;
+
+	*state = NULL;
+
+	if (handle_is_null(code_str)) {
+		return NULL;
+	}
+
+	hs = handle_lookup(code_str, HANDLE_CODE);
+	if (!hs) {
+		fprintf(stderr, "Invalid or stale %s handle %s\n", handle_types[HANDLE_CODE].name, code_str);
+		return NULL;
+	}
+
+	if (!hs->aux) {
+		hs->aux = code_state_create(hs->ptr);
+	}
+	*state = hs->aux;
+
+	return hs->ptr;
+}
+
+/**
+ * @brief Grow the handle registry
+ *
+ * New slots are put on the free list.
+ *
+ * @return 0 on success, -1 if we could not get the memory
+ */
+static int handle_grow(void) {
+
+	handle_slot_t *ns;
+	uint32_t n;
+	uint32_t i;
+
+	n = registry.n_slots ? registry.n_slots * 2 : MPCRE2_REGISTRY_INITIAL_SLOTS;
+
+	ns = m_pcre2_malloc(n * sizeof(handle_slot_t), NULL);
+	if (!ns) {
+		fprintf(stderr, "Unable to grow the handle registry\n");
+		return -1;
+	}
+
+	if (registry.slots) {
+		memcpy(ns, registry.slots, registry.n_slots * sizeof(handle_slot_t));
+		m_pcre2_free(registry.slots, NULL);
+	}
+
+	/*
+	 * Free slots are chained through the pointer field
+	 */
+	for (i = registry.n_slots; i < n; i++) {
+		ns[i].ptr = (void *) (unsigned long) (i + 1);
+		ns[i].aux = NULL;
+		ns[i].gen = 1;
+		ns[i].type = HANDLE_FREE;
+	}
+
+	registry.slots = ns;
+	registry.first_free = registry.n_slots;
+	registry.n_slots = n;
+
+	return 0;
+}
+
+/**
+ * @brief Register an object and encode its handle
+ *
+ * A NULL object (usually a failed create) encodes as "0".
+ *
+ * @param ptr The object
+ * @param type The type of the object
+ * @param buf String storage for the handle
+ * @param size Size of storage
+ *
+ * @return 0 on success, -1 on failure, in which case "0" is stored
+ */
+static int handle_encode(void *ptr, uint32_t type, char *buf, int size) {
+
+	uint32_t slot;
+	handle_slot_t *hs;
+
+	if (!ptr) {
+		snprintf(buf, size, "0");
+		return -1;
+	}
+
+	if (registry.first_free >= registry.n_slots && handle_grow() < 0) {
+		snprintf(buf, size, "0");
+		return -1;
+	}
+
+	slot = registry.first_free;
+	hs = &registry.slots[slot];
+	registry.first_free = (uint32_t) (unsigned long) hs->ptr;
+
+	hs->ptr = ptr;
+	hs->aux = NULL;
+	hs->type = type;
+
+	snprintf(buf, size, "%c%u.%u", handle_types[type].tag, slot, hs->gen);
+
+	return 0;
+}
+
+/**
+ * @brief Release a handle
+ *
+ * The slot goes back on the free list with a new generation, so the old
+ * handle no longer decodes.  The object itself is not freed.
+ *
+ * @param hstr The handle
+ * @param type The type of handle expected
+ *
+ * @return The object the handle referred to, or NULL if it was not a live handle
+ */
+static void *handle_release(const char *hstr, uint32_t type) {
+
+	handle_slot_t *hs;
+	void *ptr;
+
+	if (handle_is_null(hstr)) {
+		return NULL;
+	}
+
+	hs = handle_lookup(hstr, type);
+	if (!hs) {
+		fprintf(stderr, "Invalid or stale %s handle %s\n", handle_types[type].name, hstr);
+		return NULL;
+	}
+
+	ptr = hs->ptr;
+
+	if (hs->aux && type == HANDLE_CODE) {
+		code_state_free(hs->aux);
+	}
+	hs->aux = NULL;
+
+	hs->ptr = (void *) (unsigned long) registry.first_free;
+	hs->type = HANDLE_FREE;
+	hs->gen++;
+	registry.first_free = hs - registry.slots;
+
+	return ptr;
+}
+
 /*
  * In this section we have several functions which do use the PCRE2 API but are not
  * wrappers for PCRE2 functions and are not exported to M.  In general this is
@@ -410,7 +856,7 @@ static pcre2_general_context *get_general_context (char *general_context_str) {
 	 * If they supply "0" or "NULL" use or create the default_gc * else decode it.
 	 */
 	if ( (strcmp(general_context_str, "0") != 0) && (strcmp(general_context_str, "NULL") != 0) ) {
-		return (pcre2_general_context *) pointer_decode(general_context_str);
+		return (pcre2_general_context *) handle_decode(general_context_str, HANDLE_GENERAL_CONTEXT);
 	} else if (default_gc) {
 		return default_gc;
 	}
@@ -430,1564 +876,7916 @@ static pcre2_general_context *get_general_context (char *general_context_str) {
 }
 
 /**
- * @brief Get or create a compile context
+ * @brief Get a compile context
  *
- * If we are supplied "0" or "NULL", we create a generic compile context.
+ * If we are supplied "0" or "NULL", we use a default compile context which is
+ * created the first time it is needed and kept for the life of the process.
  * Otherwise we decode the given context.
  *
- * If we created the context, we set the free flag, otherwise not
+ * NULL means PCRE2's own defaults if the default context could not be created,
+ * but for a stale handle it is an error, which callers check with handle_is_null().
  *
  * @param context_str The incoming compile context handle
- * @param must_free Pointer to our free flag
  *
  * @return a pcre2_compile_context pointer or NULL
  * 
  */
-static pcre2_compile_context *get_compile_context(char *context_str, int *must_free) {
+static pcre2_compile_context *get_compile_context(char *context_str) {
 	
-	pcre2_general_context *gc;
-	pcre2_compile_context *cc;
-
-	*must_free = 0;
+	static pcre2_compile_context *default_cc = NULL;
 
 	if ( (strcmp(context_str, "0") != 0) && (strcmp(context_str, "NULL") != 0) ) {
-		*must_free = 0;
-		return (pcre2_compile_context *) pointer_decode(context_str);
+		return (pcre2_compile_context *) handle_decode(context_str, HANDLE_COMPILE_CONTEXT);
+	} else if (default_cc) {
+		return default_cc;
 	}
 
-	gc = get_general_context("0");
-	cc = pcre2_compile_context_create(gc);
+	default_cc = pcre2_compile_context_create(get_general_context("0"));
 
-	if (!cc) {
+	if (!default_cc) {
 		fprintf(stderr, "Can't allocate compile context!\n");
 		return NULL;
 	}
 
-	*must_free = 1;
+	return default_cc;
+}
+
+/**
+ * This type holds a named match profile: a match context with limits (and
+ * perhaps a JIT stack) set up once, which M refers to by name.  The limits are
+ * kept here as well as in the context so the profile can be set up again elsewhere.
+ * A limit which is negative was not given and is left at the PCRE2 default.
+ */
+typedef struct match_profile {
+	struct match_profile *next;	///< Next profile
+	pcre2_match_context *mc;	///< The match context
+	pcre2_jit_stack *jit_stack;	///< The profile's JIT stack, or NULL
+	long match_limit;		///< pcre2_set_match_limit() value
+	long depth_limit;		///< pcre2_set_depth_limit() value
+	long heap_limit;		///< pcre2_set_heap_limit() value
+	long offset_limit;		///< pcre2_set_offset_limit() value
+	long jit_stack_size;		///< Maximum size of the JIT stack
+	char name[32];			///< Profile name
+} match_profile_t;
+
+static match_profile_t *match_profiles = NULL;	///< List of the named match profiles
+
+/**
+ * @brief Find a named match profile
+ *
+ * @param name The profile name
+ *
+ * @return The profile, or NULL if there is none by that name
+ */
+static match_profile_t *match_profile_find(const char *name) {
+
+	match_profile_t *prof;
+
+	for (prof = match_profiles; prof; prof = prof->next) {
+		if (strcmp(prof->name, name) == 0) {
+			return prof;
+		}
+	}
 
-	return cc;
+	return NULL;
 }
 
+/**
+ * @brief Smallest JIT stack we create, the same as the machine stack PCRE2 uses by default
+ */
+#define MPCRE2_JIT_STACK_MIN (32 * 1024)
+
+/**
+ * This type holds the process-wide JIT stack shared by the default match context
+ * and by profiles without a JIT stack of their own
+ */
+typedef struct jit_stack_pool {
+	pcre2_jit_stack *stack;		///< The stack, or NULL for PCRE2's 32K machine stack
+	size_t size;			///< Maximum size of the stack
+	size_t ceiling;			///< Size beyond which we will not grow the stack
+	size_t high_water;		///< Largest stack a match has had to grow it to
+	unsigned long grows;		///< Number of times the stack has been grown
+	int used;			///< Set by jit_stack_callback(), so we know the stack was ours
+	int grown;			///< Set once the stack is grown for the match being retried
+} jit_stack_pool_t;
+
+static jit_stack_pool_t jit_stacks = { NULL, MPCRE2_JIT_STACK_MIN, 16 * 1024 * 1024, 0, 0, 0, 0 };	///< The shared JIT stack
 
 /**
- * @brief Get or create a match context
+ * @brief JIT stack callback handing out the shared JIT stack
  *
- * If we are supplied "0" or "NULL", we create a generic match context.
- * Otherwise we decode the given context.
+ * @param data Not used
  *
- * If we created the context, we set the free flag, otherwise not
+ * @return The shared stack, or NULL for PCRE2's own 32K stack
+ */
+static pcre2_jit_stack *jit_stack_callback(void *data) {
+
+	jit_stacks.used = 1;
+
+	return jit_stacks.stack;
+}
+
+/**
+ * @brief Replace the shared JIT stack with one of the given size
  *
- * @param context_str The incoming match context handle
- * @param must_free Pointer to our free flag
+ * @param size Maximum size of the new stack
  *
- * @return a pcre2_match_context pointer or NULL
- * 
+ * @return 0 on success, PCRE2_ERROR_NOMEMORY if the stack could not be created
  */
-static pcre2_match_context *get_match_context(char *context_str, int *must_free) {
-	
-	pcre2_general_context *gc;
-	pcre2_match_context *mc;
+static int jit_stack_resize(size_t size) {
 
-	*must_free = 0;
+	pcre2_jit_stack *stack;
 
-	if ( (strcmp(context_str, "0") != 0) && (strcmp(context_str, "NULL") != 0) ) {
-		*must_free = 0;
-		return (pcre2_match_context *) pointer_decode(context_str);
+	stack = pcre2_jit_stack_create(MPCRE2_JIT_STACK_MIN, size, get_general_context("0"));
+	if (!stack) {
+		return PCRE2_ERROR_NOMEMORY;
 	}
 
-	gc = get_general_context("0");
-	mc = pcre2_match_context_create(gc);
+	pcre2_jit_stack_free(jit_stacks.stack);
+	jit_stacks.stack = stack;
+	jit_stacks.size = size;
 
-	if (!mc) {
-		fprintf(stderr, "Can't allocate match context!\n");
-		return NULL;
+	return 0;
+}
+
+/**
+ * @brief Double the shared JIT stack, up to the ceiling
+ *
+ * @return 0 if the stack grew, < 0 if it is already at the ceiling or could not grow
+ */
+static int jit_stack_grow(void) {
+
+	size_t size;
+
+	if (jit_stacks.size >= jit_stacks.ceiling) {
+		return -1;
 	}
 
-	*must_free = 1;
+	size = jit_stacks.size * 2;
+	if (size > jit_stacks.ceiling) {
+		size = jit_stacks.ceiling;
+	}
 
-	return mc;
-}
+	if (jit_stack_resize(size) < 0) {
+		return -1;
+	}
+	jit_stacks.grows++;
 
+	return 0;
+}
 
 /**
- * @brief Turn various pcre2 options presented as C strings into integers
+ * @brief Decide whether a match should be tried again with a bigger shared JIT stack
  *
- * Normally, when using options in certain pcre2 functions, the options are presented as
- * a bitmap constructed by logically ORing macros.  When the options come in
- * from M, they are a string that looks the same as the C interface, but which
- * must be parsed out since this is not easily done on the M side.
+ * Clear jit_stacks.used before each match, then pass this the result.  If the
+ * match ran out of the shared stack, the stack is grown and we say to retry.
+ * Once a match which had to grow the stack gets through, the size it needed is
+ * the high-water mark, which is what to presize the stack to.  Matches which
+ * fit the stack as it is say nothing about how much they need, so they don't
+ * touch it.
  *
- * This means we are called with strings like:
- * 
- *	"PCRE2_ANCHORED|PCRE2_ALLOW_EMPTY_CLASS|PCRE2_ALT_BSUX"
+ * @param res The result of the match
  *
- * If an error is encountered, -1 will be returned, otherwise the indicated
- * logical OR will be.
- *
- * This parse function is used with several different option tables.
- *
- * @param option_table table mapping strings to bitmasks
- * @param option_count number of entries in the option table
- * @param opt_tag String to use as a label for this set of options in error messages
- * @param options A null terminated C string indicating flags.
- * @param result  Pointer to the storage for the ORed flags result
- *
- * @return 0 on success or -1 on error
- * 
+ * @return Non-zero if the match should be tried again
  */
-static int parse_pcre2_options(struct opt_tab *option_table, int option_count, char *opt_tag,
-	char *options, uint32_t *result) {
-
-	size_t len;
-	char *saveptr;
-	char *token;
-	uint32_t res = 0;
-	char *cpt;
-	char *save_cpt;
-	int found;
-	int i;
+static int jit_stack_retry(int res) {
 
-	/*
-	 * It is possible that options are 0, in which case we don't have to do much.
-	 */
-	if(strcmp(options, "0") == 0) {
-		*result = 0;
+	if (!jit_stacks.used) {
 		return 0;
 	}
 
-	/*
-	 * Otherwise, we need to copy options so we can process with strtok_r()
-	 * Note that we will set cpt = NULL in some cases, so we need to keep a copy to free
-	 */
-	len = strlen(options);
-	cpt = m_pcre2_malloc(len + 1, NULL);
-	if (!cpt) {
-		fprintf(stderr, "Can't malloc to parse options!\n");
-		return -1;
+	if (res == PCRE2_ERROR_JIT_STACKLIMIT && jit_stack_grow() == 0) {
+		jit_stacks.grown = 1;
+		return 1;
 	}
-	save_cpt = cpt;
-	strncpy(cpt, options, len + 1);
-
-	while ( (token = strtok_r(cpt, "|", &saveptr)) ) {
-
-		found = 0;
-		for(i = 0; i < option_count; i++) {
-			if (strcmp(token, option_table[i].name) == 0) {
-				res |= option_table[i].val;
-				found = 1;
-				break;
-			}
-		}
-
-		if (!found) {
-			fprintf(stderr, "Unknown %s option %s\n", opt_tag, token);
-			m_pcre2_free(save_cpt, NULL);
-			return -1;
-		}
 
-		cpt = NULL;	/* signal strtok_r to continue last parse */
+	if (jit_stacks.grown && res != PCRE2_ERROR_JIT_STACKLIMIT && jit_stacks.size > jit_stacks.high_water) {
+		jit_stacks.high_water = jit_stacks.size;
 	}
-
-	*result = res;
-
-	m_pcre2_free(save_cpt, NULL);
+	jit_stacks.grown = 0;
 
 	return 0;
 }
 
-/*
- * This section contains exported helper functions which do not directly map to
- * the PCRE2 API, but paper over the differences between M & C
- */
-
 /**
- * @brief Get the default MPCRE2 general context
+ * @brief Get a match context
  *
- * MPCRE2 creates a default general context which is used behind the scenes.
- * This general context uses M memory allocation and dallocation.  If this is
- * needed on the M side we use this function to access it.
+ * If we are supplied "0" or "NULL", we use a default match context which is
+ * created the first time it is needed and kept for the life of the process, and
+ * which uses the shared JIT stack (see code_match()).  If we are supplied the name of a profile defined with pcre2defineprofile, we
+ * use its context.  Otherwise we decode the given context.
  *
- * @param count The parameter count from the M API
+ * As with get_compile_context(), NULL for a stale handle is an error, which
+ * callers check with handle_is_null().
  *
- * @return A string handle for the GC
+ * @param context_str The incoming match context handle or profile name
  *
+ * @return a pcre2_match_context pointer or NULL
+ * 
  */
-gtm_char_t *mpcre2_get_general_context(int count) {
+static pcre2_match_context *get_match_context(char *context_str) {
 	
-	pcre2_general_context *gc;
-	static char buf[80];
+	static pcre2_match_context *default_mc = NULL;
+	match_profile_t *prof;
 
-	gc = get_general_context("NULL");
+	if ( (strcmp(context_str, "0") != 0) && (strcmp(context_str, "NULL") != 0) ) {
+		if (!handle_lookup(context_str, HANDLE_MATCH_CONTEXT) &&
+			(prof = match_profile_find(context_str)) != NULL) {
+			return prof->mc;
+		}
+		return (pcre2_match_context *) handle_decode(context_str, HANDLE_MATCH_CONTEXT);
+	} else if (default_mc) {
+		return default_mc;
+	}
 
-	pointer_encode(gc, buf, sizeof(buf));
+	default_mc = pcre2_match_context_create(get_general_context("0"));
 
-	return buf;
+	if (!default_mc) {
+		fprintf(stderr, "Can't allocate match context!\n");
+		return NULL;
+	}
+
+	pcre2_jit_stack_assign(default_mc, jit_stack_callback, NULL);
+
+	return default_mc;
 }
 
+static unsigned long jit_threshold = 0;	///< Matches after which a pattern is JIT compiled, 0 for never
+
 /**
- * @brief Return an output vector pair
+ * @brief Count a match against a pattern, JIT compiling the pattern once it is hot
  *
- * Since M cannot directly manipulate output vector pointers, this access function
- * is needed to take the handle and an index and return the queried output
- * vector pair
+ * Once a pattern has been matched jit_threshold times it is JIT compiled with
+ * PCRE2_JIT_COMPLETE.  This is only tried once per pattern; if it fails the
+ * pattern stays with the interpreter.
  *
- * @param count Parameter count provided by the M API
- * @param ovector_str A string handle for a pointer to the output vector pairs
- * @param index Which pair to return
- * @param p0 Pointer to the first element of the pair to return
- * @param p1 Pointer to the second element of the pair to return
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern, or NULL
  *
  * @return None
  */
-void mpcre2_get_ov_pair(int count, gtm_char_t *ovector_str, gtm_long_t index, gtm_long_t *p0, gtm_long_t *p1) {
-
-	PCRE2_SIZE *ov;
+static void code_count_match(pcre2_code *code, code_state_t *state) {
 
-	ov = (PCRE2_SIZE *) pointer_decode(ovector_str);
+	if (!state || state->jit_tried) {
+		return;
+	}
 
-	*p0 = ov[index*2];
-	*p1 = ov[(index*2)+1];
+	if (++state->matches >= jit_threshold && jit_threshold > 0) {
+		state->jit_tried = 1;
+		if (pcre2_jit_compile(code, PCRE2_JIT_COMPLETE) == 0) {
+			state->jit = 1;
+		}
+	}
 }
 
 /**
- * @brief Copy a buffer allocated in C to an M string
- * 
- * @param count Parameter count from the M API
- * @param buffer_ptr_str String handle for the buffer pointer
- * @param len Length of the buffer
- *
- * @return a gtm_string_t with the buffer address and length
+ * @brief Match options which pcre2_jit_match() accepts
  */
-gtm_string_t *mpcre2_get_mstring_from_buf(int count, gtm_char_t *buffer_ptr_str, gtm_long_t len) {
-
-	static gtm_string_t ret;
-
-	ret.address = pointer_decode(buffer_ptr_str);
-	ret.length = len;
-
-	return &ret;
-}
+#define MPCRE2_JIT_MATCH_OPTIONS (PCRE2_NO_UTF_CHECK | PCRE2_NOTBOL | PCRE2_NOTEOL | PCRE2_NOTEMPTY | \
+	PCRE2_NOTEMPTY_ATSTART | PCRE2_PARTIAL_SOFT | PCRE2_PARTIAL_HARD)
 
 /**
- * @brief Return the number of captured substrings from a substring list
- *
- * This is a helper function for pcre2_substring_list_get() and requires
- * that function to be called first to establish the two pointers used here.
- *
- * @param count Parameter count from the M API
- * @param listptr_str String handle for the substring list
- *
- * @return The number of substrings in the list
+ * @brief Match a compiled pattern, taking the JIT fast path when we can
+ *
+ * When the pattern has JIT code and the options allow it, pcre2_jit_match() is called
+ * directly, skipping the checks pcre2_match() makes before handing over to the JIT code.
+ * A UTF pattern only goes this way with PCRE2_NO_UTF_CHECK, since pcre2_jit_match()
+ * does not check the subject.  If the JIT code can't handle the options (for instance
+ * a partial match when the pattern was only compiled with PCRE2_JIT_COMPLETE) we get
+ * PCRE2_ERROR_JIT_BADOPTION, and fall back to the interpreter.
+ *
+ * The match is counted towards the pattern's JIT threshold (see code_count_match()).
+ *
+ * If the JIT code runs out of the shared JIT stack (PCRE2_ERROR_JIT_STACKLIMIT), the
+ * stack is doubled and the match tried again, until the stack reaches its ceiling.
+ * Contexts with a JIT stack of their own are left alone.
+ *
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern, or NULL
+ * @param subject The subject string
+ * @param length Length of the subject
+ * @param startoffset Where to start matching
+ * @param options Match options
+ * @param match_data Match data block
+ * @param mc Match context, or NULL
+ *
+ * @return As for pcre2_match()
  */
-gtm_long_t mpcre2_get_substring_list_count(int count, gtm_char_t *listptr_str) {
+static int code_match(pcre2_code *code, code_state_t *state, PCRE2_SPTR subject, PCRE2_SIZE length,
+	PCRE2_SIZE startoffset, uint32_t options, pcre2_match_data *match_data, pcre2_match_context *mc) {
 
-	PCRE2_UCHAR **listptr;
-	PCRE2_UCHAR *cpt;
-	int i;
+	uint32_t match_options;
+	int res;
 
-	listptr = (PCRE2_UCHAR **) pointer_decode(listptr_str);
+	code_count_match(code, state);
 
-	/*
-	 * The end of the list is signaled by a NULL pointer.  Obviously we
-	 * are hosed if it is not there.
-	 */
-	if (!listptr[0])
-		return 0;
+	for (;;) {
+		jit_stacks.used = 0;
+		match_options = options;
 
-	for(i = 1;; ++i) {
-		cpt = listptr[i];
-		if (!cpt)
+		if (state && state->jit && match_data && startoffset <= length &&
+			(options & ~MPCRE2_JIT_MATCH_OPTIONS) == 0 &&
+			(!state->utf || (options & PCRE2_NO_UTF_CHECK))) {
+
+			res = pcre2_jit_match(code, subject, length, startoffset, options, match_data, mc);
+			if (res == PCRE2_ERROR_JIT_BADOPTION) {
+				match_options |= PCRE2_NO_JIT;
+				res = pcre2_match(code, subject, length, startoffset, match_options, match_data, mc);
+			}
+		} else {
+			res = pcre2_match(code, subject, length, startoffset, match_options, match_data, mc);
+		}
+
+		if (!jit_stack_retry(res)) {
 			break;
+		}
 	}
 
-	return i;
+	return res;
 }
 
 /**
- * @brief Return an M string from a pcre2 substring list
+ * This type holds the state of a global (find every match) loop over one subject
+ */
+typedef struct global_match {
+	pcre2_code *code;		///< The compiled pattern
+	code_state_t *state;		///< mpcre2 state for the pattern, or NULL
+	PCRE2_SPTR subject;		///< The subject string
+	PCRE2_SIZE length;		///< Length of the subject
+	uint32_t options;		///< Match options given by the caller
+	pcre2_match_data *match_data;	///< Match data for the loop
+	pcre2_match_context *mc;	///< Match context, or NULL
+	PCRE2_SIZE offset;		///< Where the first match starts looking
+	PCRE2_SIZE start;		///< Start of the previous match
+	PCRE2_SIZE end;			///< End of the previous match
+	int started;			///< Non-zero once the first match has been run
+	int crlf;			///< Non-zero if CRLF is a valid newline for the pattern
+	int utf;			///< Non-zero if the pattern is in UTF mode
+} global_match_t;
+
+/**
+ * @brief Set up a global match loop
+ *
+ * @param gm The loop state to set up
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern, or NULL
+ * @param subject The subject string
+ * @param length Length of the subject
+ * @param startoffset Where the first match starts looking
+ * @param options Match options
+ * @param match_data Match data for the loop
+ * @param mc Match context, or NULL
  *
- * This is a utility function to support pcre2_substring_list_get()
+ * @return None
+ */
+static void global_match_init(global_match_t *gm, pcre2_code *code, code_state_t *state,
+	PCRE2_SPTR subject, PCRE2_SIZE length, PCRE2_SIZE startoffset, uint32_t options,
+	pcre2_match_data *match_data, pcre2_match_context *mc) {
+
+	uint32_t all_options = 0;
+	uint32_t newline = 0;
+
+	pcre2_pattern_info(code, PCRE2_INFO_ALLOPTIONS, &all_options);
+	pcre2_pattern_info(code, PCRE2_INFO_NEWLINE, &newline);
+
+	gm->code = code;
+	gm->state = state;
+	gm->subject = subject;
+	gm->length = length;
+	gm->options = options;
+	gm->match_data = match_data;
+	gm->mc = mc;
+	gm->offset = startoffset;
+	gm->start = gm->end = 0;
+	gm->started = 0;
+	gm->utf = (all_options & PCRE2_UTF) != 0;
+	gm->crlf = newline == PCRE2_NEWLINE_ANY || newline == PCRE2_NEWLINE_CRLF ||
+		newline == PCRE2_NEWLINE_ANYCRLF;
+}
+
+/**
+ * @brief Step one character forward in a global match loop
  *
- * @param count Parameter count from the M API
- * @param listptr_str String handle for a pcre2 substring list
- * @param lenptr_str String handle for a pcre2 length list
- * @param index Index in the list of the string to return
+ * CRLF counts as one character when it is a valid newline, and in UTF mode we
+ * skip over the continuation bytes of a multi-byte character.
  *
- * @return The given string value as an M string
+ * @param gm The loop state
+ * @param offset Where to step from
+ *
+ * @return The offset of the next character
  */
-gtm_string_t *mpcre2_get_mstring_from_substring_list(int count, gtm_char_t *listptr_str, gtm_char_t *lenptr_str, gtm_long_t index) {
+static PCRE2_SIZE global_match_advance(global_match_t *gm, PCRE2_SIZE offset) {
 
-	PCRE2_UCHAR **listptr;
-	PCRE2_SIZE *lenptr;
-	static gtm_string_t ret;
+	if (gm->crlf && offset + 1 < gm->length && gm->subject[offset] == '\r' &&
+		gm->subject[offset + 1] == '\n') {
+		return offset + 2;
+	}
 
-	listptr = (PCRE2_UCHAR **) pointer_decode(listptr_str);
-	lenptr = (PCRE2_SIZE *) pointer_decode(lenptr_str);
+	offset++;
 
-	ret.address = (char *) listptr[index];
-	ret.length = lenptr[index];
+	if (gm->utf) {
+		while (offset < gm->length && (gm->subject[offset] & 0xc0) == 0x80) {
+			offset++;
+		}
+	}
 
-	return &ret;
+	return offset;
 }
 
-/*
- * This section contains functions which are exported and are 1 for 1 wrappings
- * of PCRE2 functions.  They are listed in the order given in the PCRE2
- * https://www.pcre.org/current/doc/html/pcre2api.html document. (As of a
- * certain point in time..)
- */
-
 /**
- * @brief Wrapper for M calls to pcre2_compile
+ * @brief Find the next match in a global match loop
  *
- * This function serves as a wrapper so M can call pcre2_compile().
- * The parameters are similar to the C call, but since we use an M string,
- * for the pattern, we know the length, and don't have to pass that as a
- * separate parameter. 
- * 
- * In general, refer to the PCRE2 documentation for a fuller description
- * of these parameters.  The handle returned on success will be a decimal
- * encoded pointer.
+ * This follows what pcre2test does for /g.  After an empty match we first try
+ * for a non-empty match at the same place (PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED),
+ * and only when that fails move on by one character.  If \K left the previous
+ * match ending before the point it started, we move past the start so that the
+ * loop always makes progress.
  *
- * @param count M API supplied count of arguments to this function
- * @param pattern The regular expression we are compiling
- * @param options Compile options
- * @param errorcode Output parameter to return an error if compile fails
- * @param erroroffset Output parameter indicating the byte offset of a compile failure
- * @param ccontext_str Compile context for compile, "0" for defaults
+ * @param gm The loop state
  *
- * @return A handle for this compiled pattern or a "0" string on failure
+ * @return As for pcre2_match(), with PCRE2_ERROR_NOMATCH at the end of the subject
  */
-gtm_char_t *mpcre2_compile(int count, gtm_string_t *pattern, gtm_char_t *options,
-	gtm_long_t *errorcode, gtm_ulong_t *erroroffset, gtm_char_t *ccontext_str) {
+static int global_match_next(global_match_t *gm) {
 
-	int ecode;
-	PCRE2_SIZE eoffset;
-	uint32_t compile_options;
-	pcre2_compile_context *ccontext;
-	pcre2_code *code;		/* our compiled pattern */
-	static char result[80];
-	int must_free;
+	PCRE2_SIZE *ov;
+	PCRE2_SIZE offset;
+	PCRE2_SIZE startchar;
+	uint32_t options;
+	int res;
 
-	/*
-	 * If custom compile option strings are passed in, we must
-	 * map them from string format to internal format
-	 */
-	if (parse_pcre2_options(compile_opts, n_compile_opts, "compile",
-		options, &compile_options) < 0) {
-		return "0";
-	}
+	if (!gm->started) {
+		gm->started = 1;
+		offset = gm->offset;
+		options = gm->options;
+	} else {
+		offset = gm->end;
+		options = gm->options;
 
+		if (gm->start == gm->end) {
+			if (offset >= gm->length) {
+				return PCRE2_ERROR_NOMATCH;
+			}
+			options |= PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED;
+		} else {
+			startchar = pcre2_get_startchar(gm->match_data);
+			if (offset <= startchar) {
+				if (startchar >= gm->length) {
+					return PCRE2_ERROR_NOMATCH;
+				}
+				offset = global_match_advance(gm, startchar);
+			}
+		}
+	}
 
-	ccontext = get_compile_context(ccontext_str, &must_free);
+	res = code_match(gm->code, gm->state, gm->subject, gm->length, offset, options,
+		gm->match_data, gm->mc);
 
 	/*
-	 * Now actually compile the pattern
+	 * No non-empty match where the empty one was, so try again one character on
 	 */
-	code = pcre2_compile( (PCRE2_SPTR) (pattern->address), (PCRE2_SIZE) (pattern->length),
-		compile_options, &ecode, &eoffset, ccontext);
-
-	if (must_free) {
-		pcre2_compile_context_free(ccontext);
+	if (res == PCRE2_ERROR_NOMATCH && options != gm->options) {
+		offset = global_match_advance(gm, offset);
+		res = code_match(gm->code, gm->state, gm->subject, gm->length, offset, gm->options,
+			gm->match_data, gm->mc);
 	}
 
-	*erroroffset = eoffset;
-	*errorcode = ecode;
-
-	if (!code) {
-		return "0";
+	if (res >= 0) {
+		ov = pcre2_get_ovector_pointer(gm->match_data);
+		gm->start = ov[0];
+		gm->end = ov[1];
 	}
 
-	pointer_encode(code, result, sizeof(result));
-	return result;
+	return res;
 }
 
-
 /**
- * @brief Wrap pcre2_code_free()
+ * @brief Format an output vector as "start,end" pairs separated by ";"
  *
- * We pass pcre2 code pointers back and forth to M as text.
- * We need to re-create the code pointer and free it.
+ * Pairs which are unset, or at or beyond the match return code rc, are
+ * written as "-".  Offsets are zero based byte offsets, as with pcre2getovpair.
  *
- * @param count Count of parameters from M API
- * @param code String value of a code pointer from M
+ * @param ov The output vector
+ * @param pairs Number of pairs to write
+ * @param rc Return code from the match
+ * @param buf Where to write
+ * @param size Space available in buf
  *
- * @return None
+ * @return Number of bytes written, or 0 if it would not fit
  */
-void mpcre2_code_free(int count, gtm_char_t *code) {
+static size_t ovector_format(PCRE2_SIZE *ov, uint32_t pairs, int rc, char *buf, size_t size) {
 
-	pcre2_code *ptr;
+	char *p = buf;
+	char *end = buf + size;
+	uint32_t i;
+	int len;
 
-	ptr = (pcre2_code *) pointer_decode(code);
+	for (i = 0; i < pairs; i++) {
+		if (i > 0) {
+			if (p >= end) {
+				return 0;
+			}
+			*p++ = ';';
+		}
 
-	pcre2_code_free(ptr);
+		if ((int) i >= rc || ov[i*2] == PCRE2_UNSET) {
+			if (p >= end) {
+				return 0;
+			}
+			*p++ = '-';
+			continue;
+		}
+
+		len = snprintf(p, end - p, "%zu,%zu", (size_t) ov[i*2], (size_t) ov[(i*2)+1]);
+		if (len < 0 || len >= end - p) {
+			return 0;
+		}
+		p += len;
+	}
+
+	return p - buf;
 }
 
 /**
- * @brief Wrap the pcre2_match_data_create() function
- *
- * If we are called with a non "0" general context, use it.
- * Otherwise we use our internal general context.
+ * @brief Append a "start,end" pair to a result, with a space before it if it is not the first
  *
- * @param count Count of parameters from the M API
- * @param ovecsize The size of the output vector to create
- * @param gcontext_str A custom general context or "0" in string format
+ * @param buf The result buffer
+ * @param used Bytes of buf used so far, updated
+ * @param size Size of buf
+ * @param start Start of the match
+ * @param end End of the match
  *
- * @return A stringified match data handle
+ * @return 0 on success, -1 if the pair would not fit
  */
-gtm_char_t *mpcre2_match_data_create(int count, gtm_long_t ovecsize, gtm_char_t *gcontext_str) {
-
-	pcre2_general_context *gc;
-	pcre2_match_data *md;
-	static char buf[80];
-
-	gc = get_general_context(gcontext_str);
+static int append_pair(char *buf, size_t *used, size_t size, PCRE2_SIZE start, PCRE2_SIZE end) {
 
-	md = pcre2_match_data_create(ovecsize, gc);
+	int len;
 
-	pointer_encode(md, buf, sizeof(buf));
+	len = snprintf(buf + *used, size - *used, *used ? " %zu,%zu" : "%zu,%zu", (size_t) start, (size_t) end);
+	if (len < 0 || (size_t) len >= size - *used) {
+		return -1;
+	}
+	*used += len;
 
-	return buf;
+	return 0;
 }
 
 /**
- * @brief Wrap pcre2_match_data_create_from_pattern()
+ * @brief Find how much of a buffer is whole UTF-8 characters
  *
- * If we are called with a non "0" general context, use it.
- * Otherwise we use our internal general context.
+ * Used by the streams, where a chunk may end part way through a character, and
+ * to keep pieces of a substitute result whole.
  *
- * @param count Count of parameters from the M API
- * @param code_str A compiled pcre2 regular expression pointer in string format
- * @param gcontext_str A custom general context or "0" in string format
+ * @param buf The buffer
+ * @param len Length of the buffer
  *
- * @return A stringified match data pointer
+ * @return len, less the bytes of an incomplete character at the end
  */
-gtm_char_t *mpcre2_match_data_create_from_pattern(int count, gtm_char_t *code_str,
-	gtm_char_t *gcontext_str) {
+static size_t utf8_whole_length(const char *buf, size_t len) {
 
-	pcre2_code *code;
-	pcre2_general_context *gc;
-	pcre2_match_data *md;
-	static char buf[80];
+	unsigned char lead;
+	size_t back;
+	size_t need;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	for (back = 1; back <= 3 && back <= len; back++) {
+		if ((buf[len - back] & 0xc0) != 0x80) {
+			break;
+		}
+	}
+	if (back > 3 || back > len) {
+		return len;
+	}
 
-	gc = get_general_context(gcontext_str);
+	lead = (unsigned char) buf[len - back];
+	need = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
 
-	md = pcre2_match_data_create_from_pattern(code, gc);
+	return need > back ? len - back : len;
+}
 
-	pointer_encode(md, buf, sizeof(buf));
+/**
+ * Most bytes a value returned to M can have, which is GT.M's longest string
+ */
+#define MPCRE2_VALUE_MAX 1048576
 
-	return buf;
-}
+/**
+ * This type is a buffer kept between calls, such as the one behind strings returned by value
+ */
+typedef struct value_buffer {
+	char *buf;			///< The buffer, or NULL before first use
+	size_t size;			///< Size of buf in bytes
+} value_buffer_t;
+
+static value_buffer_t value_buffer = { NULL, 0 };
 
 /**
- * @brief wrap pcre2_match() for M
+ * @brief Make sure a kept buffer holds at least size bytes
  *
- * We bring in "subject" as an M string, so we can have embedded zero bytes.  This gives
- * us a length, so we don't have a separate parameter for that.
+ * The buffer only ever grows, so after the first few calls using it there
+ * is no allocation at all.  It is allocated on first use even if size is 0,
+ * so that NULL always means failure.
  *
- * @param count Count of parameters from the M API
- * @param code_str A pcre2 compiled regular expression pointer in string format
- * @param subject The string to search for matches
- * @param startoffset The byte offset at which to start the match search
- * @param options_str Pcre2 match options in string form
- * @param match_data_str A Pcre2 match data pointer in string format
- * @param mcontext_str A Pcre2 match context pointer in string format, or "0"
+ * @param vb The buffer
+ * @param size Bytes needed
  *
- * @return < 0 on error or no match, 0 vector offests too small, else one more than the highest numbered capturing pair that has been set
+ * @return The buffer, or NULL if it could not be grown
  */
-gtm_long_t mpcre2_match(int count, gtm_char_t *code_str, gtm_string_t *subject,
-	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
-	gtm_char_t *mcontext_str) {
+static char *value_buffer_reserve(value_buffer_t *vb, size_t size) {
 
-	pcre2_code *code;
-	pcre2_match_data *match_data;
-	pcre2_match_context *mc;
-	uint32_t options;
-	int must_free;
-	gtm_long_t res;
+	char *nbuf;
+	size_t nsize;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	if (size <= vb->size && vb->buf) {
+		return vb->buf;
+	}
 
-	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
-		return -1;
+	nsize = vb->size ? vb->size : 256;
+	while (nsize < size) {
+		nsize *= 2;
+	}
+
+	nbuf = m_pcre2_malloc(nsize, NULL);
+	if (!nbuf) {
+		return NULL;
 	}
+	if (vb->buf) {
+		m_pcre2_free(vb->buf, NULL);
+	}
+	vb->buf = nbuf;
+	vb->size = nsize;
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
+	return nbuf;
+}
 
-	mc = get_match_context(mcontext_str, &must_free);
+/**
+ * @brief Mark every pair in a new match data block's output vector as unset
+ *
+ * pcre2_match() never touches pairs beyond the pattern's capture groups, so
+ * without this pcre2getovector would report whatever was left in memory.
+ *
+ * @param md The match data, or NULL
+ *
+ * @return None
+ */
+static void match_data_reset(pcre2_match_data *md) {
 
-	res = pcre2_match(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
-		(PCRE2_SIZE) startoffset, options, match_data, mc);
+	PCRE2_SIZE *ov;
+	uint32_t i;
 
-	if (must_free) {
-		pcre2_match_context_free(mc);
+	if (!md) {
+		return;
 	}
 
-	return res;
-
+	ov = pcre2_get_ovector_pointer(md);
+	for (i = 0; i < pcre2_get_ovector_count(md) * 2; i++) {
+		ov[i] = PCRE2_UNSET;
+	}
 }
 
 /**
- * @brief wrap pcre2_dfa_match() for M
+ * @brief Get the match data kept with a compiled pattern, creating it the first time
  *
- * We bring in "subject" as an M string, so we can have embedded zero bytes.  This gives
- * us a length, so we don't have a separate parameter for that.  Additionally, there is
- * no way, or reason to pass in a vector of ints for "workspace from M, so we simply accept
- * a count, and allocate that many on the stack.
+ * The match data is sized from the pattern and lives as long as the pattern, so
+ * matching with "AUTO" costs no allocation after the first match.  PCRE2 keeps
+ * its backtracking frame vector in the match data, so that is reused too.  The
+ * match data gets a handle of its own, so that the last match can be looked at
+ * with the usual functions, but it is marked as belonging to the pattern so that
+ * pcre2matchdatafree will not free it.
  *
- * @param count Count of parameters from the M API
- * @param code_str A pcre2 compiled regular expression pointer in string format
- * @param subject The string to search for matches
- * @param startoffset The byte offset at which to start the match search
- * @param options_str Pcre2 match options in string form
- * @param match_data_str A Pcre2 match data pointer in string format
- * @param mcontext_str A Pcre2 match context pointer in string format, or "0"
- * @param wscount Number of entries to create in the workspace vector
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern, or NULL
  *
- * @return < 0 on error or no match, 0 vector offests too small, else one more than the highest numbered capturing pair that has been set
+ * @return The match data, or NULL if it could not be created
  */
-gtm_long_t mpcre2_dfa_match(int count, gtm_char_t *code_str, gtm_string_t *subject,
-	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
-	gtm_char_t *mcontext_str, gtm_long_t wscount) {
-
-	pcre2_code *code;
-	pcre2_match_data *match_data;
-	pcre2_match_context *mc;
-	uint32_t options;
-	int workspace[wscount];
-	int must_free;
-	gtm_long_t res;
+static pcre2_match_data *code_match_data(pcre2_code *code, code_state_t *state) {
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	handle_slot_t *hs;
 
-	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
-		return -1;
+	if (!state) {
+		return NULL;
 	}
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
-
-	mc = get_match_context(mcontext_str, &must_free);
+	if (state->md) {
+		return state->md;
+	}
 
-	res = pcre2_dfa_match(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
-		(PCRE2_SIZE) startoffset, options, match_data, mc, workspace, (PCRE2_SIZE) wscount);
+	state->md = pcre2_match_data_create_from_pattern(code, get_general_context("0"));
+	if (!state->md) {
+		return NULL;
+	}
+	match_data_reset(state->md);
 
-	if (must_free) {
-		pcre2_match_context_free(mc);
+	if (handle_encode(state->md, HANDLE_MATCH_DATA, state->md_handle, sizeof(state->md_handle)) < 0) {
+		pcre2_match_data_free(state->md);
+		state->md = NULL;
+		return NULL;
 	}
 
-	return res;
+	hs = handle_lookup(state->md_handle, HANDLE_MATCH_DATA);
+	hs->aux = state;
 
+	return state->md;
 }
 
 /**
- * @brief Wrap the pcre2_match_data_free() function
+ * @brief Decode a match data handle, where "AUTO" means the pattern's own match data
  *
- * @param count M API argument count
- * @param match_data_str Stringified match data pointer
- * 
- * @return None
+ * @param match_data_str The match data handle, "AUTO", or "0"
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern, or NULL
+ *
+ * @return The match data, or NULL
  */
-void mpcre2_match_data_free(int count, gtm_char_t *match_data_str) {
+static pcre2_match_data *match_data_decode(const char *match_data_str, pcre2_code *code,
+	code_state_t *state) {
 
-	pcre2_match_data *match_data;
-
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
+	if (strcmp(match_data_str, "AUTO") == 0) {
+		return code_match_data(code, state);
+	}
 
-	pcre2_match_data_free(match_data);
+	return (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
 }
 
+
 /**
- * @brief wrap pcre2_get_mark()
+ * @brief Number of hash buckets in the option string cache
+ */
+#define MPCRE2_OPTCACHE_BUCKETS 256
+
+/**
+ * @brief Maximum number of option strings remembered by the option string cache
+ */
+#define MPCRE2_OPTCACHE_MAX 1024
+
+/**
+ * This type remembers the result of parsing one option string against one option table
+ */
+typedef struct optcache_entry {
+	struct optcache_entry *next;	///< Next entry in the same hash bucket
+	struct opt_tab *table;		///< The option table the string was parsed with
+	uint32_t hash;			///< Hash of the option string
+	uint32_t val;			///< The parsed bitmask
+	char options[];			///< The option string exactly as given
+} optcache_entry_t;
+
+static optcache_entry_t *optcache[MPCRE2_OPTCACHE_BUCKETS];	///< The option string cache, shared by all option tables
+static int n_optcache;						///< Number of entries in the option string cache
+
+/**
+ * @brief Turn various pcre2 options presented as C strings into integers
  *
- * Note this text from the PCRE2 documentation:
+ * Normally, when using options in certain pcre2 functions, the options are presented as
+ * a bitmap constructed by logically ORing macros.  When the options come in
+ * from M, they are a string that looks the same as the C interface, but which
+ * must be parsed out since this is not easily done on the M side.
  *
- *	After a successful match, a partial match
- *	(PCRE2_ERROR_PARTIAL), or a failure to match
- *	(PCRE2_ERROR_NOMATCH), a mark name may be
- *	available. The function pcre2_get_mark()
- *	can be called to access this name, which
- *	can be specified in the pattern by any of
- *	the backtracking control verbs, not just
- *	(*MARK). The same function applies to all
- *	the verbs. It returns a pointer to the
- *	zero-terminated name, which is within the
- *	compiled pattern. If no name is available,
- *	NULL is returned. The length of the name
- *	(excluding the terminating zero) is stored
- *	in the code unit that precedes the name. You
- *	should use this length instead of relying
- *	on the terminating zero if the name might
- *	contain a binary zero.
+ * This means we are called with strings like:
+ * 
+ *	"PCRE2_ANCHORED|PCRE2_ALLOW_EMPTY_CLASS|PCRE2_ALT_BSUX"
  *
- *  So we are given liberty to index *BACKWARD* from the
- *  given string, as unusual as that might seem.  In fact
- *  we do do this, so we can construct an M string which will
- *  still be OK if it contains zero bytes.  Since we only handle
- *  8 bit code units, the length of the mark name ipso facto
- *  must be <= 255.
+ * The same few option strings are passed on almost every call, so the result of
+ * each parse is remembered, keyed on the option table and the exact string.
+ * A string of decimal digits (such as "0", or the value returned from
+ * mpcre2_option_mask()) is taken as the bitmask itself and is only checked for
+ * overflow and for bits that are not in the option table.
  *
- * @param count Paramater count from the M API
- * @param match_data_str A match data handle
+ * If an error is encountered, -1 will be returned, otherwise the indicated
+ * logical OR will be.
  *
- * @return A mark name, or zero length string if none is available
+ * This parse function is used with several different option tables.
+ *
+ * @param option_table table mapping strings to bitmasks
+ * @param option_count number of entries in the option table
+ * @param opt_tag String to use as a label for this set of options in error messages
+ * @param options A null terminated C string indicating flags.
+ * @param result  Pointer to the storage for the ORed flags result
  *
+ * @return 0 on success or -1 on error
+ * 
  */
-gtm_string_t *mpcre2_get_mark(int count, gtm_char_t *match_data_str) {
+static int parse_pcre2_options(struct opt_tab *option_table, int option_count, const char *opt_tag,
+	char *options, uint32_t *result) {
 
-	pcre2_match_data *match_data;
-	unsigned char mark_len;
-	char *mark_name;
-	static gtm_string_t ret;
+	uint32_t res = 0;
+	uint32_t h;
+	char *cpt;
+	char *end;
+	size_t len;
+	size_t toklen;
+	optcache_entry_t *entry;
+	int found;
+	int i;
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
+	/*
+	 * Numeric options are a precomputed bitmask, in which case we don't have to do much.
+	 */
+	if (*options >= '0' && *options <= '9') {
+		for (cpt = options; *cpt >= '0' && *cpt <= '9'; cpt++) {
+			if (res > (UINT32_MAX - (uint32_t) (*cpt - '0')) / 10) {
+				fprintf(stderr, "%s option %s is out of range\n", opt_tag, options);
+				return -1;
+			}
+			res = (res * 10) + (*cpt - '0');
+		}
+		if (*cpt == '\0') {
+			uint32_t known = 0;
 
-	mark_name = (char *) pcre2_get_mark(match_data);
+			for (i = 0; i < option_count; i++) {
+				known |= option_table[i].val;
+			}
+			if (res & ~known) {
+				fprintf(stderr, "Unknown %s option bits 0x%x\n", opt_tag, res & ~known);
+				return -1;
+			}
+			*result = res;
+			return 0;
+		}
+		res = 0;
+	}
 
-	ret.address = NULL;
-	ret.length = 0;
+	/*
+	 * See if we have parsed this string against this table before
+	 */
+	h = 2166136261u;
+	for (cpt = options; *cpt; cpt++) {
+		h = (h ^ (unsigned char) *cpt) * 16777619u;
+	}
+	len = cpt - options;
 
-	if (mark_name) {
-		ret.address = mark_name;
-		mark_len = (unsigned char) mark_name[-1];	/* see note in function header */
-		ret.length = (int) mark_len;
-	} 
+	for (entry = optcache[h % MPCRE2_OPTCACHE_BUCKETS]; entry; entry = entry->next) {
+		if (entry->hash == h && entry->table == option_table && strcmp(entry->options, options) == 0) {
+			*result = entry->val;
+			return 0;
+		}
+	}
 
-	return &ret;
+	/*
+	 * Otherwise, walk the '|' separated names in place
+	 */
+	for (cpt = options; *cpt; cpt = (*end) ? end + 1 : end) {
+
+		end = strchr(cpt, '|');
+		if (!end) {
+			end = cpt + strlen(cpt);
+		}
+		toklen = end - cpt;
+		if (toklen == 0) {
+			continue;	/* tolerate "||" and a trailing '|' */
+		}
+
+		found = 0;
+		for(i = 0; i < option_count; i++) {
+			if (strncmp(cpt, option_table[i].name, toklen) == 0 && option_table[i].name[toklen] == '\0') {
+				res |= option_table[i].val;
+				found = 1;
+				break;
+			}
+		}
+
+		if (!found) {
+			fprintf(stderr, "Unknown %s option %.*s\n", opt_tag, (int) toklen, cpt);
+			return -1;
+		}
+	}
+
+	*result = res;
+
+	/*
+	 * Remember the result.  If we can't, it will just be parsed again next time.
+	 */
+	if (n_optcache < MPCRE2_OPTCACHE_MAX) {
+		entry = m_pcre2_malloc(sizeof(optcache_entry_t) + len + 1, NULL);
+		if (entry) {
+			entry->table = option_table;
+			entry->hash = h;
+			entry->val = res;
+			memcpy(entry->options, options, len + 1);
+			entry->next = optcache[h % MPCRE2_OPTCACHE_BUCKETS];
+			optcache[h % MPCRE2_OPTCACHE_BUCKETS] = entry;
+			n_optcache++;
+		}
+	}
 
+	return 0;
 }
 
+/*
+ * This section implements a process-wide cache of compiled patterns.  M code
+ * tends to compile the same few patterns over and over again because keeping
+ * handles in M locals across routines is awkward.  The cache is keyed on the
+ * pattern bytes, the parsed compile options and the compile context, and is
+ * kept within a byte budget by evicting the least recently used entries.
+ * Entries for a compile context are dropped when it is changed or freed.
+ */
+
 /**
- * @brief wrap the pcre2_get_ovector_count() function
+ * @brief Default memory budget for the compiled pattern cache, in bytes
+ */
+#define MPCRE2_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+
+/**
+ * @brief Initial number of hash buckets in the compiled pattern cache
+ */
+#define MPCRE2_CACHE_INITIAL_BUCKETS 64
+
+/**
+ * This type holds one compiled pattern in the cache.  Entries are chained
+ * into a hash bucket and into a doubly linked LRU list at the same time.
+ */
+typedef struct cache_entry {
+	struct cache_entry *hnext;		///< Next entry in the same hash bucket
+	struct cache_entry *newer;		///< More recently used neighbour in the LRU list
+	struct cache_entry *older;		///< Less recently used neighbour in the LRU list
+	uint32_t hash;				///< Hash of pattern, options and compile context
+	uint32_t options;			///< Parsed compile options
+	pcre2_compile_context *ccontext;	///< Compile context, NULL for the default
+	pcre2_code *code;			///< The compiled pattern owned by the cache
+	size_t size;				///< Bytes charged against the cache budget
+	char handle[24];			///< The encoded handle returned to M
+	size_t pattern_len;			///< Length of the pattern
+	char pattern[];				///< The pattern bytes
+} cache_entry_t;
+
+/**
+ * This type holds the state of the compiled pattern cache
+ */
+typedef struct pattern_cache {
+	cache_entry_t **buckets;		///< Hash buckets
+	uint32_t n_buckets;			///< Number of buckets, always a power of 2
+	uint32_t n_entries;			///< Number of cached patterns
+	cache_entry_t *newest;			///< Head of the LRU list
+	cache_entry_t *oldest;			///< Tail of the LRU list
+	size_t bytes;				///< Bytes currently charged against the budget
+	size_t budget;				///< Maximum number of bytes to keep cached
+	unsigned long hits;			///< Lookups satisfied from the cache
+	unsigned long misses;			///< Lookups which had to compile
+	unsigned long evictions;		///< Entries dropped to stay within the budget
+} pattern_cache_t;
+
+static pattern_cache_t pattern_cache = { NULL, 0, 0, NULL, NULL, 0, MPCRE2_CACHE_DEFAULT_BUDGET, 0, 0, 0 };	///< The compiled pattern cache
+
+/**
+ * @brief Hash a cache key
  *
+ * This is a 32 bit FNV-1a hash over the pattern bytes, with the options
+ * and compile context pointer folded in.
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for a pcre2 *match_data pointer
+ * @param pattern Pattern bytes
+ * @param len Length of the pattern
+ * @param options Parsed compile options
+ * @param ccontext Compile context, or NULL
  *
- * @return The number of pairs in the output vector for this match
+ * @return The hash value
  */
- gtm_long_t mpcre2_get_ovector_count(int count, gtm_char_t *match_data_str) {
+static uint32_t cache_hash(const char *pattern, size_t len, uint32_t options, pcre2_compile_context *ccontext) {
 
- 	pcre2_match_data *match_data;
+	uint32_t h = 2166136261u;
+	unsigned long long cc = (unsigned long long) ccontext;
+	size_t i;
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
+	for (i = 0; i < len; i++) {
+		h = (h ^ (unsigned char) pattern[i]) * 16777619u;
+	}
+	h = (h ^ options) * 16777619u;
+	h = (h ^ (uint32_t) cc) * 16777619u;
+	h = (h ^ (uint32_t) (cc >> 32)) * 16777619u;
 
-	return pcre2_get_ovector_count(match_data);
- }
+	return h;
+}
 
 /**
- * @brief wrap the pcre2_get_ovector_pointer() function
+ * @brief Work out how many bytes a compiled pattern costs the cache
  *
- * This function is provided, but does not have much direct utility in M, as there
- * is no native way to *use* the returned handle.  Instead, the
- * result must be used with the utility function mpcre2_get_ov_pair()
- * (pcre2getovpair in M)
+ * This counts the compiled pattern, any JIT code attached to it, and the
+ * entry itself.
  *
- * @param count The parameter count from the M API
- * @param match_data_str String handle for a match data pointer
+ * @param entry The cache entry
  *
- * @return A string handle for the output vector pointer
+ * @return Size in bytes
  */
- gtm_char_t *mpcre2_get_ovector_pointer(int count, gtm_char_t *match_data_str) {
+static size_t cache_entry_size(cache_entry_t *entry) {
 
- 	pcre2_match_data *match_data;
-	PCRE2_SIZE *p;
-	static char buf[80];
+	size_t code_size = 0;
+	size_t jit_size = 0;
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
-
-	p = pcre2_get_ovector_pointer(match_data);
-
-	pointer_encode(p, buf, sizeof(buf));
-
-	return buf;
- }
+	pcre2_pattern_info(entry->code, PCRE2_INFO_SIZE, &code_size);
+	pcre2_pattern_info(entry->code, PCRE2_INFO_JITSIZE, &jit_size);
 
+	return sizeof(cache_entry_t) + entry->pattern_len + code_size + jit_size;
+}
 
 /**
- * @brief wrap pcre2_get_startchar()
+ * @brief Unlink an entry from the LRU list
  *
- * @param count Parameter count from M API
- * @param match_data_str Match data handle
+ * @param entry The entry to unlink
  *
- * @return Code unit offset of successful match
+ * @return None
  */
-gtm_long_t mpcre2_get_startchar(int count, char *match_data_str) {
+static void cache_lru_unlink(cache_entry_t *entry) {
 
-	pcre2_match_data *match_data;
+	if (entry->newer) {
+		entry->newer->older = entry->older;
+	} else {
+		pattern_cache.newest = entry->older;
+	}
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
+	if (entry->older) {
+		entry->older->newer = entry->newer;
+	} else {
+		pattern_cache.oldest = entry->newer;
+	}
 
-	return pcre2_get_startchar(match_data);
+	entry->newer = entry->older = NULL;
 }
 
 /**
- * @brief Wrap the pcre2_general_context_create() function
- *
- * In general M code should never need to call this function, as m_pcre2
- * creates a hidden general context when needed.  Also, there is no way
- * from M to specify custom C level arguments (unless the M runtime has another
- * plugin which returns appropriate handles).
- *
- * However, if "0" is passed for all three parameters, NULL will be used, and 
- * a general context using the system (not M) memory functions will be returned.
- *
- * @param count Count of parameters provided by the M API
- * @param malloc_ptr_str String handle for a pointer to a pcre2 malloc() compatible function
- * @param free_ptr_str String handle for a pointer to a pcre2 free() compatible function
- * @param data_ptr_str String handle for a pointer to a data item to be used for marking memory
+ * @brief Put an entry at the most recently used end of the LRU list
  *
- * @return A string handle to the created pcre2_general_context (or "0" on failure)
+ * @param entry The entry
  *
+ * @return None
  */
-gtm_char_t *mpcre2_general_context_create(int count, gtm_char_t *malloc_ptr_str, gtm_char_t *free_ptr_str, gtm_char_t *data_ptr_str) {
-	
-	pcre2_general_context *gc;
-	static char buf[80];
+static void cache_lru_push(cache_entry_t *entry) {
 
-	gc = pcre2_general_context_create(pointer_decode(malloc_ptr_str), pointer_decode(free_ptr_str), pointer_decode(data_ptr_str));
+	entry->newer = NULL;
+	entry->older = pattern_cache.newest;
 
-	pointer_encode(gc, buf, sizeof(buf));
+	if (pattern_cache.newest) {
+		pattern_cache.newest->newer = entry;
+	}
+	pattern_cache.newest = entry;
 
-	return buf;
+	if (!pattern_cache.oldest) {
+		pattern_cache.oldest = entry;
+	}
 }
 
 /**
- * @brief Wrap the pcre2_general_context_copy() function
+ * @brief Remove an entry from the cache and free it along with its compiled pattern
  *
- * @param count Parameter count provided by the M API
- * @param general_context_str String handle to a pcre2 general context
+ * Freeing the compiled pattern also releases any JIT code attached to it.
  *
- * @return A string handle to a copy of the provided general context or "0"
+ * @param entry The entry to remove
  *
- */ 
- gtm_char_t *mpcre2_general_context_copy(int count, gtm_char_t *general_context_str) {
- 	
-	pcre2_general_context *gc;
-	pcre2_general_context *gc2;
-	static char buf[80];
+ * @return None
+ */
+static void cache_remove(cache_entry_t *entry) {
 
-	gc = (pcre2_general_context *) pointer_decode(general_context_str);
+	cache_entry_t **pp;
 
-	gc2 = pcre2_general_context_copy(gc);
+	pp = &pattern_cache.buckets[entry->hash & (pattern_cache.n_buckets - 1)];
+	while (*pp != entry) {
+		pp = &(*pp)->hnext;
+	}
+	*pp = entry->hnext;
 
-	pointer_encode(gc2, buf, sizeof(buf));
+	cache_lru_unlink(entry);
 
-	return buf;
- }
+	pattern_cache.bytes -= entry->size;
+	pattern_cache.n_entries--;
+
+	handle_release(entry->handle, HANDLE_CODE);
+	pcre2_code_free(entry->code);
+	m_pcre2_free(entry, NULL);
+}
 
 /**
- * @brief Wrap pcre2_general_context_free()
+ * @brief Evict least recently used entries until the cache is within budget
  *
- * @param count Parameter count from the M API
- * @param gc_str String handle to a pcre2 general context
+ * @param keep An entry which must not be evicted (the one we are about to return), or NULL
  *
  * @return None
  */
-void mpcre2_general_context_free(int count, gtm_char_t *gc_str) {
-	
-	pcre2_general_context *gc;
+static void cache_trim(cache_entry_t *keep) {
 
-	gc = (pcre2_general_context *) pointer_decode(gc_str);
+	cache_entry_t *victim;
+	cache_entry_t *next;
 
-	pcre2_general_context_free(gc);
+	victim = pattern_cache.oldest;
+	while (victim && pattern_cache.bytes > pattern_cache.budget) {
+		next = victim->newer;
+		if (victim != keep) {
+			cache_remove(victim);
+			pattern_cache.evictions++;
+		}
+		victim = next;
+	}
 }
 
 /**
- * @brief Wrap the pcre2_compile_context_create() function
+ * @brief Double the number of hash buckets
  *
- * @param count Parameter count provided by the M API
- * @param gc_str String handle to a pcre2 general context
+ * If we can't get the memory, we just carry on with longer chains.
  *
- * @return String handle to a pcre2 compile context
+ * @return None
  */
-gtm_char_t *mpcre2_compile_context_create(int count, gtm_char_t *gc_str) {
+static void cache_grow(void) {
 
-	pcre2_general_context *gc;
-	pcre2_compile_context *cc;
-	static char buf[80];
+	cache_entry_t **nb;
+	cache_entry_t *entry;
+	cache_entry_t *next;
+	uint32_t n;
+	uint32_t i;
 
-	gc = (pcre2_general_context *) pointer_decode(gc_str);
+	n = pattern_cache.n_buckets ? pattern_cache.n_buckets * 2 : MPCRE2_CACHE_INITIAL_BUCKETS;
 
-	cc = pcre2_compile_context_create(gc);
+	nb = m_pcre2_malloc(n * sizeof(cache_entry_t *), NULL);
+	if (!nb) {
+		return;
+	}
+	memset(nb, 0, n * sizeof(cache_entry_t *));
 
-	pointer_encode(cc, buf, sizeof(buf));
+	for (i = 0; i < pattern_cache.n_buckets; i++) {
+		for (entry = pattern_cache.buckets[i]; entry; entry = next) {
+			next = entry->hnext;
+			entry->hnext = nb[entry->hash & (n - 1)];
+			nb[entry->hash & (n - 1)] = entry;
+		}
+	}
 
-	return buf;
+	if (pattern_cache.buckets) {
+		m_pcre2_free(pattern_cache.buckets, NULL);
+	}
+	pattern_cache.buckets = nb;
+	pattern_cache.n_buckets = n;
 }
 
 /**
- * @brief Wrap the pcre2_compile_context_copy() function
+ * @brief Look up a compiled pattern in the cache
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
+ * On a hit the entry is moved to the most recently used end of the LRU list.
  *
- * @return String handle for a copy of the given context
+ * @param pattern Pattern bytes
+ * @param len Length of the pattern
+ * @param options Parsed compile options
+ * @param ccontext Compile context, or NULL for the default
  *
+ * @return The cache entry, or NULL if there is none
  */
-gtm_char_t *mpcre2_compile_context_copy(int count, gtm_char_t *ccontext_str) {
+static cache_entry_t *cache_lookup(const char *pattern, size_t len, uint32_t options, pcre2_compile_context *ccontext) {
 
-	pcre2_compile_context *cc;
-	pcre2_compile_context *cc2;
-	static char buf[80];
+	cache_entry_t *entry;
+	uint32_t h;
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	if (!pattern_cache.n_buckets) {
+		return NULL;
+	}
 
-	cc2 = pcre2_compile_context_copy(cc);
+	h = cache_hash(pattern, len, options, ccontext);
+
+	for (entry = pattern_cache.buckets[h & (pattern_cache.n_buckets - 1)]; entry; entry = entry->hnext) {
+		if (entry->hash == h && entry->options == options && entry->ccontext == ccontext &&
+			entry->pattern_len == len && memcmp(entry->pattern, pattern, len) == 0) {
+			break;
+		}
+	}
 
-	pointer_encode(cc2, buf, sizeof(buf));
+	if (entry && entry != pattern_cache.newest) {
+		cache_lru_unlink(entry);
+		cache_lru_push(entry);
+	}
 
-	return buf;
+	return entry;
 }
 
 /**
- * @brief Wrap the pcre2_compile_context_free() function
+ * @brief Add a freshly compiled pattern to the cache
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
+ * The cache takes ownership of the compiled pattern.  If we can't allocate an
+ * entry or a handle for it, NULL is returned and the caller still owns the code.
  *
- * @return None
+ * @param pattern Pattern bytes
+ * @param len Length of the pattern
+ * @param options Parsed compile options
+ * @param ccontext Compile context, or NULL for the default
+ * @param code The compiled pattern
+ *
+ * @return The new cache entry or NULL
  */
- void mpcre2_compile_context_free(int count, gtm_char_t *ccontext_str) {
-	pcre2_compile_context *cc;
+static cache_entry_t *cache_insert(const char *pattern, size_t len, uint32_t options,
+	pcre2_compile_context *ccontext, pcre2_code *code) {
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	cache_entry_t *entry;
+	uint32_t slot;
 
-	pcre2_compile_context_free(cc);
- }
+	if (pattern_cache.n_entries >= pattern_cache.n_buckets) {
+		cache_grow();
+		if (!pattern_cache.n_buckets) {
+			return NULL;
+		}
+	}
+
+	entry = m_pcre2_malloc(sizeof(cache_entry_t) + len, NULL);
+	if (!entry) {
+		return NULL;
+	}
+
+	entry->hash = cache_hash(pattern, len, options, ccontext);
+	entry->options = options;
+	entry->ccontext = ccontext;
+	entry->code = code;
+	entry->pattern_len = len;
+	memcpy(entry->pattern, pattern, len);
+	if (handle_encode(code, HANDLE_CODE, entry->handle, sizeof(entry->handle)) < 0) {
+		m_pcre2_free(entry, NULL);
+		return NULL;
+	}
+	entry->size = cache_entry_size(entry);
+
+	slot = entry->hash & (pattern_cache.n_buckets - 1);
+	entry->hnext = pattern_cache.buckets[slot];
+	pattern_cache.buckets[slot] = entry;
+	cache_lru_push(entry);
+
+	pattern_cache.n_entries++;
+	pattern_cache.bytes += entry->size;
+
+	return entry;
+}
 
 /**
- * @brief Wrap the pcre2_set_bsr() function
+ * @brief Take a compiled pattern back out of the cache if it is cached
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
- * @param value_str String form of pcre2 code for handling \\R mapping
+ * This is used when M frees a handle it got from the cache, so that the
+ * cache does not hang on to a freed pattern.  Freeing is rare, so a walk
+ * of the LRU list is fine.
  *
- * @return 0 on success, non zero on failure
+ * @param code The compiled pattern
+ *
+ * @return 1 if the pattern was cached (and is now freed), 0 otherwise
  */
-gtm_long_t mpcre2_set_bsr(int count, gtm_char_t *ccontext_str, gtm_char_t *value_str) {
-
-	uint32_t value;
-	pcre2_compile_context *cc;
+static int cache_forget(pcre2_code *code) {
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	cache_entry_t *entry;
 
-	/*
-	 * Parse the bsr option string
-	 */
-	if (parse_pcre2_options(bsr_opts, n_bsr_opts, "bsr", value_str, &value) < 0) {
-		return PCRE2_ERROR_BADDATA;
+	for (entry = pattern_cache.newest; entry; entry = entry->older) {
+		if (entry->code == code) {
+			cache_remove(entry);
+			return 1;
+		}
 	}
 
-	return pcre2_set_bsr(cc, value);
+	return 0;
 }
 
 /**
- * @brief Wrap the  pcre2_set_character_tables() function
+ * @brief Drop every cached pattern which was compiled with a compile context
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
- * @param tables_str String handle for a result from pcre2_maketables, or "NULL"
+ * Cache entries are keyed on the context itself rather than on its settings,
+ * which can't be read back, so they are dropped whenever the context is changed
+ * or freed.  This also keeps a new context which happens to get the address of
+ * a freed one from finding patterns compiled with the old one.
  *
- * @return Always returns 0
+ * @param ccontext The compile context
+ *
+ * @return None
  */
-gtm_long_t mpcre2_set_character_tables(int count, gtm_char_t *ccontext_str, gtm_char_t *tables_str) {
-
-	pcre2_compile_context *cc;
-	const unsigned char *tables;
+static void cache_forget_context(pcre2_compile_context *ccontext) {
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	cache_entry_t *entry;
+	cache_entry_t *next;
 
-	tables = (const unsigned char*) pointer_decode(tables_str);
-
-	return pcre2_set_character_tables(cc, tables);
+	for (entry = pattern_cache.newest; entry; entry = next) {
+		next = entry->older;
+		if (entry->ccontext == ccontext) {
+			cache_remove(entry);
+		}
+	}
 }
 
+/*
+ * This section contains exported helper functions which do not directly map to
+ * the PCRE2 API, but paper over the differences between M & C
+ */
+
 /**
- * @brief Wrap the pcre2_set_compile_extra_options() function
+ * @brief Get the default MPCRE2 general context
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
- * @param extra_options_str String with pcre2 "extra" compile options
+ * MPCRE2 creates a default general context which is used behind the scenes.
+ * This general context uses M memory allocation and dallocation.  If this is
+ * needed on the M side we use this function to access it.
+ *
+ * @param count The parameter count from the M API
+ *
+ * @return A string handle for the GC
  *
- * @return 0 in all cases
  */
-gtm_long_t mpcre2_set_compile_extra_options(int count, gtm_char_t *ccontext_str, gtm_char_t *extra_options_str) {
-
-	pcre2_compile_context *cc;
-	uint32_t extra_options;
-
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+gtm_char_t *mpcre2_get_general_context(int count) {
+	
+	pcre2_general_context *gc;
+	static char buf[80] = "0";
 
-	/* not really much point error checking this */
-	if (parse_pcre2_options(extra_compile_opts, n_extra_compile_opts, "extra compile", extra_options_str, &extra_options) < 0) {
-		return 0;
+	/*
+	 * The default GC lives for the life of the process, so it only needs one handle
+	 */
+	if (strcmp(buf, "0") == 0) {
+		gc = get_general_context("NULL");
+		handle_encode(gc, HANDLE_GENERAL_CONTEXT, buf, sizeof(buf));
 	}
 
-	return pcre2_set_compile_extra_options(cc, extra_options);
+	return buf;
 }
 
 /**
- * @brief Wrap the pcre2_set_max_pattern_length() function
+ * @brief Return an output vector pair
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
- * @param value The maximum number of code units allowed in a pcre2 pattern
+ * Since M cannot directly manipulate output vector pointers, this access function
+ * is needed to take the handle and an index and return the queried output
+ * vector pair
  *
- * @return 0 in all cases
+ * @param count Parameter count provided by the M API
+ * @param ovector_str A string handle for a pointer to the output vector pairs
+ * @param index Which pair to return
+ * @param p0 Pointer to the first element of the pair to return
+ * @param p1 Pointer to the second element of the pair to return
+ *
+ * @return None
  */
-gtm_long_t mpcre2_set_max_pattern_length(int count, gtm_char_t *ccontext_str, gtm_long_t value) {
-	pcre2_compile_context *cc;
+void mpcre2_get_ov_pair(int count, gtm_char_t *ovector_str, gtm_long_t index, gtm_long_t *p0, gtm_long_t *p1) {
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	PCRE2_SIZE *ov;
 
-	return pcre2_set_max_pattern_length(cc, value);
+	ov = (PCRE2_SIZE *) pointer_decode(ovector_str);
+
+	*p0 = ov[index*2];
+	*p1 = ov[(index*2)+1];
 }
 
 /**
- * @brief Wrap pcre2_set_newline() function
+ * @brief Return the whole output vector of a match data block in one M string
  *
- * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
- * @param value_str String representing the pcre2 newline convention to set
+ * This saves a call to pcre2getovectorpointer and one call to pcre2getovpair per
+ * group.  Pairs are written as "start,end", separated by ";", with "-" for a group
+ * which is unset, so $PIECE(result,";",n+1) is group n.  Offsets are zero based
+ * byte offsets, as with pcre2getovpair.  Every pair in the match data is written,
+ * so check the match return code first.
  *
- * @return 0 on success, nonzero on error
+ * @param count Parameter count provided by the M API
+ * @param match_data_str Handle for the match data
+ * @param result Where to put the output vector
+ *
+ * @return The number of pairs, or < 0 on error
  */
-gtm_long_t mpcre2_set_newline(int count,gtm_char_t *ccontext_str, gtm_char_t *value_str) {
+gtm_long_t mpcre2_get_ovector(int count, gtm_char_t *match_data_str, gtm_string_t *result) {
 
-	pcre2_compile_context *cc;
-	uint32_t value;
+	pcre2_match_data *md;
+	uint32_t pairs;
+	size_t len;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		result->length = 0;
+		return PCRE2_ERROR_NULL;
+	}
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	pairs = pcre2_get_ovector_count(md);
 
-	if(parse_pcre2_options(newline_opts, n_newline_opts, "newline opts", value_str, &value) < 0) {
-		return PCRE2_ERROR_BADDATA;
+	len = ovector_format(pcre2_get_ovector_pointer(md), pairs, (int) pairs, result->address,
+		result->length);
+	result->length = len;
+
+	if (len == 0) {
+		return PCRE2_ERROR_NOMEMORY;
 	}
 
-	return pcre2_set_newline(cc, value);
+	return pairs;
 }
 
 /**
- * @brief Wrap the pcre2_set_parens_nest_limit() function
- *
+ * @brief Copy a buffer allocated in C to an M string
+ * 
  * @param count Parameter count from the M API
- * @param ccontext_str String handle to a pcre2 compile context
- * @param value The maximum allowed nesting depth for parens
+ * @param buffer_ptr_str String handle for the buffer pointer
+ * @param len Length of the buffer
  *
- * @return 0 in all cases
+ * @return a gtm_string_t with the buffer address and length
  */
-gtm_long_t mpcre2_set_parens_nest_limit(int count, gtm_char_t *ccontext_str, gtm_long_t value) {
+gtm_string_t *mpcre2_get_mstring_from_buf(int count, gtm_char_t *buffer_ptr_str, gtm_long_t len) {
 
-	pcre2_compile_context *cc;
+	static gtm_string_t ret;
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	ret.address = pointer_decode(buffer_ptr_str);
+	ret.length = len;
 
-	return pcre2_set_parens_nest_limit(cc, value);
+	return &ret;
 }
 
 /**
- * @brief Wrap the pcre2_set_compile_recursion_guard() function
+ * @brief Return the number of captured substrings from a substring list
  *
- * This function is unlikely to be useful in the context of libm_pcre2, as
- * it sets up a callback for use during expression compilation of parenthesized
- * patterns, and libm_pcre2 does not provide any way to create such a function
+ * This is a helper function for pcre2_substring_list_get() and requires
+ * that function to be called first to establish the two pointers used here.
+ *
+ * @param count Parameter count from the M API
+ * @param listptr_str String handle for the substring list
+ *
+ * @return The number of substrings in the list
+ */
+gtm_long_t mpcre2_get_substring_list_count(int count, gtm_char_t *listptr_str) {
+
+	PCRE2_UCHAR **listptr;
+	PCRE2_UCHAR *cpt;
+	int i;
+
+	listptr = (PCRE2_UCHAR **) pointer_decode(listptr_str);
+
+	/*
+	 * The end of the list is signaled by a NULL pointer.  Obviously we
+	 * are hosed if it is not there.
+	 */
+	if (!listptr[0])
+		return 0;
+
+	for(i = 1;; ++i) {
+		cpt = listptr[i];
+		if (!cpt)
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * @brief Return an M string from a pcre2 substring list
+ *
+ * This is a utility function to support pcre2_substring_list_get()
+ *
+ * @param count Parameter count from the M API
+ * @param listptr_str String handle for a pcre2 substring list
+ * @param lenptr_str String handle for a pcre2 length list
+ * @param index Index in the list of the string to return
+ *
+ * @return The given string value as an M string
+ */
+gtm_string_t *mpcre2_get_mstring_from_substring_list(int count, gtm_char_t *listptr_str, gtm_char_t *lenptr_str, gtm_long_t index) {
+
+	PCRE2_UCHAR **listptr;
+	PCRE2_SIZE *lenptr;
+	static gtm_string_t ret;
+
+	listptr = (PCRE2_UCHAR **) pointer_decode(listptr_str);
+	lenptr = (PCRE2_SIZE *) pointer_decode(lenptr_str);
+
+	ret.address = (char *) listptr[index];
+	ret.length = lenptr[index];
+
+	return &ret;
+}
+
+/**
+ * @brief Compile a regular expression through the compiled pattern cache
+ *
+ * This takes the same arguments as mpcre2_compile() (pcre2compile in M), but
+ * first looks for an identical pattern, compiled with the same options and
+ * compile context, in a process-wide cache.  On a hit the existing handle is
+ * returned and pcre2_compile() is not called at all.
+ *
+ * The returned handle belongs to the cache.  It stays valid until it is evicted
+ * to keep the cache within its memory budget (see mpcre2_cache_config()), or
+ * until its compile context is changed by one of the pcre2set* calls or freed,
+ * so the intended use is to call this each time the pattern is needed rather than
+ * to hold on to the handle.  Passing it to pcre2codefree removes it from the cache.
+ *
+ * @param count M API supplied count of arguments to this function
+ * @param pattern The regular expression we are compiling
+ * @param options Compile options
+ * @param errorcode Output parameter to return an error if compile fails
+ * @param erroroffset Output parameter indicating the byte offset of a compile failure
+ * @param ccontext_str Compile context for compile, "0" for defaults
+ *
+ * @return A handle for this compiled pattern or a "0" string on failure
+ */
+gtm_char_t *mpcre2_cached_compile(int count, gtm_string_t *pattern, gtm_char_t *options,
+	gtm_long_t *errorcode, gtm_ulong_t *erroroffset, gtm_char_t *ccontext_str) {
+
+	int ecode;
+	PCRE2_SIZE eoffset;
+	uint32_t compile_options;
+	pcre2_compile_context *ccontext;
+	pcre2_compile_context *key_context;
+	pcre2_code *code;
+	cache_entry_t *entry;
+	size_t old_size;
+	static char result[80];
+
+	if (parse_pcre2_options(compile_opts, n_compile_opts, "compile",
+		options, &compile_options) < 0) {
+		return "0";
+	}
+
+	/*
+	 * The default context is keyed as NULL, so that all default compiles
+	 * share entries without creating a context just to look them up.
+	 */
+	if ( (strcmp(ccontext_str, "0") == 0) || (strcmp(ccontext_str, "NULL") == 0) ) {
+		key_context = NULL;
+	} else {
+		key_context = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+		if (!key_context) {
+			*errorcode = PCRE2_ERROR_NULL;
+			*erroroffset = 0;
+			return "0";
+		}
+	}
+
+	entry = cache_lookup(pattern->address, pattern->length, compile_options, key_context);
+	if (entry) {
+		/*
+		 * The pattern may have been JIT compiled since it was cached
+		 */
+		old_size = entry->size;
+		entry->size = cache_entry_size(entry);
+		pattern_cache.bytes += entry->size - old_size;
+		cache_trim(entry);
+
+		pattern_cache.hits++;
+		*errorcode = 100;	/* what pcre2_compile() leaves on success */
+		*erroroffset = 0;
+		return entry->handle;
+	}
+
+	pattern_cache.misses++;
+
+	ccontext = get_compile_context(ccontext_str);
+
+	code = pcre2_compile( (PCRE2_SPTR) (pattern->address), (PCRE2_SIZE) (pattern->length),
+		compile_options & ~MPCRE2_AUTO_JIT, &ecode, &eoffset, ccontext);
+
+	if (code && (compile_options & MPCRE2_AUTO_JIT)) {
+		pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+	}
+
+	*erroroffset = eoffset;
+	*errorcode = ecode;
+
+	if (!code) {
+		return "0";
+	}
+
+	entry = cache_insert(pattern->address, pattern->length, compile_options, key_context, code);
+	if (!entry) {
+		/*
+		 * Couldn't cache it, so behave just like pcre2compile, except that a
+		 * pattern we can't hand out a handle for is freed rather than leaked.
+		 */
+		if (handle_encode(code, HANDLE_CODE, result, sizeof(result)) < 0) {
+			pcre2_code_free(code);
+			*errorcode = PCRE2_ERROR_NOMEMORY;
+		}
+		return result;
+	}
+
+	cache_trim(entry);
+
+	return entry->handle;
+}
+
+/**
+ * @brief Set the memory budget of the compiled pattern cache
+ *
+ * If the new budget is smaller than what is currently cached, least recently used
+ * patterns are evicted (and freed, along with any JIT code) right away.  Passing a
+ * negative value leaves the budget alone, which is a way to query it.
+ *
+ * @param count Parameter count from the M API
+ * @param budget The maximum number of bytes to keep in the cache
+ *
+ * @return The previous budget
+ */
+gtm_long_t mpcre2_cache_config(int count, gtm_long_t budget) {
+
+	gtm_long_t old_budget;
+
+	old_budget = (gtm_long_t) pattern_cache.budget;
+
+	if (budget >= 0) {
+		pattern_cache.budget = (size_t) budget;
+		cache_trim(NULL);
+	}
+
+	return old_budget;
+}
+
+/**
+ * @brief Return compiled pattern cache statistics
+ *
+ * These are intended for sizing the cache with pcre2cacheconfig.
+ *
+ * @param count Parameter count from the M API
+ * @param hits Where to store the number of lookups satisfied from the cache
+ * @param misses Where to store the number of lookups which had to compile
+ * @param evictions Where to store the number of patterns evicted to stay within budget
+ * @param entries Where to store the number of patterns currently cached
+ * @param bytes Where to store the number of bytes currently cached
+ *
+ * @return None
+ */
+void mpcre2_cache_stats(int count, gtm_ulong_t *hits, gtm_ulong_t *misses, gtm_ulong_t *evictions,
+	gtm_ulong_t *entries, gtm_ulong_t *bytes) {
+
+	*hits = pattern_cache.hits;
+	*misses = pattern_cache.misses;
+	*evictions = pattern_cache.evictions;
+	*entries = pattern_cache.n_entries;
+	*bytes = pattern_cache.bytes;
+}
+
+/**
+ * @brief Translate an option string into the bitmask it stands for
+ *
+ * Every function which takes options as a string also accepts the bitmask
+ * as a string of decimal digits, which is used as is.  M code on a hot path
+ * can translate its options once with this function and pass the number
+ * from then on.
+ *
+ * The table is one of "compile", "extra compile", "match", "jit", "bsr",
+ * "newline" or "info", matching the option names accepted by the functions
+ * which use them.  "match" covers the substitute options as well.
+ *
+ * @param count Parameter count from the M API
+ * @param table_str Name of the option table
+ * @param options_str Options such as "PCRE2_NOTBOL|PCRE2_NOTEOL"
+ *
+ * @return The bitmask, or -1 on error
+ */
+gtm_long_t mpcre2_option_mask(int count, gtm_char_t *table_str, gtm_char_t *options_str) {
+
+	uint32_t mask;
+	int i;
+
+	for (i = 0; i < n_opt_tables; i++) {
+		if (strcmp(table_str, opt_tables[i].name) == 0) {
+			break;
+		}
+	}
+
+	if (i == n_opt_tables) {
+		fprintf(stderr, "Unknown option table %s\n", table_str);
+		return -1;
+	}
+
+	if (parse_pcre2_options(opt_tables[i].table, *opt_tables[i].count, opt_tables[i].name, options_str, &mask) < 0) {
+		return -1;
+	}
+
+	return (gtm_long_t) mask;
+}
+
+/*
+ * This section contains functions which are exported and are 1 for 1 wrappings
+ * of PCRE2 functions.  They are listed in the order given in the PCRE2
+ * https://www.pcre.org/current/doc/html/pcre2api.html document. (As of a
+ * certain point in time..)
+ */
+
+/**
+ * @brief Wrapper for M calls to pcre2_compile
+ *
+ * This function serves as a wrapper so M can call pcre2_compile().
+ * The parameters are similar to the C call, but since we use an M string,
+ * for the pattern, we know the length, and don't have to pass that as a
+ * separate parameter. 
+ * 
+ * In general, refer to the PCRE2 documentation for a fuller description
+ * of these parameters.  The handle returned on success is a registry handle.
+ *
+ * Besides the PCRE2 compile options, the pseudo-option MPCRE2_AUTO_JIT may be
+ * given, in which case the pattern is JIT compiled (PCRE2_JIT_COMPLETE) right
+ * away and pcre2match will use the JIT code whenever it can.
+ *
+ * @param count M API supplied count of arguments to this function
+ * @param pattern The regular expression we are compiling
+ * @param options Compile options
+ * @param errorcode Output parameter to return an error if compile fails
+ * @param erroroffset Output parameter indicating the byte offset of a compile failure
+ * @param ccontext_str Compile context for compile, "0" for defaults
+ *
+ * @return A handle for this compiled pattern or a "0" string on failure
+ */
+gtm_char_t *mpcre2_compile(int count, gtm_string_t *pattern, gtm_char_t *options,
+	gtm_long_t *errorcode, gtm_ulong_t *erroroffset, gtm_char_t *ccontext_str) {
+
+	int ecode;
+	PCRE2_SIZE eoffset;
+	uint32_t compile_options;
+	pcre2_compile_context *ccontext;
+	pcre2_code *code;		/* our compiled pattern */
+	static char result[80];
+
+	/*
+	 * If custom compile option strings are passed in, we must
+	 * map them from string format to internal format
+	 */
+	if (parse_pcre2_options(compile_opts, n_compile_opts, "compile",
+		options, &compile_options) < 0) {
+		return "0";
+	}
+
+
+	ccontext = get_compile_context(ccontext_str);
+	if (!ccontext && !handle_is_null(ccontext_str)) {
+		*errorcode = PCRE2_ERROR_NULL;
+		*erroroffset = 0;
+		return "0";
+	}
+
+	/*
+	 * Now actually compile the pattern
+	 */
+	code = pcre2_compile( (PCRE2_SPTR) (pattern->address), (PCRE2_SIZE) (pattern->length),
+		compile_options & ~MPCRE2_AUTO_JIT, &ecode, &eoffset, ccontext);
+
+	/*
+	 * If JIT compiling fails (say JIT is not available) the pattern is still
+	 * perfectly usable by the interpreter, so that is not an error.
+	 */
+	if (code && (compile_options & MPCRE2_AUTO_JIT)) {
+		pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+	}
+
+	*erroroffset = eoffset;
+	*errorcode = ecode;
+
+	if (!code) {
+		return "0";
+	}
+
+	handle_encode(code, HANDLE_CODE, result, sizeof(result));
+	return result;
+}
+
+
+/**
+ * @brief Wrap pcre2_code_free()
+ *
+ * We pass pcre2 code pointers back and forth to M as text.
+ * We need to re-create the code pointer and free it.
+ *
+ * @param count Count of parameters from M API
+ * @param code String value of a code pointer from M
+ *
+ * @return None
+ */
+void mpcre2_code_free(int count, gtm_char_t *code) {
+
+	pcre2_code *ptr;
+
+	ptr = (pcre2_code *) handle_decode(code, HANDLE_CODE);
+	if (!ptr) {
+		return;
+	}
+
+	/*
+	 * A pattern from pcre2cachedcompile is freed as it leaves the cache
+	 */
+	if (cache_forget(ptr)) {
+		return;
+	}
+
+	handle_release(code, HANDLE_CODE);
+	pcre2_code_free(ptr);
+}
+
+/**
+ * @brief Wrap the pcre2_match_data_create() function
+ *
+ * If we are called with a non "0" general context, use it.
+ * Otherwise we use our internal general context.
+ *
+ * @param count Count of parameters from the M API
+ * @param ovecsize The size of the output vector to create
+ * @param gcontext_str A custom general context or "0" in string format
+ *
+ * @return A stringified match data handle
+ */
+gtm_char_t *mpcre2_match_data_create(int count, gtm_long_t ovecsize, gtm_char_t *gcontext_str) {
+
+	pcre2_general_context *gc;
+	pcre2_match_data *md;
+	static char buf[80];
+
+	gc = get_general_context(gcontext_str);
+
+	md = pcre2_match_data_create(ovecsize, gc);
+	match_data_reset(md);
+
+	handle_encode(md, HANDLE_MATCH_DATA, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Wrap pcre2_match_data_create_from_pattern()
+ *
+ * If we are called with a non "0" general context, use it.
+ * Otherwise we use our internal general context.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A compiled pcre2 regular expression pointer in string format
+ * @param gcontext_str A custom general context or "0" in string format
+ *
+ * @return A stringified match data pointer
+ */
+gtm_char_t *mpcre2_match_data_create_from_pattern(int count, gtm_char_t *code_str,
+	gtm_char_t *gcontext_str) {
+
+	pcre2_code *code;
+	pcre2_general_context *gc;
+	pcre2_match_data *md;
+	static char buf[80];
+
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
+	if (!code) {
+		return "0";
+	}
+
+	gc = get_general_context(gcontext_str);
+
+	md = pcre2_match_data_create_from_pattern(code, gc);
+	match_data_reset(md);
+
+	handle_encode(md, HANDLE_MATCH_DATA, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Get the handle of the match data a compiled pattern uses for "AUTO"
+ *
+ * Passing "AUTO" as the match data to pcre2match, pcre2jitmatch, pcre2dfamatch or
+ * pcre2substitute uses match data which is kept with the pattern, so there is
+ * no need to create and free match data around each match.  This returns its
+ * handle, so that the output vector, mark and so on of the last such match can be
+ * looked at.  The match data is freed along with the pattern, and must not be
+ * passed to pcre2matchdatafree.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A compiled pcre2 regular expression handle
+ *
+ * @return The match data handle, or "0" on error
+ */
+gtm_char_t *mpcre2_get_match_data(int count, gtm_char_t *code_str) {
+
+	pcre2_code *code;
+	code_state_t *state;
+
+	code = code_decode(code_str, &state);
+	if (!code || !code_match_data(code, state)) {
+		return "0";
+	}
+
+	return state->md_handle;
+}
+
+/**
+ * @brief wrap pcre2_match() for M
+ *
+ * We bring in "subject" as an M string, so we can have embedded zero bytes.  This gives
+ * us a length, so we don't have a separate parameter for that.
+ *
+ * If the pattern has been JIT compiled (with pcre2jitcompile or MPCRE2_AUTO_JIT)
+ * the JIT code is called directly where the options allow, with the interpreter
+ * as the fallback, so there is no need to choose pcre2jitmatch at the call site.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression pointer in string format
+ * @param subject The string to search for matches
+ * @param startoffset The byte offset at which to start the match search
+ * @param options_str Pcre2 match options in string form
+ * @param match_data_str A Pcre2 match data pointer in string format, or "AUTO" for the pattern's own match data
+ * @param mcontext_str A Pcre2 match context pointer in string format, "0", or a profile name
+ *
+ * @return < 0 on error or no match, 0 vector offests too small, else one more than the highest numbered capturing pair that has been set
+ */
+gtm_long_t mpcre2_match(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
+	gtm_char_t *mcontext_str) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	uint32_t options;
+	gtm_long_t res;
+
+	code = code_decode(code_str, &state);
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	match_data = match_data_decode(match_data_str, code, state);
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = code_match(code, state, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+		(PCRE2_SIZE) startoffset, options, match_data, mc);
+
+	return res;
+
+}
+
+/**
+ * @brief Find every match of a pattern in a subject in one call
+ *
+ * This runs the whole global match loop in C, handling empty matches the way
+ * pcre2test's /g does, so M does not need to loop around pcre2match.
+ *
+ * Matches are separated by a space.  Each match is its output vector, with pairs
+ * for the whole match and every capture group written as "start,end" and separated
+ * by ";".  Unset groups are written as "-".  Offsets are zero based byte offsets,
+ * the same as pcre2getovpair.  For example "(a)|(b)" against "ab" gives
+ * "0,1;0,1;- 1,2;-;1,2".
+ *
+ * If the result does not fit, the matches which do fit are returned along with
+ * PCRE2_ERROR_NOMEMORY; the end of the last of them is where to carry on from.
+ * Any other error from the match also ends the loop, and is returned with the
+ * matches found before it.
+ *
+ * The pattern's own match data (as for "AUTO") is used, so the last match can
+ * still be looked at with pcre2getmatchdata.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param subject The string to search for matches
+ * @param startoffset The byte offset at which to start the search
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ * @param maxmatches Stop after this many matches, 0 for no limit
+ * @param result Where to put the matches
+ *
+ * @return The number of matches, or < 0 on error
+ */
+gtm_long_t mpcre2_match_all(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *mcontext_str,
+	gtm_long_t maxmatches, gtm_string_t *result) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	global_match_t gm;
+	uint32_t options;
+	uint32_t pairs;
+	size_t size = result->length;
+	size_t used = 0;
+	size_t len;
+	gtm_long_t matches = 0;
+	int res;
+
+	result->length = 0;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (startoffset < 0 || (PCRE2_SIZE) startoffset > (PCRE2_SIZE) subject->length) {
+		return PCRE2_ERROR_BADOFFSET;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	match_data = code_match_data(code, state);
+	if (!match_data) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	pairs = pcre2_get_ovector_count(match_data);
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	global_match_init(&gm, code, state, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+		(PCRE2_SIZE) startoffset, options, match_data, mc);
+
+	while (maxmatches <= 0 || matches < maxmatches) {
+		res = global_match_next(&gm);
+		if (res == PCRE2_ERROR_NOMATCH) {
+			break;
+		} else if (res < 0) {
+			matches = res;
+			break;
+		}
+
+		if (matches > 0) {
+			if (used >= size) {
+				matches = PCRE2_ERROR_NOMEMORY;
+				break;
+			}
+			result->address[used++] = ' ';
+		}
+
+		len = ovector_format(pcre2_get_ovector_pointer(match_data), pairs, res,
+			result->address + used, size - used);
+		if (len == 0) {
+			/*
+			 * Drop the separator so the result ends with the last whole match
+			 */
+			if (matches > 0) {
+				used--;
+			}
+			matches = PCRE2_ERROR_NOMEMORY;
+			break;
+		}
+		used += len;
+		matches++;
+	}
+
+	result->length = used;
+
+	return matches;
+}
+
+/**
+ * @brief Take the next subject from a packed list of subjects
+ *
+ * Each subject is its length in bytes, a colon, then the subject itself, so
+ * "3:abc0:2:xy" is the three subjects "abc", "" and "xy".
+ *
+ * @param cpt Where the next subject starts, moved past it
+ * @param end The end of the list
+ * @param subject Set to the subject
+ * @param len Set to the length of the subject
+ *
+ * @return 1 if a subject was found, 0 at the end of the list, -1 if the list is not valid
+ */
+static int batch_subject_next(const char **cpt, const char *end, const char **subject, size_t *len) {
+
+	const char *p = *cpt;
+	size_t n = 0;
+
+	if (p >= end) {
+		return 0;
+	}
+
+	if (*p < '0' || *p > '9') {
+		return -1;
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		n = n * 10 + (*p++ - '0');
+		if (n > (size_t) (end - *cpt)) {
+			return -1;
+		}
+	}
+	if (p >= end || *p != ':' || n > (size_t) (end - p - 1)) {
+		return -1;
+	}
+
+	*subject = p + 1;
+	*len = n;
+	*cpt = p + 1 + n;
+
+	return 1;
+}
+
+/**
+ * @brief Add the result for one subject to a batch result
+ *
+ * @param buf The result buffer
+ * @param used Bytes of buf in use, updated
+ * @param size Size of buf
+ * @param first Non-zero for the first subject, which has no separator before it
+ * @param rc Return from the match
+ * @param start Start of the match, used if rc >= 0
+ *
+ * @return 0 on success, PCRE2_ERROR_NOMEMORY if it does not fit
+ */
+static int batch_result_append(char *buf, size_t *used, size_t size, int first, int rc, PCRE2_SIZE start) {
+
+	int n;
+
+	if (rc >= 0) {
+		n = snprintf(buf + *used, size - *used, "%s%d,%lu", first ? "" : ";", rc, (unsigned long) start);
+	} else {
+		n = snprintf(buf + *used, size - *used, "%s%d", first ? "" : ";", rc);
+	}
+	if (n < 0 || (size_t) n >= size - *used) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	*used += n;
+
+	return 0;
+}
+/**
+ * @brief Subjects each worker thread claims from a parallel batch at a time
+ */
+#define MPCRE2_BATCH_BLOCK 64
+
+/**
+ * This type holds the settings for splitting batches across threads
+ */
+typedef struct batch_config {
+	long threads;			///< Most threads for one batch, 1 to match every batch in the calling thread
+	long min_subjects;		///< Fewest subjects worth giving a thread of its own
+} batch_config_t;
+
+static batch_config_t batch_config = { 1, 1000 };
+
+/**
+ * This type is one subject in a parallel batch, with its result
+ */
+typedef struct batch_item {
+	const char *subject;		///< The subject
+	size_t len;			///< Length of the subject
+	int rc;				///< Return from pcre2_match()
+	PCRE2_SIZE start;		///< Start of the match, if there was one
+} batch_item_t;
+
+/**
+ * This type is a parallel batch, shared by its worker threads
+ */
+typedef struct batch_job {
+	pcre2_code *code;		///< The compiled pattern, which the workers only read
+	uint32_t options;		///< Match options
+	batch_item_t *items;		///< The subjects
+	size_t n_items;			///< Number of subjects
+	size_t next;			///< First subject no worker has claimed yet
+} batch_job_t;
+
+/**
+ * This type is one worker thread of a parallel batch
+ *
+ * Everything here comes from the system allocator rather than GT.M's, which is
+ * not thread safe, and nothing a worker does calls back into GT.M.
+ */
+typedef struct batch_worker {
+	void *job;			///< The batch_job_t or scan_job_t being worked on
+	pcre2_match_data *match_data;	///< The worker's own match data
+	pcre2_match_context *mc;	///< The worker's own match context
+	pcre2_jit_stack *jit_stack;	///< The worker's own JIT stack, or NULL
+	pthread_t thread;		///< The thread
+	int started;			///< Non-zero if the thread was started
+} batch_worker_t;
+
+/**
+ * @brief Get a general context which uses the system allocator
+ *
+ * This is for memory used by worker threads.
+ *
+ * @return The context, or NULL if it could not be created
+ */
+static pcre2_general_context *get_system_general_context(void) {
+
+	static pcre2_general_context *system_gc = NULL;
+
+	if (!system_gc) {
+		system_gc = pcre2_general_context_create(NULL, NULL, NULL);
+	}
+
+	return system_gc;
+}
+
+/**
+ * @brief Match subjects from a parallel batch until there are none left
+ *
+ * Subjects are claimed a block at a time, so a worker which gets short subjects
+ * does more of them.  Each result goes in the subject's own item, so the results
+ * come out in input order whichever worker matched them.
+ *
+ * @param arg The batch_worker_t
+ *
+ * @return NULL
+ */
+static void *batch_worker_run(void *arg) {
+
+	batch_worker_t *w = arg;
+	batch_job_t *job = w->job;
+	batch_item_t *item;
+	PCRE2_SIZE *ov = pcre2_get_ovector_pointer(w->match_data);
+	size_t first;
+	size_t last;
+	size_t i;
+
+	for (;;) {
+		first = __atomic_fetch_add(&job->next, MPCRE2_BATCH_BLOCK, __ATOMIC_RELAXED);
+		if (first >= job->n_items) {
+			break;
+		}
+		last = first + MPCRE2_BATCH_BLOCK < job->n_items ? first + MPCRE2_BATCH_BLOCK : job->n_items;
+
+		for (i = first; i < last; i++) {
+			item = &job->items[i];
+			item->rc = pcre2_match(job->code, (PCRE2_SPTR) item->subject, item->len, 0,
+				job->options, w->match_data, w->mc);
+			if (item->rc >= 0) {
+				item->start = ov[0];
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Free what a worker was given
+ *
+ * @param w The worker
+ *
+ * @return None
+ */
+static void batch_worker_free(batch_worker_t *w) {
+
+	if (w->match_data) {
+		pcre2_match_data_free(w->match_data);
+	}
+	if (w->mc) {
+		pcre2_match_context_free(w->mc);
+	}
+	if (w->jit_stack) {
+		pcre2_jit_stack_free(w->jit_stack);
+	}
+}
+
+/**
+ * @brief Give a worker its own match data, match context and JIT stack
+ *
+ * The match context gets the limits of the given profile, if any.  We can't do
+ * the same for a match context handle, since PCRE2 has no way to read its limits
+ * back, which is why batches given one are not split.
+ *
+ * @param w The worker, zeroed
+ * @param code The compiled pattern
+ * @param prof The match profile, or NULL for the defaults
+ *
+ * @return 0 on success, -1 if something could not be created
+ */
+static int batch_worker_init(batch_worker_t *w, pcre2_code *code, match_profile_t *prof) {
+
+	pcre2_general_context *gc;
+	size_t jit_size = 0;
+	size_t max;
+
+	gc = get_system_general_context();
+	if (!gc) {
+		return -1;
+	}
+
+	w->match_data = pcre2_match_data_create_from_pattern(code, gc);
+	w->mc = pcre2_match_context_create(gc);
+	if (!w->match_data || !w->mc) {
+		return -1;
+	}
+
+	if (prof) {
+		if (prof->match_limit >= 0) {
+			pcre2_set_match_limit(w->mc, (uint32_t) prof->match_limit);
+		}
+		if (prof->depth_limit >= 0) {
+			pcre2_set_depth_limit(w->mc, (uint32_t) prof->depth_limit);
+		}
+		if (prof->heap_limit >= 0) {
+			pcre2_set_heap_limit(w->mc, (uint32_t) prof->heap_limit);
+		}
+		if (prof->offset_limit >= 0) {
+			pcre2_set_offset_limit(w->mc, (PCRE2_SIZE) prof->offset_limit);
+		}
+	}
+
+	/*
+	 * A worker's JIT stack can't be grown and the match retried the way the
+	 * shared one is, so it is made able to grow to the ceiling from the start
+	 */
+	pcre2_pattern_info(code, PCRE2_INFO_JITSIZE, &jit_size);
+	if (jit_size > 0) {
+		max = prof && prof->jit_stack_size > 0 ? (size_t) prof->jit_stack_size : jit_stacks.ceiling;
+		w->jit_stack = pcre2_jit_stack_create(MPCRE2_JIT_STACK_MIN < max ? MPCRE2_JIT_STACK_MIN : max,
+			max, gc);
+		if (!w->jit_stack) {
+			return -1;
+		}
+		pcre2_jit_stack_assign(w->mc, NULL, w->jit_stack);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Run workers, one in the calling thread and the rest in threads of their own
+ *
+ * The calling thread does its share, so the work is still finished if a thread
+ * can't be started.  Signals are blocked in the new threads so that GT.M's
+ * handlers only ever run in the process's own thread.  This returns once every
+ * worker has finished.
+ *
+ * @param workers The workers, set up with batch_worker_init()
+ * @param n_workers Number of workers
+ * @param run What each worker runs, given its batch_worker_t
+ *
+ * @return None
+ */
+static void batch_workers_run(batch_worker_t *workers, long n_workers, void *(*run)(void *)) {
+
+	sigset_t all;
+	sigset_t old;
+	long i;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 1; i < n_workers; i++) {
+		workers[i].started = pthread_create(&workers[i].thread, NULL, run, &workers[i]) == 0;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	run(&workers[0]);
+
+	for (i = 1; i < n_workers; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+}
+
+/**
+ * @brief Match a batch of subjects across several threads
+ *
+ * The calling thread works through the batch alongside the others (see
+ * batch_workers_run()).
+ *
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern, or NULL
+ * @param subjects The packed subjects
+ * @param options Match options
+ * @param prof Match profile for the limits, or NULL
+ * @param result Where to put the result for each subject
+ * @param size Size of the result buffer
+ * @param done Set to non-zero if the batch was matched, or zero if it is too small to split
+ *
+ * @return As for mpcre2_match_batch()
+ */
+static gtm_long_t match_batch_parallel(pcre2_code *code, code_state_t *state, gtm_string_t *subjects,
+	uint32_t options, match_profile_t *prof, gtm_string_t *result, size_t size, int *done) {
+
+	batch_job_t job;
+	batch_worker_t *workers;
+	const char *cpt = subjects->address;
+	const char *end = subjects->address + subjects->length;
+	const char *subject;
+	size_t len;
+	size_t n = 0;
+	size_t used = 0;
+	size_t i;
+	long n_workers;
+	gtm_long_t matched = 0;
+	int res;
+
+	*done = 0;
+
+	while ((res = batch_subject_next(&cpt, end, &subject, &len)) > 0) {
+		n++;
+	}
+	if (res < 0 || (long) n < 2 * batch_config.min_subjects) {
+		return 0;
+	}
+
+	n_workers = (long) n / batch_config.min_subjects;
+	if (n_workers > batch_config.threads) {
+		n_workers = batch_config.threads;
+	}
+
+	job.items = m_pcre2_malloc(n * sizeof(batch_item_t), NULL);
+	workers = m_pcre2_malloc(n_workers * sizeof(batch_worker_t), NULL);
+	if (!job.items || !workers) {
+		if (job.items) {
+			m_pcre2_free(job.items, NULL);
+		}
+		if (workers) {
+			m_pcre2_free(workers, NULL);
+		}
+		return 0;
+	}
+	memset(workers, 0, n_workers * sizeof(batch_worker_t));
+
+	cpt = subjects->address;
+	for (i = 0; i < n; i++) {
+		batch_subject_next(&cpt, end, &job.items[i].subject, &job.items[i].len);
+	}
+	job.code = code;
+	job.options = options;
+	job.n_items = n;
+	job.next = 0;
+
+	/*
+	 * The whole batch counts towards the JIT threshold, and any JIT compile
+	 * has to happen before the workers start
+	 */
+	if (state && !state->jit_tried) {
+		state->matches += n - 1;
+	}
+	code_count_match(code, state);
+
+	for (i = 0; i < (size_t) n_workers; i++) {
+		workers[i].job = &job;
+		if (batch_worker_init(&workers[i], code, prof) < 0) {
+			break;
+		}
+	}
+
+	if (i == (size_t) n_workers) {
+		batch_workers_run(workers, n_workers, batch_worker_run);
+		*done = 1;
+	}
+
+	for (i = 0; i < (size_t) n_workers; i++) {
+		batch_worker_free(&workers[i]);
+	}
+	m_pcre2_free(workers, NULL);
+
+	if (!*done) {
+		m_pcre2_free(job.items, NULL);
+		return 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		res = batch_result_append(result->address, &used, size, i == 0, job.items[i].rc, job.items[i].start);
+		if (res < 0) {
+			matched = res;
+			break;
+		}
+		if (job.items[i].rc >= 0) {
+			matched++;
+		}
+	}
+	result->length = used;
+
+	m_pcre2_free(job.items, NULL);
+
+	return matched;
+}
+
+/**
+ * @brief Set how pcre2matchbatch splits batches across threads
+ *
+ * With more than one thread, a batch of at least twice min_subjects subjects is
+ * split across up to that many threads, each matching with its own match data,
+ * match context and JIT stack.  Batches given a match context handle rather than
+ * "0" or a profile name are always matched in the calling thread.  pcre2grepfiles
+ * shares its chunks of files out among the same number of threads.
+ *
+ * @param count Count of parameters from the M API
+ * @param threads Most threads for one batch, 1 for none, or < 1 to leave it as it is
+ * @param min_subjects Fewest subjects for each thread, or < 1 to leave it as it is
+ *
+ * @return The previous number of threads
+ */
+gtm_long_t mpcre2_batch_config(int count, gtm_long_t threads, gtm_long_t min_subjects) {
+
+	long old = batch_config.threads;
+
+	if (threads > 0) {
+		batch_config.threads = threads;
+	}
+	if (min_subjects > 0) {
+		batch_config.min_subjects = min_subjects;
+	}
+
+	return old;
+}
+
+/**
+ * @brief Size of each slot of the ring a gzip file is decompressed into
+ */
+#define MPCRE2_GZ_SLOT (256 * 1024)
+
+/**
+ * @brief Number of slots in the ring a gzip file is decompressed into
+ */
+#define MPCRE2_GZ_SLOTS 4
+
+/**
+ * @brief Most compressed input given to zlib at once, as its lengths are only unsigned ints
+ */
+#define MPCRE2_GZ_INPUT (1024 * 1024 * 1024)
+
+/**
+ * @brief Longest line searched in a gzip file, so that a file with no newlines can't fill memory
+ */
+#define MPCRE2_GZ_LINE_MAX (16 * 1024 * 1024)
+
+/**
+ * This type is a function called for each line of a decompressed file, returning < 0 to stop
+ */
+typedef int (*gz_line_fn_t)(void *arg, const char *line, size_t len, unsigned long number, size_t offset);
+
+/**
+ * This type is the ring of buffers a gzip file is decompressed into, shared by
+ * the thread decompressing it and the thread matching its lines
+ */
+typedef struct gz_ring {
+	z_stream zs;			///< The zlib stream
+	const unsigned char *in;	///< The compressed file
+	size_t in_size;			///< Size of the compressed file
+	size_t in_used;			///< Compressed bytes given to zlib so far
+	char *slots;			///< MPCRE2_GZ_SLOTS slots of MPCRE2_GZ_SLOT bytes
+	size_t lens[MPCRE2_GZ_SLOTS];	///< Bytes in each filled slot
+	int head;			///< Next slot to be matched
+	int filled;			///< Number of slots filled and not yet matched
+	int eof;			///< Set once the last slot is filled
+	int stop;			///< Set when the matching thread wants no more
+	int rc;				///< 0, or -1 if the file is not valid gzip data
+	pthread_mutex_t lock;		///< Guards head, filled, eof, stop and rc
+	pthread_cond_t cond;		///< Signalled whenever any of those change
+} gz_ring_t;
+
+/**
+ * @brief Check whether a file in memory is gzip compressed, by its magic number
+ *
+ * @param map The file
+ * @param size Size of the file
+ *
+ * @return Non-zero if it is
+ */
+static int gz_is_gzip(const char *map, size_t size) {
+
+	return size >= 2 && (unsigned char) map[0] == 0x1f && (unsigned char) map[1] == 0x8b;
+}
+
+/**
+ * @brief Decompress into the next free slot of a ring, waiting for one if it is full
+ *
+ * Files of several gzip members, as made by concatenating .gz files, decompress as
+ * one.  As with gunzip, anything after the last member which is not another member
+ * is ignored.
+ *
+ * @param ring The ring
+ *
+ * @return 0 if there is more to do, 1 once the ring has its last slot or has stopped
+ */
+static int gz_ring_fill(gz_ring_t *ring) {
+
+	z_stream *zs = &ring->zs;
+	size_t len;
+	int slot;
+	int done = 0;
+	int zr;
+
+	pthread_mutex_lock(&ring->lock);
+	while (ring->filled == MPCRE2_GZ_SLOTS && !ring->stop) {
+		pthread_cond_wait(&ring->cond, &ring->lock);
+	}
+	if (ring->stop) {
+		pthread_mutex_unlock(&ring->lock);
+		return 1;
+	}
+	slot = (ring->head + ring->filled) % MPCRE2_GZ_SLOTS;
+	pthread_mutex_unlock(&ring->lock);
+
+	zs->next_out = (unsigned char *) ring->slots + (size_t) slot * MPCRE2_GZ_SLOT;
+	zs->avail_out = MPCRE2_GZ_SLOT;
+	while (zs->avail_out > 0) {
+		if (zs->avail_in == 0 && ring->in_used < ring->in_size) {
+			len = ring->in_size - ring->in_used;
+			if (len > MPCRE2_GZ_INPUT) {
+				len = MPCRE2_GZ_INPUT;
+			}
+			zs->next_in = (unsigned char *) ring->in + ring->in_used;
+			zs->avail_in = len;
+			ring->in_used += len;
+		}
+
+		zr = inflate(zs, Z_NO_FLUSH);
+		if (zr == Z_STREAM_END) {
+			if (!gz_is_gzip((const char *) zs->next_in, ring->in_size - (zs->next_in - ring->in))) {
+				done = 1;
+				break;
+			}
+			inflateReset(zs);
+		} else if (zr != Z_OK) {
+			done = -1;
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&ring->lock);
+	ring->lens[slot] = MPCRE2_GZ_SLOT - zs->avail_out;
+	ring->filled++;
+	if (done) {
+		ring->eof = 1;
+		ring->rc = done < 0 ? -1 : 0;
+	}
+	pthread_cond_broadcast(&ring->cond);
+	pthread_mutex_unlock(&ring->lock);
+
+	return done != 0;
+}
+
+/**
+ * @brief Decompress a whole file into a ring, in a thread of its own
+ *
+ * @param arg The gz_ring_t
+ *
+ * @return NULL
+ */
+static void *gz_ring_run(void *arg) {
+
+	while (!gz_ring_fill(arg)) {
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Pass each line of a gzip file in memory to a function
+ *
+ * A thread of its own decompresses the file into a small ring of buffers while
+ * the calling thread matches the lines in them, so neither waits on the other
+ * for long and the file is never decompressed anywhere as a whole.  A line cut
+ * across the end of a buffer is carried over and joined up with its rest from
+ * the next one before it is passed on, so matching sees every line whole.  A
+ * line longer than MPCRE2_GZ_LINE_MAX ends the search with PCRE2_ERROR_NOMEMORY.
+ * Lines are numbered and their offsets given as in the decompressed text.
+ *
+ * If the decompressing thread can't be started, the calling thread fills the
+ * ring itself whenever it runs dry.
+ *
+ * @param path Name of the file, for messages
+ * @param map The file
+ * @param size Size of the file
+ * @param fn The function, called in the calling thread
+ * @param arg First argument for fn
+ *
+ * @return 0 on success, what fn returned if < 0, -1 if the file is not valid gzip data,
+ * or PCRE2_ERROR_NOMEMORY if a line is too long
+ */
+static int gz_scan(const char *path, const char *map, size_t size, gz_line_fn_t fn, void *arg) {
+
+	gz_ring_t ring;
+	pthread_t thread;
+	sigset_t all;
+	sigset_t old;
+	char *carry = NULL;
+	char *ncarry;
+	const char *slot;
+	const char *cpt;
+	const char *end;
+	const char *eol;
+	size_t carry_len = 0;
+	size_t carry_cap = 0;
+	size_t carry_offset = 0;
+	size_t offset = 0;
+	unsigned long line = 0;
+	int started;
+	int res = 0;
+
+	memset(&ring, 0, sizeof(ring));
+	ring.in = (const unsigned char *) map;
+	ring.in_size = size;
+	if (inflateInit2(&ring.zs, 15 + 16) != Z_OK) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	ring.slots = malloc((size_t) MPCRE2_GZ_SLOTS * MPCRE2_GZ_SLOT);
+	if (!ring.slots) {
+		inflateEnd(&ring.zs);
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.cond, NULL);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	started = pthread_create(&thread, NULL, gz_ring_run, &ring) == 0;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	for (;;) {
+		if (!started) {
+			pthread_mutex_lock(&ring.lock);
+			if (ring.filled == 0 && !ring.eof) {
+				pthread_mutex_unlock(&ring.lock);
+				gz_ring_fill(&ring);
+			} else {
+				pthread_mutex_unlock(&ring.lock);
+			}
+		}
+
+		pthread_mutex_lock(&ring.lock);
+		while (ring.filled == 0 && !ring.eof) {
+			pthread_cond_wait(&ring.cond, &ring.lock);
+		}
+		if (ring.filled == 0) {
+			pthread_mutex_unlock(&ring.lock);
+			break;
+		}
+		slot = ring.slots + (size_t) ring.head * MPCRE2_GZ_SLOT;
+		end = slot + ring.lens[ring.head];
+		pthread_mutex_unlock(&ring.lock);
+
+		for (cpt = slot; cpt < end && res >= 0; cpt = eol + 1) {
+			eol = memchr(cpt, '\n', end - cpt);
+			if (carry_len > 0 || !eol) {
+				/*
+				 * Part of a line, to be kept until the rest of it turns up
+				 */
+				if (carry_len == 0) {
+					carry_offset = offset + (cpt - slot);
+				}
+				if (carry_len + ((eol ? eol : end) - cpt) > MPCRE2_GZ_LINE_MAX) {
+					fprintf(stderr, "Line %lu of %s is too long\n", line + 1, path);
+					res = PCRE2_ERROR_NOMEMORY;
+					break;
+				}
+				if (carry_len + ((eol ? eol : end) - cpt) > carry_cap) {
+					carry_cap = carry_len + ((eol ? eol : end) - cpt) + MPCRE2_GZ_SLOT;
+					ncarry = realloc(carry, carry_cap);
+					if (!ncarry) {
+						res = PCRE2_ERROR_NOMEMORY;
+						break;
+					}
+					carry = ncarry;
+				}
+				memcpy(carry + carry_len, cpt, (eol ? eol : end) - cpt);
+				carry_len += (eol ? eol : end) - cpt;
+				if (!eol) {
+					break;
+				}
+				res = fn(arg, carry, carry_len, ++line, carry_offset);
+				carry_len = 0;
+			} else {
+				res = fn(arg, cpt, eol - cpt, ++line, offset + (cpt - slot));
+			}
+		}
+		offset += end - slot;
+
+		pthread_mutex_lock(&ring.lock);
+		ring.head = (ring.head + 1) % MPCRE2_GZ_SLOTS;
+		ring.filled--;
+		if (res < 0) {
+			ring.stop = 1;
+		}
+		pthread_cond_broadcast(&ring.cond);
+		pthread_mutex_unlock(&ring.lock);
+
+		if (res < 0) {
+			break;
+		}
+	}
+
+	if (started) {
+		pthread_join(thread, NULL);
+	}
+
+	if (res >= 0 && ring.rc < 0) {
+		fprintf(stderr, "Unable to decompress %s\n", path);
+		res = ring.rc;
+	}
+	if (res >= 0 && carry_len > 0) {
+		res = fn(arg, carry, carry_len, ++line, carry_offset);
+	}
+
+	free(carry);
+	free(ring.slots);
+	inflateEnd(&ring.zs);
+	pthread_mutex_destroy(&ring.lock);
+	pthread_cond_destroy(&ring.cond);
+
+	return res < 0 ? res : 0;
+}
+
+/**
+ * This type is a search of one file by pcre2grepfile
+ */
+typedef struct grep_file {
+	pcre2_code *code;		///< The compiled pattern
+	code_state_t *state;		///< The mpcre2 state for the pattern
+	uint32_t options;		///< Match options
+	pcre2_match_data *match_data;	///< Match data to match with
+	pcre2_match_context *mc;	///< Match context to match with
+	FILE *out;			///< File to write the matching lines to, or NULL
+	gtm_string_t *result;		///< Where to put the matching lines if out is NULL
+	size_t size;			///< Size of the result buffer
+	size_t used;			///< Bytes of it used so far
+	gtm_long_t matched;		///< Number of matching lines so far
+} grep_file_t;
+
+/**
+ * @brief Match one line of a file for pcre2grepfile, and give it if it matches
+ *
+ * @param arg The grep_file_t
+ * @param line The line, without its newline
+ * @param len Length of the line
+ * @param number Line number, counting from 1
+ * @param offset Offset in the file where the line starts
+ *
+ * @return 0, or < 0 to stop the search
+ */
+static int grep_file_line(void *arg, const char *line, size_t len, unsigned long number, size_t offset) {
+
+	grep_file_t *g = arg;
+	int n;
+	int res;
+
+	res = code_match(g->code, g->state, (PCRE2_SPTR) line, len, 0, g->options, g->match_data, g->mc);
+	if (res == PCRE2_ERROR_NOMATCH) {
+		return 0;
+	}
+	if (res < 0) {
+		return res;
+	}
+
+	g->matched++;
+	if (g->out) {
+		fprintf(g->out, "%lu,%lu\n", number, (unsigned long) offset);
+	} else {
+		n = snprintf(g->result->address + g->used, g->size - g->used, "%s%lu,%lu", g->used ? ";" : "",
+			number, (unsigned long) offset);
+		if (n < 0 || (size_t) n >= g->size - g->used) {
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		g->used += n;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Search the lines of a file for a pattern
+ *
+ * The file is mapped into memory and each line is matched where it lies, so
+ * nothing is copied and M never sees the text.  Lines end at "\n", which is not
+ * part of the line; a last line without one still counts.  Matching goes through
+ * the JIT fast path when the pattern has JIT code (see mpcre2_jit_compile() and
+ * mpcre2_set_jit_threshold()).
+ *
+ * Each matching line is given as "line,offset", its line number counting from 1
+ * and the byte offset in the file where it starts.  These are separated by ";" in
+ * result, or written one to a line to outpath when that is given, for searches
+ * which may find more than fits in an M string.  If result fills up, the lines
+ * which fit are returned along with PCRE2_ERROR_NOMEMORY.
+ *
+ * A gzip compressed file, known by its magic number rather than its name, is
+ * searched as it is decompressed (see gz_scan()), with line numbers and offsets
+ * in the decompressed text.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param path The file to search
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ * @param outpath File to write the matching lines to, or "" to return them in result
+ * @param result Where to put the matching lines
+ *
+ * @return The number of matching lines, or < 0 on error
+ */
+gtm_long_t mpcre2_grep_file(int count, gtm_char_t *code_str, gtm_char_t *path, gtm_char_t *options_str,
+	gtm_char_t *mcontext_str, gtm_char_t *outpath, gtm_string_t *result) {
+
+	grep_file_t g;
+	struct stat st;
+	const char *map = NULL;
+	const char *cpt;
+	const char *end;
+	const char *eol;
+	unsigned long line = 0;
+	int fd;
+	int res = 0;
+
+	memset(&g, 0, sizeof(g));
+	g.result = result;
+	g.size = result->length;
+	result->length = 0;
+
+	g.code = code_decode(code_str, &g.state);
+	if (!g.code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &g.options) < 0) {
+		return -1;
+	}
+
+	g.match_data = code_match_data(g.code, g.state);
+	if (!g.match_data) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	g.mc = get_match_context(mcontext_str);
+	if (!g.mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s\n", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Unable to read %s\n", path);
+		close(fd);
+		return -1;
+	}
+	if (st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "Unable to map %s\n", path);
+			close(fd);
+			return -1;
+		}
+		madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	if (outpath[0] != '\0') {
+		g.out = fopen(outpath, "w");
+		if (!g.out) {
+			fprintf(stderr, "Unable to create %s\n", outpath);
+			if (map) {
+				munmap((void *) map, st.st_size);
+			}
+			return -1;
+		}
+	}
+
+	if (gz_is_gzip(map, st.st_size)) {
+		res = gz_scan(path, map, st.st_size, grep_file_line, &g);
+	} else {
+		cpt = map;
+		end = map + st.st_size;
+		while (cpt < end && res == 0) {
+			eol = memchr(cpt, '\n', end - cpt);
+			if (!eol) {
+				eol = end;
+			}
+			res = grep_file_line(&g, cpt, eol - cpt, ++line, cpt - map);
+			cpt = eol + 1;
+		}
+	}
+	if (res < 0) {
+		g.matched = res;
+	}
+
+	if (g.out && fclose(g.out) != 0) {
+		fprintf(stderr, "Unable to write %s\n", outpath);
+		g.matched = -1;
+	}
+	if (map) {
+		munmap((void *) map, st.st_size);
+	}
+
+	result->length = g.used;
+
+	return g.matched;
+}
+
+/**
+ * @brief Size of the pieces pcre2grepfiles splits files into, before moving each end to a line end
+ */
+#define MPCRE2_SCAN_CHUNK (4 * 1024 * 1024)
+
+/**
+ * This type is one file being searched by pcre2grepfiles
+ */
+typedef struct scan_file {
+	char *path;			///< Path of the file
+	const char *map;		///< The file mapped into memory, or NULL if it is empty
+	size_t size;			///< Size of the file
+	int gz;				///< Non-zero if the file is gzip compressed
+} scan_file_t;
+
+/**
+ * This type is one matching line found by pcre2grepfiles
+ */
+typedef struct scan_hit {
+	unsigned long line;		///< Line number, counting from 1 at the start of the chunk
+	size_t offset;			///< Offset in the file where the line starts
+} scan_hit_t;
+
+/**
+ * This type is a piece of a file, which starts and ends at the start of a line
+ */
+typedef struct scan_chunk {
+	size_t file;			///< Index of the file
+	size_t start;			///< Offset of the chunk in the file
+	size_t end;			///< Offset of the end of the chunk
+	unsigned long lines;		///< Number of lines in the chunk
+	scan_hit_t *hits;		///< Matching lines, from the system allocator
+	size_t n_hits;			///< Number of matching lines
+	size_t cap;			///< Number of hits there is room for
+	int rc;				///< 0, or the match error which ended the chunk
+} scan_chunk_t;
+
+/**
+ * This type is a parallel search of files, shared by its worker threads
+ */
+typedef struct scan_job {
+	pcre2_code *code;		///< The compiled pattern, which the workers only read
+	uint32_t options;		///< Match options
+	scan_file_t *files;		///< The files
+	size_t n_files;			///< Number of files
+	scan_chunk_t *chunks;		///< The chunks, in file and offset order
+	size_t n_chunks;		///< Number of chunks
+	size_t next;			///< First chunk no worker has claimed yet
+} scan_job_t;
+
+/**
+ * This type is a worker searching one chunk
+ */
+typedef struct scan_pass {
+	scan_job_t *job;		///< The search
+	batch_worker_t *w;		///< The worker
+	scan_chunk_t *chunk;		///< The chunk
+} scan_pass_t;
+
+/**
+ * @brief Match one line of a chunk, and keep it with the chunk if it matches
+ *
+ * @param arg The scan_pass_t
+ * @param line The line, without its newline
+ * @param len Length of the line
+ * @param number Line number, counting from 1 at the start of the chunk
+ * @param offset Offset in the file where the line starts
+ *
+ * @return 0, or < 0 to stop searching the chunk
+ */
+static int scan_chunk_line(void *arg, const char *line, size_t len, unsigned long number, size_t offset) {
+
+	scan_pass_t *pass = arg;
+	scan_chunk_t *chunk = pass->chunk;
+	scan_hit_t *nhits;
+	int res;
+
+	chunk->lines = number;
+
+	res = pcre2_match(pass->job->code, (PCRE2_SPTR) line, len, 0, pass->job->options,
+		pass->w->match_data, pass->w->mc);
+	if (res == PCRE2_ERROR_NOMATCH) {
+		return 0;
+	}
+	if (res < 0) {
+		return res;
+	}
+
+	if (chunk->n_hits == chunk->cap) {
+		nhits = realloc(chunk->hits, (chunk->cap ? chunk->cap * 2 : 64) * sizeof(scan_hit_t));
+		if (!nhits) {
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		chunk->hits = nhits;
+		chunk->cap = chunk->cap ? chunk->cap * 2 : 64;
+	}
+	chunk->hits[chunk->n_hits].line = number;
+	chunk->hits[chunk->n_hits].offset = offset;
+	chunk->n_hits++;
+
+	return 0;
+}
+
+/**
+ * @brief Search chunks of files until there are none left
+ *
+ * Each idle worker takes the next chunk, so one which gets an easy chunk simply
+ * goes on to another.  Hits are kept with their chunk, with line numbers counted
+ * from the start of the chunk, and put together once every chunk is done.  A
+ * gzip compressed file is searched by its worker as it is decompressed, in a
+ * thread of its own (see gz_scan()).
+ *
+ * @param arg The batch_worker_t
+ *
+ * @return NULL
+ */
+static void *scan_worker_run(void *arg) {
+
+	scan_pass_t pass;
+	scan_file_t *file;
+	const char *cpt;
+	const char *end;
+	const char *eol;
+	unsigned long line;
+	size_t i;
+
+	pass.w = arg;
+	pass.job = pass.w->job;
+
+	for (;;) {
+		i = __atomic_fetch_add(&pass.job->next, 1, __ATOMIC_RELAXED);
+		if (i >= pass.job->n_chunks) {
+			break;
+		}
+		pass.chunk = &pass.job->chunks[i];
+		file = &pass.job->files[pass.chunk->file];
+
+		if (file->gz) {
+			pass.chunk->rc = gz_scan(file->path, file->map, file->size, scan_chunk_line, &pass);
+			continue;
+		}
+
+		cpt = file->map + pass.chunk->start;
+		end = file->map + pass.chunk->end;
+		for (line = 1; cpt < end && pass.chunk->rc == 0; line++) {
+			eol = memchr(cpt, '\n', end - cpt);
+			if (!eol) {
+				eol = end;
+			}
+			pass.chunk->rc = scan_chunk_line(&pass, cpt, eol - cpt, line, cpt - file->map);
+			cpt = eol + 1;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * This type is the list of files for pcre2grepfiles
+ */
+typedef struct scan_list {
+	scan_file_t *files;		///< The files
+	size_t n_files;			///< Number of files
+	size_t cap;			///< Number of files there is room for
+} scan_list_t;
+
+/**
+ * @brief Add a file, or every file under a directory, to a list of files to search
+ *
+ * Directories are read in name order, so the same tree always gives the same
+ * list.  Symbolic links found inside a directory are not followed, and anything
+ * which is not a regular file or a directory is left out.
+ *
+ * @param list The list
+ * @param path The file or directory
+ * @param top Non-zero if path was given by the caller, in which case a link is followed
+ *
+ * @return 0 on success, -1 on error
+ */
+static int scan_list_add(scan_list_t *list, const char *path, int top) {
+
+	struct stat st;
+	struct dirent **names;
+	scan_file_t *nfiles;
+	char *child;
+	size_t cap;
+	int n;
+	int i;
+	int res = 0;
+
+	if ((top ? stat(path, &st) : lstat(path, &st)) < 0) {
+		fprintf(stderr, "Unable to read %s\n", path);
+		return -1;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		n = scandir(path, &names, NULL, alphasort);
+		if (n < 0) {
+			fprintf(stderr, "Unable to read directory %s\n", path);
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			if (res == 0 && strcmp(names[i]->d_name, ".") != 0 && strcmp(names[i]->d_name, "..") != 0) {
+				child = m_pcre2_malloc(strlen(path) + strlen(names[i]->d_name) + 2, NULL);
+				if (!child) {
+					res = -1;
+				} else {
+					sprintf(child, "%s/%s", path, names[i]->d_name);
+					res = scan_list_add(list, child, 0);
+					m_pcre2_free(child, NULL);
+				}
+			}
+			free(names[i]);
+		}
+		free(names);
+		return res;
+	}
+
+	if (!S_ISREG(st.st_mode)) {
+		return 0;
+	}
+
+	if (list->n_files == list->cap) {
+		cap = list->cap ? list->cap * 2 : 16;
+		nfiles = m_pcre2_malloc(cap * sizeof(scan_file_t), NULL);
+		if (!nfiles) {
+			return -1;
+		}
+		if (list->files) {
+			memcpy(nfiles, list->files, list->n_files * sizeof(scan_file_t));
+			m_pcre2_free(list->files, NULL);
+		}
+		list->files = nfiles;
+		list->cap = cap;
+	}
+
+	list->files[list->n_files].path = m_pcre2_malloc(strlen(path) + 1, NULL);
+	if (!list->files[list->n_files].path) {
+		return -1;
+	}
+	strcpy(list->files[list->n_files].path, path);
+	list->files[list->n_files].map = NULL;
+	list->files[list->n_files].size = 0;
+	list->n_files++;
+
+	return 0;
+}
+
+/**
+ * @brief Map a file from a list into memory
+ *
+ * @param file The file
+ *
+ * @return 0 on success, -1 on error
+ */
+static int scan_file_map(scan_file_t *file) {
+
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(file->path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s\n", file->path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Unable to read %s\n", file->path);
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "Unable to map %s\n", file->path);
+			close(fd);
+			return -1;
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		file->map = map;
+		file->size = st.st_size;
+		file->gz = gz_is_gzip(map, st.st_size);
+	}
+	close(fd);
+
+	return 0;
+}
+
+/**
+ * @brief Split the files of a search into chunks
+ *
+ * Each chunk is about MPCRE2_SCAN_CHUNK bytes, ending just after a newline (or at
+ * the end of the file).  A gzip compressed file can only be decompressed from its
+ * start, so it is one chunk.  With chunks NULL this only counts them.
+ *
+ * @param files The files
+ * @param n_files Number of files
+ * @param chunks Where to put the chunks, or NULL
+ *
+ * @return The number of chunks
+ */
+static size_t scan_chunks_make(scan_file_t *files, size_t n_files, scan_chunk_t *chunks) {
+
+	const char *nl;
+	size_t n = 0;
+	size_t start;
+	size_t end;
+	size_t i;
+
+	for (i = 0; i < n_files; i++) {
+		for (start = 0; start < files[i].size; start = end) {
+			end = start + MPCRE2_SCAN_CHUNK;
+			if (end >= files[i].size || files[i].gz) {
+				end = files[i].size;
+			} else {
+				nl = memchr(files[i].map + end - 1, '\n', files[i].size - end + 1);
+				end = nl ? (size_t) (nl - files[i].map) + 1 : files[i].size;
+			}
+
+			if (chunks) {
+				memset(&chunks[n], 0, sizeof(scan_chunk_t));
+				chunks[n].file = i;
+				chunks[n].start = start;
+				chunks[n].end = end;
+			}
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * @brief Free a list of files to search, unmapping any which were mapped
+ *
+ * @param list The list
+ *
+ * @return None
+ */
+static void scan_list_free(scan_list_t *list) {
+
+	size_t i;
+
+	for (i = 0; i < list->n_files; i++) {
+		if (list->files[i].map) {
+			munmap((void *) list->files[i].map, list->files[i].size);
+		}
+		m_pcre2_free(list->files[i].path, NULL);
+	}
+	if (list->files) {
+		m_pcre2_free(list->files, NULL);
+	}
+}
+
+/**
+ * @brief Build and map the list of files for pcre2grepfiles
+ *
+ * @param list The list, empty
+ * @param paths Files and directories separated by newlines
+ *
+ * @return 0 on success, -1 on error
+ */
+static int scan_list_build(scan_list_t *list, gtm_string_t *paths) {
+
+	const char *cpt = paths->address;
+	const char *end = paths->address + paths->length;
+	const char *eol;
+	char *path;
+	size_t i;
+	int res;
+
+	while (cpt < end) {
+		eol = memchr(cpt, '\n', end - cpt);
+		if (!eol) {
+			eol = end;
+		}
+		if (eol > cpt) {
+			path = m_pcre2_malloc(eol - cpt + 1, NULL);
+			if (!path) {
+				return -1;
+			}
+			memcpy(path, cpt, eol - cpt);
+			path[eol - cpt] = '\0';
+			res = scan_list_add(list, path, 1);
+			m_pcre2_free(path, NULL);
+			if (res < 0) {
+				return -1;
+			}
+		}
+		cpt = eol + 1;
+	}
+
+	for (i = 0; i < list->n_files; i++) {
+		if (scan_file_map(&list->files[i]) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Search every chunk of a job, sharing them out among worker threads
+ *
+ * @param job The job, with its chunks made
+ * @param prof Match profile for the workers' limits, or NULL
+ * @param mc A match context to search with in the calling thread only, or NULL to use threads
+ *
+ * @return 0 on success, PCRE2_ERROR_NOMEMORY if the workers could not be set up
+ */
+static int scan_job_run(scan_job_t *job, match_profile_t *prof, pcre2_match_context *mc) {
+
+	batch_worker_t *workers;
+	long n_workers;
+	long i;
+	int res = 0;
+
+	n_workers = mc ? 1 : batch_config.threads;
+	if ((size_t) n_workers > job->n_chunks) {
+		n_workers = job->n_chunks ? (long) job->n_chunks : 1;
+	}
+
+	workers = m_pcre2_malloc(n_workers * sizeof(batch_worker_t), NULL);
+	if (!workers) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	memset(workers, 0, n_workers * sizeof(batch_worker_t));
+
+	for (i = 0; i < n_workers; i++) {
+		workers[i].job = job;
+		if (batch_worker_init(&workers[i], job->code, prof) < 0) {
+			res = PCRE2_ERROR_NOMEMORY;
+			break;
+		}
+	}
+
+	if (res == 0) {
+		if (mc) {
+			pcre2_match_context_free(workers[0].mc);
+			workers[0].mc = mc;
+		}
+		batch_workers_run(workers, n_workers, scan_worker_run);
+		if (mc) {
+			workers[0].mc = NULL;
+		}
+	}
+
+	for (i = 0; i < n_workers; i++) {
+		batch_worker_free(&workers[i]);
+	}
+	m_pcre2_free(workers, NULL);
+
+	return res;
+}
+
+/**
+ * @brief Put together the hits from a search, in file and offset order
+ *
+ * Line numbers within each chunk become line numbers within the file by adding
+ * the lines in the chunks of the file before it.
+ *
+ * @param job The job, searched
+ * @param out File to write the hits to, or NULL
+ * @param result Where to put the hits when out is NULL
+ * @param size Size of the result buffer
+ *
+ * @return The number of matching lines, or < 0 on error
+ */
+static gtm_long_t scan_job_report(scan_job_t *job, FILE *out, gtm_string_t *result, size_t size) {
+
+	scan_chunk_t *chunk;
+	const char *path;
+	size_t used = 0;
+	size_t i;
+	size_t j;
+	unsigned long base = 0;
+	gtm_long_t matched = 0;
+	int n;
+
+	for (i = 0; i < job->n_chunks; i++) {
+		chunk = &job->chunks[i];
+		path = job->files[chunk->file].path;
+		if (i == 0 || chunk->file != job->chunks[i - 1].file) {
+			base = 0;
+		}
+
+		for (j = 0; j < chunk->n_hits; j++) {
+			if (out) {
+				fprintf(out, "%s:%lu:%lu\n", path, base + chunk->hits[j].line,
+					(unsigned long) chunk->hits[j].offset);
+			} else {
+				n = snprintf(result->address + used, size - used, "%s%s:%lu:%lu", used ? "\n" : "",
+					path, base + chunk->hits[j].line, (unsigned long) chunk->hits[j].offset);
+				if (n < 0 || (size_t) n >= size - used) {
+					result->length = used;
+					return PCRE2_ERROR_NOMEMORY;
+				}
+				used += n;
+			}
+			matched++;
+		}
+
+		if (chunk->rc < 0) {
+			matched = chunk->rc;
+			break;
+		}
+		base += chunk->lines;
+	}
+
+	result->length = used;
+
+	return matched;
+}
+
+/**
+ * @brief Search the lines of many files, or of directory trees, across several threads
+ *
+ * This is pcre2grepfile for many files at once.  Each path may be a file, or a
+ * directory, all of whose files are searched.  Every file is mapped into memory and
+ * cut into chunks of a few megabytes at line ends, and the chunks are shared out
+ * among as many threads as pcre2batchconfig allows, each with its own match data,
+ * match context and JIT stack.  So a single large file is spread across the
+ * threads as well as a tree of many files.  A gzip compressed file is searched as
+ * it is decompressed, as by pcre2grepfile, by one thread alongside the others.
+ *
+ * Each matching line is given as "path:line:offset", with its line number counting
+ * from 1 and the byte offset in the file where it starts, as grep -n -b would show
+ * it.  They are sorted by file, in the order the paths were given and then in name
+ * order within a directory, and then by offset.  They are separated by newlines in
+ * result, or written one to a line to outpath when that is given.  If result fills
+ * up, the lines which fit are returned along with PCRE2_ERROR_NOMEMORY.
+ *
+ * As for pcre2matchbatch, a match context handle can't be shared out among threads,
+ * so with one the search runs in the calling thread only.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param paths The files and directories to search, separated by newlines
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ * @param outpath File to write the matching lines to, or "" to return them in result
+ * @param result Where to put the matching lines
+ *
+ * @return The number of matching lines, or < 0 on error
+ */
+gtm_long_t mpcre2_grep_files(int count, gtm_char_t *code_str, gtm_string_t *paths, gtm_char_t *options_str,
+	gtm_char_t *mcontext_str, gtm_char_t *outpath, gtm_string_t *result) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_context *mc = NULL;
+	match_profile_t *prof = NULL;
+	scan_list_t list = { NULL, 0, 0 };
+	scan_job_t job;
+	FILE *out = NULL;
+	size_t size = result->length;
+	size_t i;
+	uint32_t options;
+	gtm_long_t matched;
+
+	result->length = 0;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	if (strcmp(mcontext_str, "0") != 0 && strcmp(mcontext_str, "NULL") != 0 &&
+		(handle_lookup(mcontext_str, HANDLE_MATCH_CONTEXT) || !(prof = match_profile_find(mcontext_str)))) {
+		mc = get_match_context(mcontext_str);
+		if (!mc) {
+			return PCRE2_ERROR_NULL;
+		}
+	}
+
+	if (scan_list_build(&list, paths) < 0) {
+		scan_list_free(&list);
+		return -1;
+	}
+
+	memset(&job, 0, sizeof(job));
+	job.code = code;
+	job.options = options;
+	job.files = list.files;
+	job.n_files = list.n_files;
+	job.n_chunks = scan_chunks_make(list.files, list.n_files, NULL);
+	if (job.n_chunks > 0) {
+		job.chunks = m_pcre2_malloc(job.n_chunks * sizeof(scan_chunk_t), NULL);
+		if (!job.chunks) {
+			scan_list_free(&list);
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		scan_chunks_make(list.files, list.n_files, job.chunks);
+	}
+
+	/*
+	 * Any JIT compile has to happen before the workers start
+	 */
+	code_count_match(code, state);
+
+	matched = scan_job_run(&job, prof, mc);
+
+	if (matched == 0 && outpath[0] != '\0') {
+		out = fopen(outpath, "w");
+		if (!out) {
+			fprintf(stderr, "Unable to create %s\n", outpath);
+			matched = -1;
+		}
+	}
+
+	if (matched == 0) {
+		matched = scan_job_report(&job, out, result, size);
+	}
+
+	if (out && fclose(out) != 0 && matched >= 0) {
+		fprintf(stderr, "Unable to write %s\n", outpath);
+		matched = -1;
+	}
+
+	if (job.chunks) {
+		for (i = 0; i < job.n_chunks; i++) {
+			free(job.chunks[i].hits);
+		}
+		m_pcre2_free(job.chunks, NULL);
+	}
+	scan_list_free(&list);
+
+	return matched;
+}
+/**
+ * @brief Size of the output buffer for pcre2substitutefile
+ */
+#define MPCRE2_SUBST_FILE_BUFFER (1024 * 1024)
+
+/**
+ * @brief Substitute in each line of a file in memory, writing the result
+ *
+ * Runs of lines with no match are written straight from the input, so only
+ * the lines which change are copied at all.
+ *
+ * @param code The compiled pattern
+ * @param state The mpcre2 state for the pattern
+ * @param options Match and substitute options
+ * @param match_data Match data to match with
+ * @param mc Match context to match with, or NULL
+ * @param replacement The replacement string
+ * @param map The input file
+ * @param size Size of the input file
+ * @param out Where to write the output
+ * @param linesptr Set to the number of lines changed
+ *
+ * @return The number of substitutions made, or < 0 on error
+ */
+static gtm_long_t substitute_file_lines(pcre2_code *code, code_state_t *state, uint32_t options,
+	pcre2_match_data *match_data, pcre2_match_context *mc, gtm_string_t *replacement,
+	const char *map, size_t size, FILE *out, gtm_long_t *linesptr) {
+
+	value_buffer_t vb = { NULL, 0 };
+	const char *pending = map;
+	const char *cpt = map;
+	const char *end = map + size;
+	const char *eol;
+	PCRE2_SIZE bufsize;
+	PCRE2_SIZE outputlength;
+	uint32_t match_options;
+	gtm_long_t subs = 0;
+	int res = 0;
+
+	match_options = options & ~(PCRE2_SUBSTITUTE_EXTENDED | PCRE2_SUBSTITUTE_GLOBAL |
+		PCRE2_SUBSTITUTE_OVERFLOW_LENGTH | PCRE2_SUBSTITUTE_UNKNOWN_UNSET | PCRE2_SUBSTITUTE_UNSET_EMPTY);
+	options |= PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+
+	while (cpt < end) {
+		eol = memchr(cpt, '\n', end - cpt);
+		if (!eol) {
+			eol = end;
+		}
+
+		/*
+		 * A plain match, through the JIT fast path, is enough to pass over a line
+		 * which pcre2_substitute() would leave alone
+		 */
+		res = code_match(code, state, (PCRE2_SPTR) cpt, eol - cpt, 0, match_options, match_data, mc);
+		if (res == PCRE2_ERROR_NOMATCH) {
+			res = 0;
+			cpt = eol + 1;
+			continue;
+		}
+		if (res < 0) {
+			break;
+		}
+
+		bufsize = (eol - cpt) + replacement->length + 256;
+		for (;;) {
+			if (!value_buffer_reserve(&vb, bufsize)) {
+				res = PCRE2_ERROR_NOMEMORY;
+				break;
+			}
+			bufsize = vb.size;
+
+			do {
+				jit_stacks.used = 0;
+				outputlength = bufsize;
+				res = pcre2_substitute(code, (PCRE2_SPTR) cpt, eol - cpt, 0, options, match_data, mc,
+					(PCRE2_SPTR) replacement->address, (PCRE2_SIZE) replacement->length,
+					(PCRE2_UCHAR *) vb.buf, &outputlength);
+			} while (jit_stack_retry(res));
+
+			if (res != PCRE2_ERROR_NOMEMORY || outputlength <= bufsize) {
+				break;
+			}
+			bufsize = outputlength;
+		}
+		if (res < 0) {
+			break;
+		}
+
+		if (res > 0) {
+			fwrite(pending, 1, cpt - pending, out);
+			fwrite(vb.buf, 1, outputlength, out);
+			pending = eol;
+			subs += res;
+			(*linesptr)++;
+		}
+		cpt = eol + 1;
+	}
+
+	if (res >= 0) {
+		fwrite(pending, 1, end - pending, out);
+	}
+
+	if (vb.buf) {
+		m_pcre2_free(vb.buf, NULL);
+	}
+
+	return res < 0 ? res : subs;
+}
+
+/**
+ * @brief Substitute in every line of a file, as sed does, writing a new file
+ *
+ * Each line is a subject for pcre2_substitute() on its own, without its "\n",
+ * so with PCRE2_SUBSTITUTE_GLOBAL every match in a line is replaced, and without
+ * it only the first.  The input is mapped into memory and the output written
+ * through a large buffer, so neither goes through M and lines of any length are
+ * handled.  Lines with no match are copied unchanged.
+ *
+ * The output is written to a temporary file beside outpath, which is renamed to
+ * outpath only once it is complete, so outpath is never seen half written and is
+ * left as it was if anything fails.  outpath may be the same as inpath, to
+ * substitute in place; the new file gets the input file's permissions.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param replacement The replacement string
+ * @param options_str Match and substitute options
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ * @param inpath The file to read
+ * @param outpath The file to write
+ * @param linesptr Set to the number of lines changed
+ *
+ * @return The number of substitutions made, or < 0 on error
+ */
+gtm_long_t mpcre2_substitute_file(int count, gtm_char_t *code_str, gtm_string_t *replacement,
+	gtm_char_t *options_str, gtm_char_t *mcontext_str, gtm_char_t *inpath, gtm_char_t *outpath,
+	gtm_long_t *linesptr) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	struct stat st;
+	const char *map = NULL;
+	char *tmppath;
+	FILE *out;
+	uint32_t options;
+	gtm_long_t subs;
+	int fd;
+
+	*linesptr = 0;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	match_data = code_match_data(code, state);
+	if (!match_data) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	fd = open(inpath, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to open %s\n", inpath);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Unable to read %s\n", inpath);
+		close(fd);
+		return -1;
+	}
+	if (st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			fprintf(stderr, "Unable to map %s\n", inpath);
+			close(fd);
+			return -1;
+		}
+		madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	tmppath = m_pcre2_malloc(strlen(outpath) + 8, NULL);
+	if (!tmppath) {
+		if (map) {
+			munmap((void *) map, st.st_size);
+		}
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	sprintf(tmppath, "%s.XXXXXX", outpath);
+
+	fd = mkstemp(tmppath);
+	out = fd < 0 ? NULL : fdopen(fd, "w");
+	if (!out) {
+		fprintf(stderr, "Unable to create a temporary file for %s\n", outpath);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmppath);
+		}
+		m_pcre2_free(tmppath, NULL);
+		if (map) {
+			munmap((void *) map, st.st_size);
+		}
+		return -1;
+	}
+	fchmod(fd, st.st_mode & 07777);
+	setvbuf(out, NULL, _IOFBF, MPCRE2_SUBST_FILE_BUFFER);
+
+	subs = substitute_file_lines(code, state, options, match_data, mc, replacement, map, st.st_size,
+		out, linesptr);
+
+	/*
+	 * The data must be on disk before the rename makes it outpath
+	 */
+	if ((fflush(out) != 0 || ferror(out) || fsync(fd) != 0) && subs >= 0) {
+		fprintf(stderr, "Unable to write %s\n", tmppath);
+		subs = -1;
+	}
+	if (fclose(out) != 0 && subs >= 0) {
+		fprintf(stderr, "Unable to write %s\n", tmppath);
+		subs = -1;
+	}
+	if (subs >= 0 && rename(tmppath, outpath) != 0) {
+		fprintf(stderr, "Unable to rename %s to %s\n", tmppath, outpath);
+		subs = -1;
+	}
+	if (subs < 0) {
+		unlink(tmppath);
+		*linesptr = 0;
+	}
+
+	m_pcre2_free(tmppath, NULL);
+	if (map) {
+		munmap((void *) map, st.st_size);
+	}
+
+	return subs;
+}
+
+
+/**
+ * @brief Match a pattern against many subjects in one call
+ *
+ * Subjects are packed into one string as length-prefixed items (see
+ * batch_subject_next()), so "3:abc0:2:xy" holds "abc", "" and "xy".  The pattern,
+ * options, match context and match data are all looked up once for the whole
+ * batch, which saves the per-call cost of pcre2match over many short subjects.
+ *
+ * The result has one item per subject, separated by ";".  A subject which matched
+ * gives "rc,start", the return from pcre2_match() and the byte offset where the
+ * match starts; one which did not gives just the (negative) return.  So the
+ * subjects above against "b" give "1,1;-1;-1".
+ *
+ * If the result does not fit, the items which do fit are returned along with
+ * PCRE2_ERROR_NOMEMORY.
+ *
+ * Large batches can be split across threads (see mpcre2_batch_config()).  The
+ * pattern's own match data is only used when the batch is not split.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param subjects The packed subjects
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ * @param result Where to put the result for each subject
+ *
+ * @return The number of subjects which matched, or < 0 on error
+ */
+gtm_long_t mpcre2_match_batch(int count, gtm_char_t *code_str, gtm_string_t *subjects,
+	gtm_char_t *options_str, gtm_char_t *mcontext_str, gtm_string_t *result) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	const char *cpt = subjects->address;
+	const char *end = subjects->address + subjects->length;
+	const char *subject;
+	match_profile_t *prof = NULL;
+	size_t len;
+	size_t size = result->length;
+	size_t used = 0;
+	uint32_t options;
+	gtm_long_t matched = 0;
+	int res;
+	int first = 1;
+	int done;
+
+	result->length = 0;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	match_data = code_match_data(code, state);
+	if (!match_data) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	/*
+	 * Split the batch across threads if that is configured, unless we were given
+	 * a match context whose limits the threads could not copy
+	 */
+	if (batch_config.threads > 1 && (strcmp(mcontext_str, "0") == 0 || strcmp(mcontext_str, "NULL") == 0 ||
+		(!handle_lookup(mcontext_str, HANDLE_MATCH_CONTEXT) && (prof = match_profile_find(mcontext_str))))) {
+		matched = match_batch_parallel(code, state, subjects, options, prof, result, size, &done);
+		if (done) {
+			return matched;
+		}
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	while ((res = batch_subject_next(&cpt, end, &subject, &len)) > 0) {
+		res = code_match(code, state, (PCRE2_SPTR) subject, len, 0, options, match_data, mc);
+
+		if (batch_result_append(result->address, &used, size, first, res,
+			res >= 0 ? pcre2_get_ovector_pointer(match_data)[0] : 0) < 0) {
+			result->length = used;
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		if (res >= 0) {
+			matched++;
+		}
+		first = 0;
+	}
+
+	result->length = used;
+
+	if (res < 0) {
+		fprintf(stderr, "Invalid packed subject at offset %ld\n", (long) (cpt - subjects->address));
+		return -1;
+	}
+
+	return matched;
+}
+
+/**
+ * @brief Most text a match stream keeps for a partial match before giving up on it
+ */
+#define MPCRE2_STREAM_RETAIN_MAX (1024 * 1024)
+
+/**
+ * This type holds a match stream, which matches a pattern with the standard
+ * (backtracking or JIT) matcher against a subject fed in chunks
+ */
+typedef struct match_stream {
+	char code_str[24];		///< Handle of the pattern
+	char mcontext_str[32];		///< Match context handle or profile name
+	uint32_t options;		///< Match options
+	pcre2_match_data *match_data;	///< Match data for the stream
+	char *buf;			///< Text kept from earlier chunks, followed by the current chunk
+	size_t len;			///< Bytes of buf in use
+	size_t cap;			///< Bytes allocated for buf
+	PCRE2_SIZE base;		///< Absolute offset of buf[0]
+	PCRE2_SIZE resume;		///< Absolute offset at which to carry on matching
+	int resume_after_empty;		///< Non-zero if an empty match at resume was already reported
+	uint32_t lookbehind;		///< Characters kept before resume: PCRE2_INFO_MAXLOOKBEHIND, at least 1
+	int utf;			///< Non-zero if the pattern is in UTF mode
+	int ended;			///< Non-zero once the last chunk has been fed
+} match_stream_t;
+
+/**
+ * @brief Create a match stream
+ *
+ * A match stream matches a pattern against a subject which is fed to it a chunk at a
+ * time with pcre2matchstreamfeed, for subjects too big for one M string.  It uses
+ * the same matcher as pcre2match (so JIT code if the pattern has it), with
+ * PCRE2_PARTIAL_HARD to spot matches which run over the end of a chunk.  Only the
+ * text from the start of such a match, plus what the pattern's lookbehinds need,
+ * is kept for the next chunk.  At least one character before it is always kept and
+ * matching carries on after it, so that ^ and \b see the real text before a chunk.
+ *
+ * The pattern and context are looked up by handle on each feed, so they must
+ * outlive the stream.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ *
+ * @return A match stream handle, or "0" on error
+ */
+gtm_char_t *mpcre2_match_stream_create(int count, gtm_char_t *code_str, gtm_char_t *options_str,
+	gtm_char_t *mcontext_str) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	match_stream_t *ms;
+	uint32_t options;
+	uint32_t all_options = 0;
+	static char buf[80];
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return "0";
+	}
+
+	if (strlen(code_str) >= sizeof(ms->code_str) || strlen(mcontext_str) >= sizeof(ms->mcontext_str)) {
+		fprintf(stderr, "Handle or profile name too long\n");
+		return "0";
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return "0";
+	}
+
+	ms = m_pcre2_malloc(sizeof(match_stream_t), NULL);
+	if (!ms) {
+		return "0";
+	}
+
+	ms->match_data = pcre2_match_data_create_from_pattern(code, get_general_context("0"));
+	if (!ms->match_data) {
+		m_pcre2_free(ms, NULL);
+		return "0";
+	}
+
+	/*
+	 * JIT code for hard partial matching is separate, so add it if the
+	 * pattern has JIT code at all
+	 */
+	if (state && state->jit) {
+		pcre2_jit_compile(code, PCRE2_JIT_PARTIAL_HARD);
+	}
+
+	ms->lookbehind = 0;
+	pcre2_pattern_info(code, PCRE2_INFO_MAXLOOKBEHIND, &ms->lookbehind);
+	if (ms->lookbehind == 0) {
+		ms->lookbehind = 1;
+	}
+	pcre2_pattern_info(code, PCRE2_INFO_ALLOPTIONS, &all_options);
+
+	strcpy(ms->code_str, code_str);
+	strcpy(ms->mcontext_str, mcontext_str);
+	ms->options = options & ~(PCRE2_PARTIAL_SOFT | PCRE2_PARTIAL_HARD);
+	ms->buf = NULL;
+	ms->len = 0;
+	ms->cap = 0;
+	ms->base = 0;
+	ms->resume = 0;
+	ms->resume_after_empty = 0;
+	ms->utf = (all_options & PCRE2_UTF) != 0;
+	ms->ended = 0;
+
+	if (handle_encode(ms, HANDLE_MATCH_STREAM, buf, sizeof(buf)) < 0) {
+		pcre2_match_data_free(ms->match_data);
+		m_pcre2_free(ms, NULL);
+		return "0";
+	}
+
+	return buf;
+}
+
+/**
+ * @brief Feed the next chunk of the subject to a match stream
+ *
+ * The matches found are returned as "start,end" pairs separated by spaces, with
+ * offsets from the start of the whole subject.  A match still open at the end of a
+ * chunk is reported by the feed which completes it.  Set last for the final chunk
+ * (which may be empty), so that matches which could have gone on are reported;
+ * nothing can be fed after it.  Empty matches are handled as by pcre2matchall.
+ *
+ * If a partial match grows beyond 1M bytes it is dropped, the feed returns
+ * PCRE2_ERROR_NOMEMORY, and matching carries on after the text fed so far.
+ *
+ * @param count Count of parameters from the M API
+ * @param stream_str A match stream handle
+ * @param chunk The next chunk of the subject
+ * @param last Non-zero if this is the last chunk
+ * @param result Where to put the matches
+ *
+ * @return The number of matches, or < 0 on error.  PCRE2_ERROR_NOMEMORY also means
+ * the matches did not all fit in result; the rest of the chunk was skipped.
+ */
+gtm_long_t mpcre2_match_stream_feed(int count, gtm_char_t *stream_str, gtm_string_t *chunk,
+	gtm_long_t last, gtm_string_t *result) {
+
+	match_stream_t *ms;
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_context *mc;
+	global_match_t gm;
+	PCRE2_SIZE *ov;
+	PCRE2_SIZE resume;
+	PCRE2_SIZE keep;
+	PCRE2_SIZE empty_at;
+	PCRE2_SIZE avail;
+	uint32_t back;
+	size_t size = result->length;
+	size_t used = 0;
+	size_t cap;
+	char *nbuf;
+	gtm_long_t matches = 0;
+	int res;
+
+	result->length = 0;
+
+	ms = (match_stream_t *) handle_decode(stream_str, HANDLE_MATCH_STREAM);
+	if (!ms) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	code = code_decode(ms->code_str, &state);
+	if (!code || ms->ended) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	mc = get_match_context(ms->mcontext_str);
+	if (!mc && !handle_is_null(ms->mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	/*
+	 * Add the chunk to what we kept from before
+	 */
+	if (ms->len + chunk->length > ms->cap) {
+		cap = ms->cap ? ms->cap : 4096;
+		while (cap < ms->len + chunk->length) {
+			cap *= 2;
+		}
+		nbuf = m_pcre2_malloc(cap, NULL);
+		if (!nbuf) {
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		if (ms->buf) {
+			memcpy(nbuf, ms->buf, ms->len);
+			m_pcre2_free(ms->buf, NULL);
+		}
+		ms->buf = nbuf;
+		ms->cap = cap;
+	}
+	memcpy(ms->buf + ms->len, chunk->address, chunk->length);
+	ms->len += chunk->length;
+
+	/*
+	 * A UTF-8 character split between chunks is held back until it is whole
+	 */
+	avail = (ms->utf && !last) ? utf8_whole_length(ms->buf, ms->len) : ms->len;
+
+	global_match_init(&gm, code, state, (PCRE2_SPTR) ms->buf, avail, ms->resume - ms->base,
+		ms->options | (last ? 0 : PCRE2_PARTIAL_HARD), ms->match_data, mc);
+	if (ms->resume_after_empty) {
+		gm.started = 1;
+		gm.start = gm.end = ms->resume - ms->base;
+	}
+	ov = pcre2_get_ovector_pointer(ms->match_data);
+
+	resume = ms->base + avail;
+	empty_at = ms->resume_after_empty ? ms->resume : PCRE2_UNSET;
+	ms->resume_after_empty = 0;
+
+	for (;;) {
+		res = global_match_next(&gm);
+
+		if (res == PCRE2_ERROR_NOMATCH) {
+			break;
+		} else if (res == PCRE2_ERROR_PARTIAL) {
+			resume = ms->base + ov[0];
+			ms->resume_after_empty = (resume == empty_at);
+			break;
+		} else if (res < 0) {
+			matches = res;
+			break;
+		}
+
+		/*
+		 * An empty match at the very end of a chunk which is not the last is left
+		 * for the next chunk, so it is not reported twice.
+		 */
+		if (!last && ov[0] >= avail) {
+			resume = ms->base + ov[0];
+			break;
+		}
+
+		if (append_pair(result->address, &used, size, ms->base + ov[0], ms->base + ov[1]) < 0) {
+			matches = PCRE2_ERROR_NOMEMORY;
+			break;
+		}
+		matches++;
+		empty_at = ov[0] == ov[1] ? ms->base + ov[0] : PCRE2_UNSET;
+	}
+
+	if (ms->base + avail - resume > MPCRE2_STREAM_RETAIN_MAX) {
+		resume = ms->base + avail;
+		ms->resume_after_empty = 0;
+		matches = PCRE2_ERROR_NOMEMORY;
+	}
+
+	/*
+	 * Keep the text from where we carry on, plus enough before it for lookbehinds
+	 * and for ^ and \b to look at
+	 */
+	keep = resume - ms->base;
+	for (back = 0; back < ms->lookbehind && keep > 0; back++) {
+		keep--;
+		while (ms->utf && keep > 0 && (ms->buf[keep] & 0xc0) == 0x80) {
+			keep--;
+		}
+	}
+	memmove(ms->buf, ms->buf + keep, ms->len - keep);
+	ms->len -= keep;
+	ms->base += keep;
+	ms->resume = resume;
+
+	ms->ended = last != 0;
+	result->length = used;
+
+	return matches;
+}
+
+/**
+ * @brief Free a match stream
+ *
+ * @param count Count of parameters from the M API
+ * @param stream_str A match stream handle
+ *
+ * @return None
+ */
+void mpcre2_match_stream_free(int count, gtm_char_t *stream_str) {
+
+	match_stream_t *ms;
+
+	ms = (match_stream_t *) handle_release(stream_str, HANDLE_MATCH_STREAM);
+	if (!ms) {
+		return;
+	}
+
+	pcre2_match_data_free(ms->match_data);
+	if (ms->buf) {
+		m_pcre2_free(ms->buf, NULL);
+	}
+	m_pcre2_free(ms, NULL);
+}
+
+/**
+ * @brief Handle for the mpcre2 call-in table, opened on first use
+ */
+static uintptr_t callin_table = 0;
+
+/**
+ * @brief Switch to the mpcre2 call-in table, opening it the first time
+ *
+ * The table is $MPCRE2_SRC/mpcre2.ci, so mpcre2 does not need to be merged
+ * into whatever $GTMCI names.  The routines it calls are in mpcre2ci.m, which
+ * needs to be in $gtmroutines.
+ *
+ * @param old Where to store the table in use before the switch
+ *
+ * @return 0 on success, -1 on error
+ */
+static int callin_table_switch(uintptr_t *old) {
+
+	char fname[1024];
+	char msg[512];
+	char *src;
+
+	if (!callin_table) {
+		src = getenv("MPCRE2_SRC");
+		snprintf(fname, sizeof(fname), "%s/mpcre2.ci", src ? src : ".");
+		if (gtm_ci_tab_open(fname, &callin_table) != 0) {
+			gtm_zstatus(msg, sizeof(msg));
+			fprintf(stderr, "Unable to open call-in table %s: %s\n", fname, msg);
+			callin_table = 0;
+			return -1;
+		}
+	}
+
+	if (gtm_ci_tab_switch(callin_table, old) != 0) {
+		gtm_zstatus(msg, sizeof(msg));
+		fprintf(stderr, "Unable to switch to call-in table: %s\n", msg);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Check that a string is a plain M local variable name
+ *
+ * The name is used with indirection in mpcre2ci.m, so anything else is refused.
+ *
+ * @param name The name to check
+ *
+ * @return Non-zero if the name is usable
+ */
+static int valid_local_name(const char *name) {
+
+	const char *p = name;
+
+	if (*p == '%') {
+		p++;
+	}
+	if (!((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) {
+		return 0;
+	}
+	for (p++; *p; p++) {
+		if (!((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9'))) {
+			return 0;
+		}
+	}
+
+	return (p - name) <= 31;
+}
+
+/**
+ * @brief Set one capture in the caller's local array with setcap^mpcre2ci
+ *
+ * @param varname The M local variable name
+ * @param sub The subscript, either the group number or name
+ * @param text A copy of the captured part of the subject
+ * @param base Offset in the subject where text starts
+ * @param ov The output vector pair for the group
+ *
+ * @return 0 on success, else the GT.M status
+ */
+static int callin_set_capture(char *varname, char *sub, const char *text, PCRE2_SIZE base, PCRE2_SIZE *ov) {
+
+	static ci_name_descriptor setcap = { { sizeof("mpcre2setcap") - 1, "mpcre2setcap" }, NULL };
+	gtm_string_t val;
+
+	val.address = (gtm_char_t *) text + (ov[0] - base);
+	val.length = ov[1] > ov[0] ? ov[1] - ov[0] : 0;
+
+	return gtm_cip(&setcap, varname, sub, &val);
+}
+
+/**
+ * @brief Match and copy every capture into an M local array
+ *
+ * On a successful match the local variable named by varname is killed and then
+ * set so that varname(n) is capture group n (0 being the whole match) and
+ * varname(name) is the named group name.  Groups which are unset are left
+ * undefined, so $DATA tells them apart from empty captures.  For duplicate
+ * names the first group which is set wins, as with pcre2substringgetbyname.
+ *
+ * The array is set through the GT.M call-in interface, using the call-in table
+ * mpcre2.ci in $MPCRE2_SRC and the routine mpcre2ci.m, which must be in
+ * $gtmroutines.  On a failed match the array is left alone.  The subject lives
+ * in GT.M's string pool, which a call-in may garbage collect and move, so the
+ * captured text is copied out of it before the first call-in.
+ *
+ * The pattern's own match data (as for "AUTO") is used.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param subject The string to search for a match
+ * @param startoffset The byte offset at which to start the search
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ * @param varname Name of the M local variable for the captures
+ *
+ * @return As for pcre2match, or -1 if the captures could not be set
+ */
+gtm_long_t mpcre2_match_captures(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *mcontext_str,
+	gtm_char_t *varname) {
+
+	static ci_name_descriptor kill = { { sizeof("mpcre2kill") - 1, "mpcre2kill" }, NULL };
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	PCRE2_SPTR nametable;
+	PCRE2_SPTR entry;
+	PCRE2_SPTR last_name = NULL;
+	PCRE2_SIZE *ov;
+	PCRE2_SIZE lo;
+	PCRE2_SIZE hi = 0;
+	uint32_t options;
+	uint32_t namecount = 0;
+	uint32_t entrysize = 0;
+	uint32_t i;
+	uintptr_t old_table;
+	char *text = NULL;
+	char name[32];
+	char sub[16];
+	char msg[512];
+	int group;
+	int status = 0;
+	int res;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (!valid_local_name(varname)) {
+		fprintf(stderr, "Invalid local variable name %s\n", varname);
+		return -1;
+	}
+	strcpy(name, varname);
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	match_data = code_match_data(code, state);
+	if (!match_data) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = code_match(code, state, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+		(PCRE2_SIZE) startoffset, options, match_data, mc);
+
+	/*
+	 * A start can be after its end with \K in a lookahead, so take the lowest and
+	 * highest of both
+	 */
+	if (res > 0) {
+		ov = pcre2_get_ovector_pointer(match_data);
+		lo = subject->length;
+		for (i = 0; i < (uint32_t) res * 2; i++) {
+			if (ov[i] != PCRE2_UNSET) {
+				lo = ov[i] < lo ? ov[i] : lo;
+				hi = ov[i] > hi ? ov[i] : hi;
+			}
+		}
+		if (hi < lo) {
+			hi = lo;
+		}
+		text = m_pcre2_malloc(hi - lo + 1, NULL);
+		if (!text) {
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		memcpy(text, subject->address + lo, hi - lo);
+	}
+
+	if (res > 0 && callin_table_switch(&old_table) == 0) {
+		status = gtm_cip(&kill, name);
+
+		for (i = 0; status == 0 && i < (uint32_t) res; i++) {
+			if (ov[i*2] == PCRE2_UNSET) {
+				continue;
+			}
+			snprintf(sub, sizeof(sub), "%u", i);
+			status = callin_set_capture(name, sub, text, lo, &ov[i*2]);
+		}
+
+		pcre2_pattern_info(code, PCRE2_INFO_NAMECOUNT, &namecount);
+		pcre2_pattern_info(code, PCRE2_INFO_NAMEENTRYSIZE, &entrysize);
+		pcre2_pattern_info(code, PCRE2_INFO_NAMETABLE, &nametable);
+
+		/*
+		 * Each entry is a two byte group number followed by the name.  The table is
+		 * sorted by name, so duplicate names are next to each other.
+		 */
+		for (i = 0; status == 0 && i < namecount; i++) {
+			entry = nametable + (i * entrysize);
+			group = (entry[0] << 8) | entry[1];
+			if (group >= res || ov[group*2] == PCRE2_UNSET) {
+				continue;
+			}
+			if (last_name && strcmp((char *) last_name, (char *) entry + 2) == 0) {
+				continue;
+			}
+			last_name = entry + 2;
+			status = callin_set_capture(name, (char *) entry + 2, text, lo, &ov[group*2]);
+		}
+
+		gtm_ci_tab_switch(old_table, &old_table);
+
+		if (status != 0) {
+			gtm_zstatus(msg, sizeof(msg));
+			fprintf(stderr, "Unable to set captures in %s: %s\n", name, msg);
+			res = -1;
+		}
+	} else if (res > 0) {
+		res = -1;
+	}
+
+	if (text) {
+		m_pcre2_free(text, NULL);
+	}
+
+	return res;
+}
+
+/**
+ * @brief Number of ints in a DFA workspace when the caller does not say
+ */
+#define MPCRE2_DFA_WORKSPACE_MIN 1000
+
+/**
+ * @brief Number of ints beyond which a DFA workspace is not grown
+ */
+#define MPCRE2_DFA_WORKSPACE_MAX (1024 * 1024)
+
+/**
+ * This type holds a heap allocated workspace for pcre2_dfa_match()
+ */
+typedef struct dfa_workspace {
+	int *ws;		///< The workspace
+	size_t count;		///< Number of ints in the workspace
+} dfa_workspace_t;
+
+static dfa_workspace_t dfa_workspace = { NULL, 0 };	///< Workspace for pcre2dfamatch
+
+/**
+ * @brief Make sure a DFA workspace has at least a given number of ints
+ *
+ * The contents are not kept when the workspace grows.
+ *
+ * @param w The workspace
+ * @param count Number of ints needed, 0 for at least MPCRE2_DFA_WORKSPACE_MIN
+ *
+ * @return 0 on success, -1 if we could not get the memory
+ */
+static int dfa_workspace_reserve(dfa_workspace_t *w, size_t count) {
+
+	int *ws;
+
+	if (count < MPCRE2_DFA_WORKSPACE_MIN) {
+		count = MPCRE2_DFA_WORKSPACE_MIN;
+	}
+
+	if (w->count >= count) {
+		return 0;
+	}
+
+	ws = m_pcre2_malloc(count * sizeof(int), NULL);
+	if (!ws) {
+		return -1;
+	}
+
+	if (w->ws) {
+		m_pcre2_free(w->ws, NULL);
+	}
+	w->ws = ws;
+	w->count = count;
+
+	return 0;
+}
+
+/**
+ * @brief Run pcre2_dfa_match(), growing the workspace until it is big enough
+ *
+ * PCRE2_ERROR_DFA_WSSIZE and PCRE2_ERROR_DFA_RECURSE both mean the workspace was
+ * too small, so we double it (up to MPCRE2_DFA_WORKSPACE_MAX) and try again.  This
+ * is not done for PCRE2_DFA_RESTART, which needs the workspace exactly as the
+ * previous match left it.
+ *
+ * @param code The compiled pattern
+ * @param subject The subject string
+ * @param length Length of the subject
+ * @param startoffset Where to start matching
+ * @param options Match options
+ * @param match_data Match data block
+ * @param mc Match context, or NULL
+ * @param w The workspace
+ *
+ * @return As for pcre2_dfa_match()
+ */
+static int dfa_match(pcre2_code *code, PCRE2_SPTR subject, PCRE2_SIZE length, PCRE2_SIZE startoffset,
+	uint32_t options, pcre2_match_data *match_data, pcre2_match_context *mc, dfa_workspace_t *w) {
+
+	int res;
+
+	for (;;) {
+		res = pcre2_dfa_match(code, subject, length, startoffset, options, match_data, mc,
+			w->ws, (PCRE2_SIZE) w->count);
+
+		if ((res != PCRE2_ERROR_DFA_WSSIZE && res != PCRE2_ERROR_DFA_RECURSE) ||
+			(options & PCRE2_DFA_RESTART) || w->count >= MPCRE2_DFA_WORKSPACE_MAX) {
+			break;
+		}
+
+		if (dfa_workspace_reserve(w, w->count * 2 < MPCRE2_DFA_WORKSPACE_MAX ?
+			w->count * 2 : MPCRE2_DFA_WORKSPACE_MAX) < 0) {
+			break;
+		}
+	}
+
+	return res;
+}
+
+/**
+ * @brief wrap pcre2_dfa_match() for M
+ *
+ * We bring in "subject" as an M string, so we can have embedded zero bytes.  This gives
+ * us a length, so we don't have a separate parameter for that.  Additionally, there is
+ * no way, or reason to pass in a vector of ints for "workspace from M, so we simply accept
+ * a count.  The workspace is kept on the heap between calls and grown as matches need
+ * it (see dfa_match()), so the count is only a starting size, and 0 leaves it to us.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression pointer in string format
+ * @param subject The string to search for matches
+ * @param startoffset The byte offset at which to start the match search
+ * @param options_str Pcre2 match options in string form
+ * @param match_data_str A Pcre2 match data pointer in string format, or "AUTO" for the pattern's own match data
+ * @param mcontext_str A Pcre2 match context pointer in string format, "0", or a profile name
+ * @param wscount Minimum number of entries in the workspace vector, or 0 for automatic
+ *
+ * @return < 0 on error or no match, 0 vector offests too small, else one more than the highest numbered capturing pair that has been set
+ */
+gtm_long_t mpcre2_dfa_match(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
+	gtm_char_t *mcontext_str, gtm_long_t wscount) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	uint32_t options;
+	gtm_long_t res;
+
+	code = code_decode(code_str, &state);
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	match_data = match_data_decode(match_data_str, code, state);
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (wscount < 0 || dfa_workspace_reserve(&dfa_workspace, (size_t) wscount) < 0) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	res = dfa_match(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+		(PCRE2_SIZE) startoffset, options, match_data, mc, &dfa_workspace);
+
+	return res;
+
+}
+
+/**
+ * This type holds a DFA match stream, which matches a pattern against a subject
+ * fed in chunks
+ */
+typedef struct dfa_stream {
+	char code_str[24];		///< Handle of the pattern
+	char mcontext_str[32];		///< Match context handle or profile name
+	uint32_t options;		///< Match options
+	pcre2_match_data *match_data;	///< Match data for the stream
+	dfa_workspace_t workspace;	///< Workspace, kept between chunks for PCRE2_DFA_RESTART
+	PCRE2_SIZE base;		///< Absolute offset of the start of the next chunk
+	PCRE2_SIZE partial_start;	///< Absolute start of the partial match being carried over
+	int partial;			///< Non-zero if a partial match is being carried over
+	int utf;			///< Non-zero if the pattern is in UTF mode
+	int ended;			///< Non-zero once the last chunk has been fed
+	uint32_t lookbehind;		///< Characters of each chunk kept as context for the next
+	char carry[4];			///< Start of a UTF-8 character split between chunks
+	size_t carry_len;		///< Bytes in carry
+	char *buf;			///< The kept context, followed by carry and the next chunk
+	size_t keep_len;		///< Bytes of kept context at the start of buf
+	size_t cap;			///< Bytes allocated for buf
+} dfa_stream_t;
+
+/**
+ * @brief Create a DFA match stream
+ *
+ * A DFA stream matches a pattern against a subject which is fed to it a chunk at a
+ * time with pcre2dfastreamfeed, for subjects too big for one M string.  Matches
+ * which run over the end of a chunk are carried on into the next one with
+ * PCRE2_PARTIAL_HARD and PCRE2_DFA_RESTART, so a match is not looked at twice.
+ * Like pcre2dfamatch, each match found is the longest one at its start.
+ *
+ * Each chunk is matched behind the last few characters of the one before it (as
+ * many as the pattern's longest lookbehind, and at least one), so that ^, \A, \b
+ * and lookbehinds see the real text before the chunk.
+ *
+ * The pattern and context are looked up by handle on each feed, so they must
+ * outlive the stream.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str A pcre2 compiled regular expression handle
+ * @param options_str Pcre2 match options in string form
+ * @param mcontext_str A Pcre2 match context handle, "0", or a profile name
+ *
+ * @return A DFA stream handle, or "0" on error
+ */
+gtm_char_t *mpcre2_dfa_stream_create(int count, gtm_char_t *code_str, gtm_char_t *options_str,
+	gtm_char_t *mcontext_str) {
+
+	pcre2_code *code;
+	dfa_stream_t *ds;
+	uint32_t options;
+	uint32_t all_options = 0;
+	static char buf[80];
+
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
+	if (!code) {
+		return "0";
+	}
+
+	if (strlen(code_str) >= sizeof(ds->code_str) || strlen(mcontext_str) >= sizeof(ds->mcontext_str)) {
+		fprintf(stderr, "Handle or profile name too long\n");
+		return "0";
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return "0";
+	}
+
+	ds = m_pcre2_malloc(sizeof(dfa_stream_t), NULL);
+	if (!ds) {
+		return "0";
+	}
+
+	ds->match_data = pcre2_match_data_create_from_pattern(code, get_general_context("0"));
+	if (!ds->match_data) {
+		m_pcre2_free(ds, NULL);
+		return "0";
+	}
+
+	pcre2_pattern_info(code, PCRE2_INFO_ALLOPTIONS, &all_options);
+	ds->utf = (all_options & PCRE2_UTF) != 0;
+
+	/*
+	 * There is always room in buf for the context kept from one chunk
+	 */
+	ds->lookbehind = 0;
+	pcre2_pattern_info(code, PCRE2_INFO_MAXLOOKBEHIND, &ds->lookbehind);
+	if (ds->lookbehind == 0) {
+		ds->lookbehind = 1;
+	}
+	ds->cap = ds->utf ? (size_t) ds->lookbehind * 4 : ds->lookbehind;
+	ds->buf = m_pcre2_malloc(ds->cap, NULL);
+	if (!ds->buf) {
+		pcre2_match_data_free(ds->match_data);
+		m_pcre2_free(ds, NULL);
+		return "0";
+	}
+
+	strcpy(ds->code_str, code_str);
+	strcpy(ds->mcontext_str, mcontext_str);
+	ds->options = options;
+	ds->workspace.ws = NULL;
+	ds->workspace.count = 0;
+	if (dfa_workspace_reserve(&ds->workspace, 0) < 0) {
+		pcre2_match_data_free(ds->match_data);
+		m_pcre2_free(ds->buf, NULL);
+		m_pcre2_free(ds, NULL);
+		return "0";
+	}
+	ds->base = 0;
+	ds->partial_start = 0;
+	ds->partial = 0;
+	ds->ended = 0;
+	ds->carry_len = 0;
+	ds->keep_len = 0;
+
+	if (handle_encode(ds, HANDLE_DFA_STREAM, buf, sizeof(buf)) < 0) {
+		pcre2_match_data_free(ds->match_data);
+		m_pcre2_free(ds->workspace.ws, NULL);
+		m_pcre2_free(ds->buf, NULL);
+		m_pcre2_free(ds, NULL);
+		return "0";
+	}
+
+	return buf;
+}
+
+/**
+ * @brief Feed the next chunk of the subject to a DFA match stream
+ *
+ * The matches which end in this chunk are returned as "start,end" pairs separated
+ * by spaces, with offsets from the start of the whole subject.  A match still open
+ * at the end of a chunk is reported by the feed which completes it.  Set last for
+ * the final chunk (which may be empty), so that matches which could have gone on
+ * are reported; nothing can be fed after it.
+ *
+ * After an empty match the scan moves on one character.  As with any DFA partial
+ * matching, a match which starts inside a carried over partial match, after its
+ * start, is not found.
+ *
+ * @param count Count of parameters from the M API
+ * @param stream_str A DFA stream handle
+ * @param chunk The next chunk of the subject
+ * @param last Non-zero if this is the last chunk
+ * @param result Where to put the matches
+ *
+ * @return The number of matches, or < 0 on error.  PCRE2_ERROR_NOMEMORY means the
+ * matches did not all fit in result, and the rest of the chunk was skipped.
+ */
+gtm_long_t mpcre2_dfa_stream_feed(int count, gtm_char_t *stream_str, gtm_string_t *chunk,
+	gtm_long_t last, gtm_string_t *result) {
+
+	dfa_stream_t *ds;
+	pcre2_code *code;
+	pcre2_match_context *mc;
+	PCRE2_SPTR subject;
+	PCRE2_SIZE length;
+	PCRE2_SIZE start;
+	PCRE2_SIZE offset;
+	PCRE2_SIZE origin;
+	PCRE2_SIZE avail;
+	PCRE2_SIZE keep;
+	PCRE2_SIZE *ov;
+	uint32_t partial;
+	uint32_t n;
+	size_t size = result->length;
+	size_t used = 0;
+	gtm_long_t matches = 0;
+	char *nbuf;
+	int res;
+
+	result->length = 0;
+
+	ds = (dfa_stream_t *) handle_decode(stream_str, HANDLE_DFA_STREAM);
+	if (!ds) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	code = (pcre2_code *) handle_decode(ds->code_str, HANDLE_CODE);
+	if (!code || ds->ended) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	mc = get_match_context(ds->mcontext_str);
+	if (!mc && !handle_is_null(ds->mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	subject = (PCRE2_SPTR) chunk->address;
+	length = (PCRE2_SIZE) chunk->length;
+
+	/*
+	 * Matching starts after the context kept from the last chunk and any UTF-8
+	 * character split between the chunks, so the three are put together in buf
+	 */
+	start = ds->keep_len;
+	if (ds->keep_len || ds->carry_len) {
+		if (ds->cap < ds->keep_len + ds->carry_len + length) {
+			nbuf = m_pcre2_malloc(ds->keep_len + ds->carry_len + length, NULL);
+			if (!nbuf) {
+				return PCRE2_ERROR_NOMEMORY;
+			}
+			memcpy(nbuf, ds->buf, ds->keep_len);
+			m_pcre2_free(ds->buf, NULL);
+			ds->buf = nbuf;
+			ds->cap = ds->keep_len + ds->carry_len + length;
+		}
+		memcpy(ds->buf + ds->keep_len, ds->carry, ds->carry_len);
+		memcpy(ds->buf + ds->keep_len + ds->carry_len, chunk->address, length);
+		subject = (PCRE2_SPTR) ds->buf;
+		length += ds->keep_len + ds->carry_len;
+		ds->carry_len = 0;
+	}
+	if (ds->utf && !last) {
+		avail = start + utf8_whole_length((const char *) subject + start, length - start);
+		ds->carry_len = length - avail;
+		memcpy(ds->carry, subject + avail, ds->carry_len);
+		length = avail;
+	}
+
+	/*
+	 * With nothing new to look at there is nothing to do, and a restart on an empty
+	 * subject would end the partial match we are carrying
+	 */
+	if (length == start && !last) {
+		return 0;
+	}
+	partial = last ? 0 : PCRE2_PARTIAL_HARD;
+	ov = pcre2_get_ovector_pointer(ds->match_data);
+	origin = ds->base - start;
+	offset = start;
+
+	/*
+	 * Carry on with the partial match from the last chunk, if there is one
+	 */
+	if (ds->partial) {
+		res = dfa_match(code, subject, length, start, ds->options | partial | PCRE2_DFA_RESTART,
+			ds->match_data, mc, &ds->workspace);
+
+		if (res == PCRE2_ERROR_PARTIAL) {
+			offset = length + 1;
+		} else if (res >= 0) {
+			ds->partial = 0;
+			if (append_pair(result->address, &used, size, ds->partial_start, origin + ov[1]) < 0) {
+				matches = PCRE2_ERROR_NOMEMORY;
+				offset = length + 1;
+			} else {
+				matches++;
+				offset = ov[1];
+			}
+		} else if (res == PCRE2_ERROR_NOMATCH) {
+			ds->partial = 0;
+		} else {
+			matches = res;
+			offset = length + 1;
+		}
+	}
+
+	/*
+	 * An empty match at the very end of a chunk which is not the last is left
+	 * for the start of the next chunk, so it is not reported twice.
+	 */
+	while (offset < length || (last && offset == length)) {
+		res = dfa_match(code, subject, length, offset, ds->options | partial,
+			ds->match_data, mc, &ds->workspace);
+
+		if (res == PCRE2_ERROR_NOMATCH) {
+			break;
+		} else if (res == PCRE2_ERROR_PARTIAL) {
+			ds->partial = 1;
+			ds->partial_start = origin + ov[0];
+			break;
+		} else if (res < 0) {
+			matches = res;
+			break;
+		}
+
+		if (append_pair(result->address, &used, size, origin + ov[0], origin + ov[1]) < 0) {
+			matches = PCRE2_ERROR_NOMEMORY;
+			break;
+		}
+		matches++;
+
+		offset = ov[1];
+		if (ov[0] == ov[1]) {
+			offset++;
+			while (ds->utf && offset < length && (subject[offset] & 0xc0) == 0x80) {
+				offset++;
+			}
+		}
+	}
+
+	/*
+	 * If we stopped for an error, a partial match we were carrying is lost
+	 */
+	if (matches < 0) {
+		ds->partial = 0;
+	}
+
+	/*
+	 * Keep the last few characters as context for the next chunk.  buf was
+	 * made big enough for them when the stream was created.
+	 */
+	keep = length;
+	for (n = ds->lookbehind; n && keep; n--) {
+		keep--;
+		while (ds->utf && keep && (subject[keep] & 0xc0) == 0x80) {
+			keep--;
+		}
+	}
+	if (length - keep > ds->cap) {
+		keep = length - ds->cap;	/* only with malformed UTF-8 */
+	}
+	ds->keep_len = length - keep;
+	memmove(ds->buf, subject + keep, ds->keep_len);
+
+	ds->base += length - start;
+	ds->ended = last != 0;
+	result->length = used;
+
+	return matches;
+}
+
+/**
+ * @brief Free a DFA match stream
+ *
+ * @param count Count of parameters from the M API
+ * @param stream_str A DFA stream handle
+ *
+ * @return None
+ */
+void mpcre2_dfa_stream_free(int count, gtm_char_t *stream_str) {
+
+	dfa_stream_t *ds;
+
+	ds = (dfa_stream_t *) handle_release(stream_str, HANDLE_DFA_STREAM);
+	if (!ds) {
+		return;
+	}
+
+	pcre2_match_data_free(ds->match_data);
+	m_pcre2_free(ds->workspace.ws, NULL);
+	m_pcre2_free(ds->buf, NULL);
+	m_pcre2_free(ds, NULL);
+}
+
+/**
+ * @brief Wrap the pcre2_match_data_free() function
+ *
+ * @param count M API argument count
+ * @param match_data_str Stringified match data pointer
+ * 
+ * @return None
+ */
+void mpcre2_match_data_free(int count, gtm_char_t *match_data_str) {
+
+	pcre2_match_data *match_data;
+	handle_slot_t *hs;
+
+	/*
+	 * The match data used for "AUTO" goes when its pattern goes
+	 */
+	hs = handle_lookup(match_data_str, HANDLE_MATCH_DATA);
+	if (hs && hs->aux) {
+		fprintf(stderr, "Match data %s belongs to a compiled pattern and is freed with it\n", match_data_str);
+		return;
+	}
+
+	match_data = (pcre2_match_data *) handle_release(match_data_str, HANDLE_MATCH_DATA);
+
+	pcre2_match_data_free(match_data);
+}
+
+/**
+ * @brief wrap pcre2_get_mark()
+ *
+ * Note this text from the PCRE2 documentation:
+ *
+ *	After a successful match, a partial match
+ *	(PCRE2_ERROR_PARTIAL), or a failure to match
+ *	(PCRE2_ERROR_NOMATCH), a mark name may be
+ *	available. The function pcre2_get_mark()
+ *	can be called to access this name, which
+ *	can be specified in the pattern by any of
+ *	the backtracking control verbs, not just
+ *	(*MARK). The same function applies to all
+ *	the verbs. It returns a pointer to the
+ *	zero-terminated name, which is within the
+ *	compiled pattern. If no name is available,
+ *	NULL is returned. The length of the name
+ *	(excluding the terminating zero) is stored
+ *	in the code unit that precedes the name. You
+ *	should use this length instead of relying
+ *	on the terminating zero if the name might
+ *	contain a binary zero.
+ *
+ *  So we are given liberty to index *BACKWARD* from the
+ *  given string, as unusual as that might seem.  In fact
+ *  we do do this, so we can construct an M string which will
+ *  still be OK if it contains zero bytes.  Since we only handle
+ *  8 bit code units, the length of the mark name ipso facto
+ *  must be <= 255.
+ *
+ * @param count Paramater count from the M API
+ * @param match_data_str A match data handle
+ *
+ * @return A mark name, or zero length string if none is available
+ *
+ */
+gtm_string_t *mpcre2_get_mark(int count, gtm_char_t *match_data_str) {
+
+	pcre2_match_data *match_data;
+	unsigned char mark_len;
+	char *mark_name;
+	static gtm_string_t ret;
+
+	ret.address = NULL;
+	ret.length = 0;
+
+	match_data = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!match_data) {
+		return &ret;
+	}
+
+	mark_name = (char *) pcre2_get_mark(match_data);
+
+	if (mark_name) {
+		ret.address = mark_name;
+		mark_len = (unsigned char) mark_name[-1];	/* see note in function header */
+		ret.length = (int) mark_len;
+	} 
+
+	return &ret;
+
+}
+
+/**
+ * @brief wrap the pcre2_get_ovector_count() function
+ *
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for a pcre2 *match_data pointer
+ *
+ * @return The number of pairs in the output vector for this match
+ */
+ gtm_long_t mpcre2_get_ovector_count(int count, gtm_char_t *match_data_str) {
+
+ 	pcre2_match_data *match_data;
+
+	match_data = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!match_data) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_get_ovector_count(match_data);
+ }
+
+/**
+ * @brief wrap the pcre2_get_ovector_pointer() function
+ *
+ * This function is provided, but does not have much direct utility in M, as there
+ * is no native way to *use* the returned handle.  Instead, the
+ * result must be used with the utility function mpcre2_get_ov_pair()
+ * (pcre2getovpair in M)
+ *
+ * @param count The parameter count from the M API
+ * @param match_data_str String handle for a match data pointer
+ *
+ * @return A string handle for the output vector pointer
+ */
+ gtm_char_t *mpcre2_get_ovector_pointer(int count, gtm_char_t *match_data_str) {
+
+ 	pcre2_match_data *match_data;
+	PCRE2_SIZE *p;
+	static char buf[80];
+
+	match_data = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!match_data) {
+		return "0";
+	}
+
+	p = pcre2_get_ovector_pointer(match_data);
+
+	pointer_encode(p, buf, sizeof(buf));
+
+	return buf;
+ }
+
+
+/**
+ * @brief wrap pcre2_get_startchar()
+ *
+ * @param count Parameter count from M API
+ * @param match_data_str Match data handle
+ *
+ * @return Code unit offset of successful match
+ */
+gtm_long_t mpcre2_get_startchar(int count, char *match_data_str) {
+
+	pcre2_match_data *match_data;
+
+	match_data = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!match_data) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_get_startchar(match_data);
+}
+
+/**
+ * @brief Wrap the pcre2_general_context_create() function
+ *
+ * In general M code should never need to call this function, as m_pcre2
+ * creates a hidden general context when needed.  Also, there is no way
+ * from M to specify custom C level arguments (unless the M runtime has another
+ * plugin which returns appropriate handles).
+ *
+ * However, if "0" is passed for all three parameters, NULL will be used, and 
+ * a general context using the system (not M) memory functions will be returned.
+ *
+ * @param count Count of parameters provided by the M API
+ * @param malloc_ptr_str String handle for a pointer to a pcre2 malloc() compatible function
+ * @param free_ptr_str String handle for a pointer to a pcre2 free() compatible function
+ * @param data_ptr_str String handle for a pointer to a data item to be used for marking memory
+ *
+ * @return A string handle to the created pcre2_general_context (or "0" on failure)
+ *
+ */
+gtm_char_t *mpcre2_general_context_create(int count, gtm_char_t *malloc_ptr_str, gtm_char_t *free_ptr_str, gtm_char_t *data_ptr_str) {
+	
+	pcre2_general_context *gc;
+	static char buf[80];
+
+	gc = pcre2_general_context_create(pointer_decode(malloc_ptr_str), pointer_decode(free_ptr_str), pointer_decode(data_ptr_str));
+
+	handle_encode(gc, HANDLE_GENERAL_CONTEXT, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Wrap the pcre2_general_context_copy() function
+ *
+ * @param count Parameter count provided by the M API
+ * @param general_context_str String handle to a pcre2 general context
+ *
+ * @return A string handle to a copy of the provided general context or "0"
+ *
+ */ 
+ gtm_char_t *mpcre2_general_context_copy(int count, gtm_char_t *general_context_str) {
+ 	
+	pcre2_general_context *gc;
+	pcre2_general_context *gc2;
+	static char buf[80];
+
+	gc = (pcre2_general_context *) handle_decode(general_context_str, HANDLE_GENERAL_CONTEXT);
+	if (!gc) {
+		return "0";
+	}
+
+	gc2 = pcre2_general_context_copy(gc);
+
+	handle_encode(gc2, HANDLE_GENERAL_CONTEXT, buf, sizeof(buf));
+
+	return buf;
+ }
+
+/**
+ * @brief Wrap pcre2_general_context_free()
+ *
+ * @param count Parameter count from the M API
+ * @param gc_str String handle to a pcre2 general context
+ *
+ * @return None
+ */
+void mpcre2_general_context_free(int count, gtm_char_t *gc_str) {
+	
+	pcre2_general_context *gc;
+
+	gc = (pcre2_general_context *) handle_decode(gc_str, HANDLE_GENERAL_CONTEXT);
+
+	/*
+	 * The default general context is used behind the scenes and is never freed
+	 */
+	if (!gc || gc == get_general_context("0")) {
+		return;
+	}
+
+	handle_release(gc_str, HANDLE_GENERAL_CONTEXT);
+	pcre2_general_context_free(gc);
+}
+
+/**
+ * @brief Wrap the pcre2_compile_context_create() function
+ *
+ * @param count Parameter count provided by the M API
+ * @param gc_str String handle to a pcre2 general context
+ *
+ * @return String handle to a pcre2 compile context
+ */
+gtm_char_t *mpcre2_compile_context_create(int count, gtm_char_t *gc_str) {
+
+	pcre2_general_context *gc;
+	pcre2_compile_context *cc;
+	static char buf[80];
+
+	gc = (pcre2_general_context *) handle_decode(gc_str, HANDLE_GENERAL_CONTEXT);
+
+	cc = pcre2_compile_context_create(gc);
+
+	handle_encode(cc, HANDLE_COMPILE_CONTEXT, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Wrap the pcre2_compile_context_copy() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ *
+ * @return String handle for a copy of the given context
+ *
+ */
+gtm_char_t *mpcre2_compile_context_copy(int count, gtm_char_t *ccontext_str) {
+
+	pcre2_compile_context *cc;
+	pcre2_compile_context *cc2;
+	static char buf[80];
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return "0";
+	}
+
+	cc2 = pcre2_compile_context_copy(cc);
+
+	handle_encode(cc2, HANDLE_COMPILE_CONTEXT, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Wrap the pcre2_compile_context_free() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ *
+ * @return None
+ */
+ void mpcre2_compile_context_free(int count, gtm_char_t *ccontext_str) {
+	pcre2_compile_context *cc;
+
+	cc = (pcre2_compile_context *) handle_release(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (cc) {
+		cache_forget_context(cc);
+	}
+
+	pcre2_compile_context_free(cc);
+ }
+
+/**
+ * @brief Wrap the pcre2_set_bsr() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ * @param value_str String form of pcre2 code for handling \\R mapping
+ *
+ * @return 0 on success, non zero on failure
+ */
+gtm_long_t mpcre2_set_bsr(int count, gtm_char_t *ccontext_str, gtm_char_t *value_str) {
+
+	uint32_t value;
+	pcre2_compile_context *cc;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	/*
+	 * Parse the bsr option string
+	 */
+	if (parse_pcre2_options(bsr_opts, n_bsr_opts, "bsr", value_str, &value) < 0) {
+		return PCRE2_ERROR_BADDATA;
+	}
+
+	cache_forget_context(cc);
+
+	return pcre2_set_bsr(cc, value);
+}
+
+/**
+ * @brief Wrap the  pcre2_set_character_tables() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ * @param tables_str String handle for a result from pcre2_maketables, or "NULL"
+ *
+ * @return Always returns 0
+ */
+gtm_long_t mpcre2_set_character_tables(int count, gtm_char_t *ccontext_str, gtm_char_t *tables_str) {
+
+	pcre2_compile_context *cc;
+	const unsigned char *tables;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	tables = (const unsigned char*) pointer_decode(tables_str);
+
+	cache_forget_context(cc);
+
+	return pcre2_set_character_tables(cc, tables);
+}
+
+/**
+ * @brief Wrap the pcre2_set_compile_extra_options() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ * @param extra_options_str String with pcre2 "extra" compile options
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_compile_extra_options(int count, gtm_char_t *ccontext_str, gtm_char_t *extra_options_str) {
+
+	pcre2_compile_context *cc;
+	uint32_t extra_options;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	/* not really much point error checking this */
+	if (parse_pcre2_options(extra_compile_opts, n_extra_compile_opts, "extra compile", extra_options_str, &extra_options) < 0) {
+		return 0;
+	}
+
+	cache_forget_context(cc);
+
+	return pcre2_set_compile_extra_options(cc, extra_options);
+}
+
+/**
+ * @brief Wrap the pcre2_set_max_pattern_length() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ * @param value The maximum number of code units allowed in a pcre2 pattern
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_max_pattern_length(int count, gtm_char_t *ccontext_str, gtm_long_t value) {
+	pcre2_compile_context *cc;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	cache_forget_context(cc);
+
+	return pcre2_set_max_pattern_length(cc, value);
+}
+
+/**
+ * @brief Wrap pcre2_set_newline() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle for a pcre2 compile context
+ * @param value_str String representing the pcre2 newline convention to set
+ *
+ * @return 0 on success, nonzero on error
+ */
+gtm_long_t mpcre2_set_newline(int count,gtm_char_t *ccontext_str, gtm_char_t *value_str) {
+
+	pcre2_compile_context *cc;
+	uint32_t value;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	if(parse_pcre2_options(newline_opts, n_newline_opts, "newline opts", value_str, &value) < 0) {
+		return PCRE2_ERROR_BADDATA;
+	}
+
+	cache_forget_context(cc);
+
+	return pcre2_set_newline(cc, value);
+}
+
+/**
+ * @brief Wrap the pcre2_set_parens_nest_limit() function
+ *
+ * @param count Parameter count from the M API
+ * @param ccontext_str String handle to a pcre2 compile context
+ * @param value The maximum allowed nesting depth for parens
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_parens_nest_limit(int count, gtm_char_t *ccontext_str, gtm_long_t value) {
+
+	pcre2_compile_context *cc;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	cache_forget_context(cc);
+
+	return pcre2_set_parens_nest_limit(cc, value);
+}
+
+/**
+ * @brief Wrap the pcre2_set_compile_recursion_guard() function
+ *
+ * This function is unlikely to be useful in the context of libm_pcre2, as
+ * it sets up a callback for use during expression compilation of parenthesized
+ * patterns, and libm_pcre2 does not provide any way to create such a function
  * or return a handle to it.  That functionality could be provided by another
  * plugin, but is left as an exercise for the reader.
  *
  * @param count Parameter count from the M API
- * @param ccontext_str String handle for a pcre2 compile context
- * @param guard_function_str String handle for a pointer to a guard function
- * @param user_data_str String handle for a piece of user data
+ * @param ccontext_str String handle for a pcre2 compile context
+ * @param guard_function_str String handle for a pointer to a guard function
+ * @param user_data_str String handle for a piece of user data
+ *
+ * @return 0 in all cases
+ *
+ */
+ gtm_long_t mpcre2_set_compile_recursion_guard(int count, gtm_char_t *ccontext_str, gtm_char_t *guard_function_str, gtm_char_t *user_data_str) {
+
+	pcre2_compile_context *cc;
+	void *guard_function;
+	void *user_data;
+
+	cc = (pcre2_compile_context *) handle_decode(ccontext_str, HANDLE_COMPILE_CONTEXT);
+	if (!cc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	guard_function = (void *) pointer_decode(guard_function_str);
+
+	user_data = (void *) pointer_decode(user_data_str);
+
+	cache_forget_context(cc);
+
+	return pcre2_set_compile_recursion_guard(cc, guard_function, user_data);
+ }
+
+/**
+ * @brief Wrap the pcre2_match_context_create() function
+ *
+ * @param count Parameter count from the M API
+ * @param gcontext_str String handle to a pcre2 general context
+ *
+ * @return String handle to a pcre2 match context
+ */
+gtm_char_t *mpcre2_match_context_create(int count, gtm_char_t *gcontext_str) {
+
+	pcre2_general_context *gc;
+	pcre2_match_context *mc;
+	static char buf[80];
+
+	gc = get_general_context(gcontext_str);
+
+	mc = pcre2_match_context_create(gc);
+
+	handle_encode(mc, HANDLE_MATCH_CONTEXT, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Wrap the pcre2_match_context_copy() function
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle to a pcre2 match context
+ *
+ * @return String handle for a new pcre2 match context
+ */
+gtm_char_t *mpcre2_match_context_copy(int count, gtm_char_t *mcontext_str) {
+
+	pcre2_match_context *mc;
+	pcre2_match_context *mc2;
+	static char buf[80];
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return "0";
+	}
+
+	mc2 = pcre2_match_context_copy(mc);
+
+	handle_encode(mc2, HANDLE_MATCH_CONTEXT, buf, sizeof(buf));
+
+	return buf;
+}
+
+/**
+ * @brief Wrap the pcre2_match_context_free() function
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle for a pcre2 match context
+ *
+ * @return None
+ */ 
+ void mpcre2_match_context_free(int count, gtm_char_t* mcontext_str) {
+
+	pcre2_match_context *mc;
+
+	mc = (pcre2_match_context *) handle_release(mcontext_str, HANDLE_MATCH_CONTEXT);
+
+ 	pcre2_match_context_free(mc);
+ }
+
+/**
+* @brief Wrap the pcre2_set_callout() function
+*
+* This function is unlikely to be of use in the libm_pcre2 context as it
+* sets up a callout function in a pcre2 match context, and libm_pcre2 does not
+* provide any way to create such callouts, or return handles for them.  This could
+* be done in another plugin and is left as an exercise for the reader.
+* 
+* @param count Parameter count provided from the M API
+* @param mcontext_str String handle for a pcre2 match context
+* @param callout_function_str String handle for callout function
+* @param callout_data_str String handle for callout data
+*
+* @return 0 in all cases
+*/
+gtm_long_t mpcre2_set_callout(int count, gtm_char_t *mcontext_str, gtm_char_t *callout_function_str, gtm_char_t *callout_data_str) {
+
+	pcre2_match_context *mc;
+	void *callout_function;
+	void *callout_data;
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	callout_function = (void *) pointer_decode(callout_function_str);
+
+	callout_data = (void *) pointer_decode(callout_data_str);
+
+	return pcre2_set_callout(mc, callout_function, callout_data);
+}
+
+#if 0
+ /* Not supported in Ubuntu version yet */
+/**
+ * @brief Wrap the pcre2_set_substitute_callout() function
+ *
+ * This function is unlikely to be useful in the libm_pcre2 context, as it sets up a callout function
+ * for PCRE2 to call after each substitution made by pcre2_substitute(), and libm_pcre2 provides no way
+ * to create such functions or return handles to them though this could be done in another plugin.
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle for a pcre2 match context
+ * @param callout_function_str String handle for the callout function
+ * @param callout_data_str String handle for the callout data
+ * 
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_substitute_callout(int count, gtm_char_t *mcontext_str, gtm_char_t *callout_function_str, gtm_char_t *callout_data_str) {
+
+	pcre2_match_context *mc;
+	void *callout_function;
+	void *callout_data;
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+
+	callout_function = (void *) pointer_decode(callout_function_str);
+
+	callout_data = (void *) pointer_decode(callout_data_str);
+
+	return pcre2_set_substitute_callout(mc, callout_function, callout_data);
+}
+#endif
+
+/**
+ * @brief Wrap the pcre2_set_offset_limit() function
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle for a pcre2 match context
+ * @param value Value for the offest limit field in the match context
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_offset_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+
+	pcre2_match_context *mc;
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_set_offset_limit(mc, value);
+}
+
+
+/**
+ * @brief Wrap the pcre2_set_heap_limit() function
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle for a pcre2 match context
+ * @param value Value for the backtracking heap limit field in the match context
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_heap_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+
+	pcre2_match_context *mc;
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_set_heap_limit(mc, value);
+}
+
+
+/**
+ * @brief Wrap the pcre2_set_match_limit() function
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle for a pcre2 match context
+ * @param value Value for the match limit field in the match context
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_match_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+
+	pcre2_match_context *mc;
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_set_match_limit(mc, value);
+}
+
+
+/**
+ * @brief Wrap the pcre2_set_depth_limit() function
+ *
+ * @param count Parameter count from the M API
+ * @param mcontext_str String handle for a pcre2 depth context
+ * @param value Value for the backtracking depth limit field in the match context
+ *
+ * @return 0 in all cases
+ */
+gtm_long_t mpcre2_set_depth_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+
+	pcre2_match_context *mc;
+
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_set_depth_limit(mc, value);
+}
+
+/**
+ * @brief Wrap the pcre2_substring_copy_byname() function
+ *
+ * This function will return one of several PCRE2 errors on failure:
+ *	PCRE2_ERROR_NOSUBSTRING   there are no groups of that name
+ *	PCRE2_ERROR_UNAVAILABLE    the ovector was too small for that group
+ *	PCRE2_ERROR_UNSET         the group did not participate in the match
+ *	PCRE2_ERROR_NOMEMORY      the buffer is not big enough
+ *
+ * In C, these symbolic error codes can be used in code.  This is not the case
+ * in M, and libm_pcre2 does not currently provide a translation.  The current
+ * numerical values for these are, respectively: -49, -54, -55 & -48
+ *
+ * Note that this function does not need the "bufflen" parameter from the C
+ * version because the gtm_string_t type handles that.
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param name Name of the captured substring
+ * @param buffer to receive the string
+ *
+ * @return 0 on success non-zero on error
+ */
+gtm_long_t mpcre2_substring_copy_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_string_t *buffer) {
+
+	pcre2_match_data *md;
+	int res;
+	PCRE2_SIZE len;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	len = (PCRE2_SIZE) buffer->length;
+	res = pcre2_substring_copy_byname(md, (PCRE2_SPTR) name, (PCRE2_UCHAR *) buffer->address, &len);
+	buffer->length = len;
+
+	return res;
+}
+
+
+/**
+ * @brief Wrap the pcre2_substring_copy_bynumber() function
+ *
+ * This function will return one of several PCRE2 errors on failure:
+ *	PCRE2_ERROR_NOSUBSTRING   there are no groups of that number
+ *	PCRE2_ERROR_UNAVAILABLE    the ovector was too small for that group
+ *	PCRE2_ERROR_UNSET         the group did not participate in the match
+ *	PCRE2_ERROR_NOMEMORY      the buffer is not big enough
+ *
+ * In C, these symbolic error codes can be used in code.  This is not the case
+ * in M, and libm_pcre2 does not currently provide a translation.  The current
+ * numerical values for these are, respectively: -49, -54, -55 & -48
+ *
+ * Note that this function does not need the "bufflen" parameter from the C
+ * version because the gtm_string_t type handles that.
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param number number of the captured substring
+ * @param buffer to receive the string
+ *
+ * @return 0 on success non-zero on error
+ */
+gtm_long_t mpcre2_substring_copy_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_string_t *buffer) {
+
+	pcre2_match_data *md;
+	int res;
+	PCRE2_SIZE len;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	len = (PCRE2_SIZE) buffer->length;
+	res = pcre2_substring_copy_bynumber(md, (uint32_t) number, (PCRE2_UCHAR *) buffer->address, &len);
+	buffer->length = len;
+
+	return res;
+}
+
+/**
+ * @brief Return a captured substring, found by name, as the value of the call
+ *
+ * Like pcre2substringcopybyname, but the substring is returned from a buffer
+ * kept between calls, so GT.M does not set up a 1M output string for it.
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param name Name of the captured substring
+ * @param rcptr Set to 0 on success or a PCRE2 error code as for pcre2substringcopybyname
+ *
+ * @return The substring, or an empty string on error
+ */
+gtm_string_t *mpcre2_substring_value_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_long_t *rcptr) {
+
+	static gtm_string_t ret;
+	pcre2_match_data *md;
+	PCRE2_SIZE len;
+	int res;
+
+	ret.address = NULL;
+	ret.length = 0;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		*rcptr = PCRE2_ERROR_NULL;
+		return &ret;
+	}
+
+	res = pcre2_substring_length_byname(md, (PCRE2_SPTR) name, &len);
+	if (res == 0) {
+		len++;
+		if (!value_buffer_reserve(&value_buffer, len)) {
+			res = PCRE2_ERROR_NOMEMORY;
+		} else {
+			res = pcre2_substring_copy_byname(md, (PCRE2_SPTR) name, (PCRE2_UCHAR *) value_buffer.buf, &len);
+		}
+	}
+
+	*rcptr = res;
+	if (res == 0) {
+		ret.address = value_buffer.buf;
+		ret.length = len;
+	}
+
+	return &ret;
+}
+
+/**
+ * @brief Return a captured substring, found by number, as the value of the call
+ *
+ * Like pcre2substringcopybynumber, but the substring is returned from a buffer
+ * kept between calls, so GT.M does not set up a 1M output string for it.
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param number Number of the captured substring
+ * @param rcptr Set to 0 on success or a PCRE2 error code as for pcre2substringcopybynumber
+ *
+ * @return The substring, or an empty string on error
+ */
+gtm_string_t *mpcre2_substring_value_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_long_t *rcptr) {
+
+	static gtm_string_t ret;
+	pcre2_match_data *md;
+	PCRE2_SIZE len;
+	int res;
+
+	ret.address = NULL;
+	ret.length = 0;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		*rcptr = PCRE2_ERROR_NULL;
+		return &ret;
+	}
+
+	res = pcre2_substring_length_bynumber(md, (uint32_t) number, &len);
+	if (res == 0) {
+		len++;
+		if (!value_buffer_reserve(&value_buffer, len)) {
+			res = PCRE2_ERROR_NOMEMORY;
+		} else {
+			res = pcre2_substring_copy_bynumber(md, (uint32_t) number, (PCRE2_UCHAR *) value_buffer.buf, &len);
+		}
+	}
+
+	*rcptr = res;
+	if (res == 0) {
+		ret.address = value_buffer.buf;
+		ret.length = len;
+	}
+
+	return &ret;
+}
+
+/**
+ * @brief Wrap the void pcre2_substring_free() function
+ *
+ * Free memory allocated by pcre2_substring_get_byname() or
+ * pcre2_substring_get_bynumber().
+ *
+ * @param count Parameter count from the M API
+ * @param buffer_str String handle for the buffer to free
+ *
+ * @return None
+ */
+void mpcre2_substring_free(int count, gtm_char_t *buffer_str) {
+
+	PCRE2_UCHAR *buffer;
+
+	buffer = (PCRE2_UCHAR *) pointer_decode(buffer_str);
+
+	pcre2_substring_free(buffer);
+}
+
+/**
+ * @brief Wrap the pcre2_substring_get_byname() function
+ *
+ * It is not clear that this function has any utility in an M environment.
+ * It is only useful with the helper function mpcre2_get_mstring_from_buf().
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param name Name of the capture group
+ * @param bufferptr_str Where to store the pointer to the allocated buffer
+ * @param bufflen Where to store the length of the allocated buffer
+ *
+ * @return 0 on success non-zero on error
+ */
+int mpcre2_substring_get_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_string_t *bufferptr_str, gtm_long_t *bufflen) {
+	
+	pcre2_match_data *md;
+	PCRE2_UCHAR *bufferptr;
+	PCRE2_SIZE len;
+	int res;
+	static char buf[80];
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = pcre2_substring_get_byname(md, (PCRE2_SPTR) name, &bufferptr, &len);
+
+	pointer_encode(bufferptr, buf, sizeof(buf));
+
+	strncpy(bufferptr_str->address, buf, strlen(buf));
+
+	bufferptr_str->length = strlen(buf);
+
+	*bufflen = len;
+
+	return res;
+}
+
+
+/**
+ * @brief Wrap the pcre2_substring_get_bynumber() function
+ *
+ * It is not clear that this function has any utility in an M environment.
+ * It is only useful with the helper function mpcre2_get_mstring_from_buf().
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param number Number of the capture group
+ * @param bufferptr_str Where to store the pointer to the allocated buffer
+ * @param bufflen Where to store the length of the allocated buffer
+ *
+ * @return 0 on success non-zero on error
+ */
+int mpcre2_substring_get_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_string_t *bufferptr_str, gtm_long_t *bufflen) {
+	
+	pcre2_match_data *md;
+	PCRE2_UCHAR *bufferptr;
+	PCRE2_SIZE len;
+	int res;
+	static char buf[80];
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = pcre2_substring_get_bynumber(md, (uint32_t) number, &bufferptr, &len);
+
+	pointer_encode(bufferptr, buf, sizeof(buf));
+
+	strncpy(bufferptr_str->address, buf, strlen(buf));
+
+	bufferptr_str->length = strlen(buf);
+
+	*bufflen = len;
+
+	return res;
+}
+
+/**
+ * @brief Wrap the pcre2_substring_length_byname() function
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param name Name of the capture group
+ * @param length Where to store the length of the capture
+ *
+ * @return 0 on success non-zero otherwise
+ */
+ gtm_long_t mpcre2_substring_length_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_long_t *length) {
+
+	pcre2_match_data *md;
+	PCRE2_SIZE len;
+	int res;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = pcre2_substring_length_byname(md, (PCRE2_SPTR) name, &len);
+
+	*length = len;
+
+	return res;
+
+ }
+
+/**
+ * @brief Wrap the pcre2_substring_length_bynumber() function
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param number Number of the capture group
+ * @param length Where to store the length of the capture
+ *
+ * @return 0 on success non-zero otherwise
+ */
+ gtm_long_t mpcre2_substring_length_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_long_t *length) {
+
+	pcre2_match_data *md;
+	PCRE2_SIZE len;
+	int res;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = pcre2_substring_length_bynumber(md, number, &len);
+
+	*length = len;
+
+	return res;
+
+ }
+
+/*
+ * The pcre2_substring_nametable_scan() function would go here.
+ *
+ * However, it seems neither straight-forward nor obviously desirable
+ * to provide this function in M, so for now it is not wrapped.
+ */
+
+/**
+ * @brief Wrap the pcre2_substring_number_from_name() function
+ *
+ * @param count Parameter count from the M API
+ * @param code_str String handle for a pcre2 compiled regular expression
+ * @param name name of the capture group to map
+ *
+ * @return Either the number of the parentheses for the name or a negative error number (see pcre2.h)
+ */
+gtm_long_t mpcre2_substring_number_from_name(int count, gtm_char_t *code_str, gtm_char_t *name) {
+
+	pcre2_code *code;
+
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	return pcre2_substring_number_from_name(code, (PCRE2_SPTR) name);
+}
+
+/**
+ * @brief Wrap the pcre2_substring_list_free() function.
+ *
+ * @param count Parameter count from the M API
+ * @param list_str String handle for a pcre2 substring list
+ *
+ * @return None
+ *
+ */
+void mpcre2_substring_list_free(int count, gtm_char_t *list_str) {
+	
+	PCRE2_SPTR *list;
+
+	list = (PCRE2_SPTR *) pointer_decode(list_str);
+
+	pcre2_substring_list_free(list);
+}
+
+/**
+ * @brief Wrap the pcre2_substring_list_get() function.
+ *
+ * To be useful from M, this function must be used in conjunction with the
+ * utilitiy functions pcre2_get_substring_list_count() & pcre2_get_mstring_from_substring_list().
+ *
+ * On the C side, we can pass NULL for lengthsptr.  We don't accept that here.
+ *
+ * @param count Parameter count from the M API
+ * @param match_data_str String handle for pcre2 match data
+ * @param listptr_str Variable to hold the handle for the substring list
+ * @param lengthsptr_str Variable to hold the handle for the lengths list
+ *
+ * @return 0 on success, non-zero on error
+ */
+gtm_long_t mpcre2_substring_list_get(int count, gtm_char_t *match_data_str, gtm_string_t *listptr_str, gtm_string_t *lengthsptr_str) {
+
+	pcre2_match_data *md;
+	PCRE2_UCHAR **listptr;
+	PCRE2_SIZE *lengthsptr;
+	char buf[80];
+	int res;
+
+	md = (pcre2_match_data *) handle_decode(match_data_str, HANDLE_MATCH_DATA);
+	if (!md) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	res = pcre2_substring_list_get(md, &listptr, &lengthsptr);
+
+	pointer_encode(listptr, buf, sizeof(buf));
+	strncpy(listptr_str->address, buf, strlen(buf));
+	listptr_str->length = strlen(buf);
+
+	pointer_encode(lengthsptr, buf, sizeof(buf));
+	strncpy(lengthsptr_str->address, buf, strlen(buf));
+	lengthsptr_str->length = strlen(buf);
+
+	return res;
+}
+
+
+/**
+ * @brief Wrap the pcre2_substitute() function
+ *
+ * @param count M API argument count
+ * @param code_str String handle for a compiled PCRE2 regular expression
+ * @param subject The string in which to make the substitution
+ * @param startoffset The byte offset in the subject to start checking for substitutions
+ * @param options_str Match options as in pcre2_match()
+ * @param match_data_str String handle for match data as in pcre2_match(), or "AUTO" for the pattern's own match data
+ * @param mcontext_str String handle for Pcre2 match context, "0", or a profile name
+ * @param replacement The string to substitute for matched text
+ * @param outputbuffer Where to put the copy of the subject with the replacement(s)
+ * @param outputlengthptr Where to store the length of the copy of the subject with replacement(s)
+ *
+ * @return The number of substitutions or < 0 on error
+ *
+ */
+gtm_long_t mpcre2_substitute(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
+	gtm_char_t *mcontext_str, gtm_string_t *replacement, gtm_string_t *outputbuffer, gtm_long_t *outputlengthptr) {
+
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	uint32_t options;
+	PCRE2_SIZE outputlength;
+	int res;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
+	code_count_match(code, state);
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
+
+	/*
+	 * If match_data_str is "0" set it to NULL
+	 */
+	if (strcmp(match_data_str, "0") == 0) {
+		match_data = NULL;
+	} else {
+		match_data = match_data_decode(match_data_str, code, state);
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
+	}
+
+	do {
+		jit_stacks.used = 0;
+		outputlength = outputbuffer->length;
+		res = pcre2_substitute(code, (PCRE2_SPTR)subject->address, (PCRE2_SIZE) subject->length,
+			(PCRE2_SIZE) startoffset, options, match_data, mc, (PCRE2_SPTR) replacement->address,
+			(PCRE2_SIZE) replacement->length, (PCRE2_UCHAR *) outputbuffer->address, &outputlength);
+	} while (jit_stack_retry(res));
+
+	if (res < 0) {
+		outputbuffer->length = 0;
+	} else {
+		outputbuffer->length = outputlength;
+	}
+
+	*outputlengthptr = (gtm_long_t) outputlength;
+
+	return res ;
+}
+
+/**
+ * @brief Wrap pcre2_substitute(), returning the output as the value of the call
+ *
+ * pcre2substitute needs an output string parameter, which GT.M sets up at its
+ * full 1M size on every call.  This returns the output from a buffer kept between
+ * calls instead, so a short result costs only its own length.  The buffer is
+ * grown to the size PCRE2_SUBSTITUTE_OVERFLOW_LENGTH reports when it is too small.
+ * Output longer than an M string can hold gives PCRE2_ERROR_NOMEMORY; use
+ * pcre2substitutelarge for that.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str The compiled pattern from pcre2compile
+ * @param subject The subject string
+ * @param startoffset Offset in the subject at which to start matching
+ * @param options_str Match and substitute options
+ * @param match_data_str Match data handle, "AUTO" for the pattern's own, or "0"
+ * @param mcontext_str Match context handle or profile name
+ * @param replacement The replacement string
+ * @param rcptr Set to the number of substitutions made, or a PCRE2 error code
+ *
+ * @return The output, or an empty string on error
+ */
+gtm_string_t *mpcre2_substitute_value(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
+	gtm_char_t *mcontext_str, gtm_string_t *replacement, gtm_long_t *rcptr) {
+
+	static gtm_string_t ret;
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	PCRE2_SIZE size;
+	PCRE2_SIZE outputlength;
+	uint32_t options;
+	int res;
+
+	ret.address = NULL;
+	ret.length = 0;
+	*rcptr = PCRE2_ERROR_NULL;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return &ret;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		*rcptr = -1;
+		return &ret;
+	}
+	options |= PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+
+	if (strcmp(match_data_str, "0") == 0) {
+		match_data = NULL;
+	} else {
+		match_data = match_data_decode(match_data_str, code, state);
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		*rcptr = PCRE2_ERROR_NULL;
+		return &ret;
+	}
+
+	size = subject->length + replacement->length + 1;
+	for (;;) {
+		if (!value_buffer_reserve(&value_buffer, size)) {
+			*rcptr = PCRE2_ERROR_NOMEMORY;
+			return &ret;
+		}
+		size = value_buffer.size;
+
+		code_count_match(code, state);
+		do {
+			jit_stacks.used = 0;
+			outputlength = size;
+			res = pcre2_substitute(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+				(PCRE2_SIZE) startoffset, options, match_data, mc, (PCRE2_SPTR) replacement->address,
+				(PCRE2_SIZE) replacement->length, (PCRE2_UCHAR *) value_buffer.buf, &outputlength);
+		} while (jit_stack_retry(res));
+
+		/*
+		 * On overflow outputlength is the size needed, including the terminating zero
+		 */
+		if (res != PCRE2_ERROR_NOMEMORY || outputlength <= size || outputlength > MPCRE2_VALUE_MAX + 1) {
+			break;
+		}
+		size = outputlength;
+	}
+
+	/*
+	 * The buffer may have grown past what M can take back for an earlier call
+	 */
+	if (res >= 0 && outputlength > MPCRE2_VALUE_MAX) {
+		res = PCRE2_ERROR_NOMEMORY;
+	}
+
+	*rcptr = res;
+	if (res >= 0) {
+		ret.address = value_buffer.buf;
+		ret.length = outputlength;
+	}
+
+	return &ret;
+}
+
+/**
+ * This type is the output of pcre2substitutelarge, held in C until M reads it
+ */
+typedef struct substitute_result {
+	PCRE2_UCHAR *buf;		///< The substituted string
+	PCRE2_SIZE len;			///< Length of buf in bytes
+	PCRE2_SIZE pos;			///< Where the next pcre2resultread starts
+	int utf;			///< Non-zero if pieces must end on whole UTF-8 characters
+} substitute_result_t;
+
+/**
+ * @brief Wrap pcre2_substitute() for output of any length
+ *
+ * The output is built in a C buffer instead of an M string, so it is not bound by
+ * the 1M limit on string parameters.  The replacement is first run into a buffer
+ * sized from the subject; if that is too short, PCRE2_SUBSTITUTE_OVERFLOW_LENGTH
+ * gives the exact length needed and it is run once more into a buffer of that size.
+ * The result is read in pieces with pcre2resultread and freed with pcre2resultfree.
+ *
+ * @param count Count of parameters from the M API
+ * @param code_str The compiled pattern from pcre2compile
+ * @param subject The subject string
+ * @param startoffset Offset in the subject at which to start matching
+ * @param options_str Match and substitute options
+ * @param match_data_str Match data handle, "AUTO" for the pattern's own, or "0"
+ * @param mcontext_str Match context handle or profile name
+ * @param replacement The replacement string
+ * @param rcptr Set to the number of substitutions made, or a PCRE2 error code
+ * @param lengthptr Set to the length of the output in bytes
+ *
+ * @return A result handle, or "0" if the substitution failed
+ */
+gtm_char_t *mpcre2_substitute_large(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
+	gtm_char_t *mcontext_str, gtm_string_t *replacement, gtm_long_t *rcptr, gtm_ulong_t *lengthptr) {
+
+	static char buf[80];
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	substitute_result_t *sr;
+	PCRE2_UCHAR *out;
+	PCRE2_SIZE size;
+	PCRE2_SIZE outputlength;
+	uint32_t options;
+	int res;
+
+	*rcptr = PCRE2_ERROR_NULL;
+	*lengthptr = 0;
+
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return "0";
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		*rcptr = -1;
+		return "0";
+	}
+	options |= PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+
+	if (strcmp(match_data_str, "0") == 0) {
+		match_data = NULL;
+	} else {
+		match_data = match_data_decode(match_data_str, code, state);
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		*rcptr = PCRE2_ERROR_NULL;
+		return "0";
+	}
+
+	/*
+	 * Most replacements leave the subject about the same size, so start there
+	 * with some room to spare
+	 */
+	size = subject->length + subject->length / 4 + 256;
+	out = NULL;
+	for (;;) {
+		out = m_pcre2_malloc(size, NULL);
+		if (!out) {
+			*rcptr = PCRE2_ERROR_NOMEMORY;
+			return "0";
+		}
+
+		code_count_match(code, state);
+		do {
+			jit_stacks.used = 0;
+			outputlength = size;
+			res = pcre2_substitute(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+				(PCRE2_SIZE) startoffset, options, match_data, mc, (PCRE2_SPTR) replacement->address,
+				(PCRE2_SIZE) replacement->length, out, &outputlength);
+		} while (jit_stack_retry(res));
+
+		/*
+		 * On overflow outputlength is the size needed, including the terminating zero
+		 */
+		if (res != PCRE2_ERROR_NOMEMORY || outputlength <= size) {
+			break;
+		}
+		m_pcre2_free(out, NULL);
+		size = outputlength;
+	}
+
+	*rcptr = res;
+	if (res < 0) {
+		m_pcre2_free(out, NULL);
+		return "0";
+	}
+
+	sr = m_pcre2_malloc(sizeof(substitute_result_t), NULL);
+	if (!sr) {
+		m_pcre2_free(out, NULL);
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return "0";
+	}
+	sr->buf = out;
+	sr->len = outputlength;
+	sr->pos = 0;
+	sr->utf = state ? state->utf : 0;
+
+	if (handle_encode(sr, HANDLE_SUBSTITUTE_RESULT, buf, sizeof(buf)) < 0) {
+		m_pcre2_free(out, NULL);
+		m_pcre2_free(sr, NULL);
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return "0";
+	}
+
+	*lengthptr = (gtm_ulong_t) outputlength;
+
+	return buf;
+}
+
+/**
+ * @brief Read the next piece of a result from pcre2substitutelarge
+ *
+ * Each call returns up to size bytes following the previous piece, so a loop
+ * which stops when nothing is returned reads the whole result.  For a UTF
+ * pattern a piece never ends part way through a character.
+ *
+ * @param count Count of parameters from the M API
+ * @param result_str A result handle
+ * @param size Most bytes to return, or 0 for as many as the output string holds
+ * @param piece Set to the next piece of the result
+ *
+ * @return Length of the piece, 0 once the result has all been read, or a PCRE2 error code
+ */
+gtm_long_t mpcre2_result_read(int count, gtm_char_t *result_str, gtm_long_t size, gtm_string_t *piece) {
+
+	substitute_result_t *sr;
+	PCRE2_SIZE n;
+
+	sr = (substitute_result_t *) handle_decode(result_str, HANDLE_SUBSTITUTE_RESULT);
+	if (!sr) {
+		piece->length = 0;
+		return PCRE2_ERROR_NULL;
+	}
+
+	if (size < 0) {
+		fprintf(stderr, "Invalid piece size %ld\n", (long) size);
+		piece->length = 0;
+		return -1;
+	}
+
+	n = sr->len - sr->pos;
+	if (n > piece->length) {
+		n = piece->length;
+	}
+	if (size > 0 && n > (PCRE2_SIZE) size) {
+		n = size;
+	}
+	if (sr->utf && sr->pos + n < sr->len) {
+		n = utf8_whole_length((char *) sr->buf + sr->pos, n);
+		if (n == 0) {
+			fprintf(stderr, "Piece size %ld is too small for a UTF-8 character\n", (long) size);
+			piece->length = 0;
+			return -1;
+		}
+	}
+
+	memcpy(piece->address, sr->buf + sr->pos, n);
+	piece->length = n;
+	sr->pos += n;
+
+	return (gtm_long_t) n;
+}
+
+/**
+ * @brief Free a result from pcre2substitutelarge
  *
- * @return 0 in all cases
+ * @param count Count of parameters from the M API
+ * @param result_str A result handle
  *
+ * @return None
  */
- gtm_long_t mpcre2_set_compile_recursion_guard(int count, gtm_char_t *ccontext_str, gtm_char_t *guard_function_str, gtm_char_t *user_data_str) {
+void mpcre2_result_free(int count, gtm_char_t *result_str) {
 
-	pcre2_compile_context *cc;
-	void *guard_function;
-	void *user_data;
+	substitute_result_t *sr;
 
-	cc = (pcre2_compile_context *) pointer_decode(ccontext_str);
+	sr = (substitute_result_t *) handle_release(result_str, HANDLE_SUBSTITUTE_RESULT);
+	if (!sr) {
+		return;
+	}
 
-	guard_function = (void *) pointer_decode(guard_function_str);
+	m_pcre2_free(sr->buf, NULL);
+	m_pcre2_free(sr, NULL);
+}
 
-	user_data = (void *) pointer_decode(user_data_str);
+/**
+ * @brief Initial number of hash buckets in a substitute map
+ */
+#define MPCRE2_MAP_BUCKETS 64
 
-	return pcre2_set_compile_recursion_guard(cc, guard_function, user_data);
- }
+/**
+ * This type is one key and its value in a substitute map
+ */
+typedef struct map_entry {
+	struct map_entry *next;		///< Next entry in the same hash bucket
+	uint32_t hash;			///< Hash of the key
+	size_t klen;			///< Length of the key
+	size_t vlen;			///< Length of the value
+	char data[];			///< The key followed by the value
+} map_entry_t;
 
 /**
- * @brief Wrap the pcre2_match_context_create() function
+ * This type is a key to value table for pcre2substitutemap
+ */
+typedef struct subst_map {
+	map_entry_t **buckets;		///< Hash buckets, a power of 2 of them
+	size_t n_buckets;		///< Number of buckets
+	size_t n_entries;		///< Number of keys in the table
+} subst_map_t;
+
+/**
+ * @brief Hash a substitute map key
  *
- * @param count Parameter count from the M API
- * @param gcontext_str String handle to a pcre2 general context
+ * This is a 32 bit FNV-1a hash, as for the compiled pattern cache.
  *
- * @return String handle to a pcre2 match context
+ * @param key The key
+ * @param len Length of the key
+ *
+ * @return The hash value
  */
-gtm_char_t *mpcre2_match_context_create(int count, gtm_char_t *gcontext_str) {
+static uint32_t map_hash(const char *key, size_t len) {
 
-	pcre2_general_context *gc;
-	pcre2_match_context *mc;
-	static char buf[80];
+	uint32_t h = 2166136261u;
+	size_t i;
 
-	gc = get_general_context(gcontext_str);
+	for (i = 0; i < len; i++) {
+		h = (h ^ (unsigned char) key[i]) * 16777619u;
+	}
 
-	mc = pcre2_match_context_create(gc);
+	return h;
+}
+
+/**
+ * @brief Look up a key in a substitute map
+ *
+ * @param map The map
+ * @param key The key
+ * @param len Length of the key
+ *
+ * @return The entry, or NULL if the key is not in the map
+ */
+static map_entry_t *map_find(subst_map_t *map, const char *key, size_t len) {
 
-	pointer_encode(mc, buf, sizeof(buf));
+	map_entry_t *entry;
+	uint32_t h;
 
-	return buf;
+	h = map_hash(key, len);
+	for (entry = map->buckets[h & (map->n_buckets - 1)]; entry; entry = entry->next) {
+		if (entry->hash == h && entry->klen == len && memcmp(entry->data, key, len) == 0) {
+			return entry;
+		}
+	}
+
+	return NULL;
 }
 
 /**
- * @brief Wrap the pcre2_match_context_copy() function
+ * @brief Double the number of hash buckets in a substitute map
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle to a pcre2 match context
+ * @param map The map
  *
- * @return String handle for a new pcre2 match context
+ * @return 0 on success, PCRE2_ERROR_NOMEMORY if the new buckets could not be allocated
  */
-gtm_char_t *mpcre2_match_context_copy(int count, gtm_char_t *mcontext_str) {
+static int map_grow(subst_map_t *map) {
 
-	pcre2_match_context *mc;
-	pcre2_match_context *mc2;
-	static char buf[80];
+	map_entry_t **nb;
+	map_entry_t *entry;
+	map_entry_t *next;
+	size_t n = map->n_buckets * 2;
+	size_t i;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	nb = m_pcre2_malloc(n * sizeof(map_entry_t *), NULL);
+	if (!nb) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	memset(nb, 0, n * sizeof(map_entry_t *));
 
-	mc2 = pcre2_match_context_copy(mc);
+	for (i = 0; i < map->n_buckets; i++) {
+		for (entry = map->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry->next = nb[entry->hash & (n - 1)];
+			nb[entry->hash & (n - 1)] = entry;
+		}
+	}
 
-	pointer_encode(mc2, buf, sizeof(buf));
+	m_pcre2_free(map->buckets, NULL);
+	map->buckets = nb;
+	map->n_buckets = n;
 
-	return buf;
+	return 0;
 }
 
 /**
- * @brief Wrap the pcre2_match_context_free() function
+ * @brief Add a key to a substitute map, replacing any value it already has
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle for a pcre2 match context
+ * @param map The map
+ * @param key The key
+ * @param klen Length of the key
+ * @param value The value
+ * @param vlen Length of the value
  *
- * @return None
- */ 
- void mpcre2_match_context_free(int count, gtm_char_t* mcontext_str) {
+ * @return 0 on success, PCRE2_ERROR_NOMEMORY on failure
+ */
+static int map_put(subst_map_t *map, const char *key, size_t klen, const char *value, size_t vlen) {
 
-	pcre2_match_context *mc;
+	map_entry_t *entry;
+	map_entry_t **pp;
+	uint32_t h;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	if (map->n_entries >= map->n_buckets && map_grow(map) < 0) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
 
- 	pcre2_match_context_free(mc);
- }
+	entry = m_pcre2_malloc(sizeof(map_entry_t) + klen + vlen, NULL);
+	if (!entry) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	h = map_hash(key, klen);
+	entry->hash = h;
+	entry->klen = klen;
+	entry->vlen = vlen;
+	memcpy(entry->data, key, klen);
+	memcpy(entry->data + klen, value, vlen);
 
-/**
-* @brief Wrap the pcre2_set_callout() function
-*
-* This function is unlikely to be of use in the libm_pcre2 context as it
-* sets up a callout function in a pcre2 match context, and libm_pcre2 does not
-* provide any way to create such callouts, or return handles for them.  This could
-* be done in another plugin and is left as an exercise for the reader.
-* 
-* @param count Parameter count provided from the M API
-* @param mcontext_str String handle for a pcre2 match context
-* @param callout_function_str String handle for callout function
-* @param callout_data_str String handle for callout data
-*
-* @return 0 in all cases
-*/
-gtm_long_t mpcre2_set_callout(int count, gtm_char_t *mcontext_str, gtm_char_t *callout_function_str, gtm_char_t *callout_data_str) {
+	/*
+	 * A later entry for the same key replaces the earlier one
+	 */
+	for (pp = &map->buckets[h & (map->n_buckets - 1)]; *pp; pp = &(*pp)->next) {
+		if ((*pp)->hash == h && (*pp)->klen == klen && memcmp((*pp)->data, key, klen) == 0) {
+			entry->next = (*pp)->next;
+			m_pcre2_free(*pp, NULL);
+			*pp = entry;
+			return 0;
+		}
+	}
 
-	pcre2_match_context *mc;
-	void *callout_function;
-	void *callout_data;
+	entry->next = map->buckets[h & (map->n_buckets - 1)];
+	map->buckets[h & (map->n_buckets - 1)] = entry;
+	map->n_entries++;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	return 0;
+}
 
-	callout_function = (void *) pointer_decode(callout_function_str);
+/**
+ * @brief Free a substitute map and all its entries
+ *
+ * @param map The map
+ *
+ * @return None
+ */
+static void map_free(subst_map_t *map) {
 
-	callout_data = (void *) pointer_decode(callout_data_str);
+	map_entry_t *entry;
+	map_entry_t *next;
+	size_t i;
 
-	return pcre2_set_callout(mc, callout_function, callout_data);
+	for (i = 0; i < map->n_buckets; i++) {
+		for (entry = map->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			m_pcre2_free(entry, NULL);
+		}
+	}
+	m_pcre2_free(map->buckets, NULL);
+	m_pcre2_free(map, NULL);
 }
 
-#if 0
- /* Not supported in Ubuntu version yet */
 /**
- * @brief Wrap the pcre2_set_substitute_callout() function
+ * @brief Work out the separators for substitute map entries
  *
- * This function is unlikely to be useful in the libm_pcre2 context, as it sets up a callout function
- * for PCRE2 to call after each substitution made by pcre2_substitute(), and libm_pcre2 provides no way
- * to create such functions or return handles to them though this could be done in another plugin.
+ * @param delims "0" for the defaults (newline between entries, "=" between key and
+ *	value), or two characters: the entry separator and the key separator
+ * @param entsep Set to the entry separator
+ * @param keysep Set to the key separator
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle for a pcre2 match context
- * @param callout_function_str String handle for the callout function
- * @param callout_data_str String handle for the callout data
- * 
- * @return 0 in all cases
+ * @return 0 on success, -1 if delims is not valid
  */
-gtm_long_t mpcre2_set_substitute_callout(int count, gtm_char_t *mcontext_str, gtm_char_t *callout_function_str, gtm_char_t *callout_data_str) {
-
-	pcre2_match_context *mc;
-	void *callout_function;
-	void *callout_data;
-
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+static int map_delims(const char *delims, char *entsep, char *keysep) {
 
-	callout_function = (void *) pointer_decode(callout_function_str);
+	if (strcmp(delims, "0") == 0) {
+		*entsep = '\n';
+		*keysep = '=';
+		return 0;
+	}
 
-	callout_data = (void *) pointer_decode(callout_data_str);
+	if (strlen(delims) != 2 || delims[0] == delims[1]) {
+		fprintf(stderr, "Invalid map delimiters \"%s\"\n", delims);
+		return -1;
+	}
+	*entsep = delims[0];
+	*keysep = delims[1];
 
-	return pcre2_set_substitute_callout(mc, callout_function, callout_data);
+	return 0;
 }
-#endif
 
 /**
- * @brief Wrap the pcre2_set_offset_limit() function
+ * @brief Add the entries in a buffer to a substitute map
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle for a pcre2 match context
- * @param value Value for the offest limit field in the match context
+ * Entries are separated by entsep and empty entries are ignored.  Each entry is
+ * split at the first keysep, so a value may contain keysep but a key cannot.  When
+ * entries are separated by newlines a carriage return before the newline is dropped.
  *
- * @return 0 in all cases
+ * @param map The map
+ * @param buf The entries
+ * @param len Length of buf
+ * @param entsep The entry separator
+ * @param keysep The key separator
+ *
+ * @return 0 on success, -1 for an entry without keysep, or PCRE2_ERROR_NOMEMORY
  */
-gtm_long_t mpcre2_set_offset_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+static int map_add_entries(subst_map_t *map, const char *buf, size_t len, char entsep, char keysep) {
 
-	pcre2_match_context *mc;
+	const char *cpt = buf;
+	const char *end = buf + len;
+	const char *eol;
+	const char *sep;
+	size_t elen;
+	int res;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	while (cpt < end) {
+		eol = memchr(cpt, entsep, end - cpt);
+		if (!eol) {
+			eol = end;
+		}
+		elen = eol - cpt;
+		if (entsep == '\n' && elen > 0 && cpt[elen - 1] == '\r') {
+			elen--;
+		}
 
-	return pcre2_set_offset_limit(mc, value);
-}
+		if (elen > 0) {
+			sep = memchr(cpt, keysep, elen);
+			if (!sep) {
+				fprintf(stderr, "Map entry without a key separator: %.*s\n", (int) elen, cpt);
+				return -1;
+			}
+			res = map_put(map, cpt, sep - cpt, sep + 1, elen - (sep - cpt) - 1);
+			if (res < 0) {
+				return res;
+			}
+		}
+
+		cpt = eol + 1;
+	}
 
+	return 0;
+}
 
 /**
- * @brief Wrap the pcre2_set_heap_limit() function
+ * @brief Create a key to value table for pcre2substitutemap
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle for a pcre2 match context
- * @param value Value for the backtracking heap limit field in the match context
+ * The table lives in C until it is freed with pcre2mapfree, so it is built once
+ * and used for any number of substitutions.  Further entries can be added with
+ * pcre2mapadd and pcre2mapload.
  *
- * @return 0 in all cases
+ * @param count Count of parameters from the M API
+ * @param entries Entries such as "key=value", separated by newlines (see delims)
+ * @param delims "0" for the default separators, or two characters giving the
+ *	separator between entries and the separator between a key and its value
+ *
+ * @return A map handle, or "0" on error
  */
-gtm_long_t mpcre2_set_heap_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+gtm_char_t *mpcre2_map_create(int count, gtm_string_t *entries, gtm_char_t *delims) {
 
-	pcre2_match_context *mc;
+	static char buf[80];
+	subst_map_t *map;
+	char entsep;
+	char keysep;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	if (map_delims(delims, &entsep, &keysep) < 0) {
+		return "0";
+	}
 
-	return pcre2_set_heap_limit(mc, value);
-}
+	map = m_pcre2_malloc(sizeof(subst_map_t), NULL);
+	if (!map) {
+		return "0";
+	}
+	map->buckets = m_pcre2_malloc(MPCRE2_MAP_BUCKETS * sizeof(map_entry_t *), NULL);
+	if (!map->buckets) {
+		m_pcre2_free(map, NULL);
+		return "0";
+	}
+	memset(map->buckets, 0, MPCRE2_MAP_BUCKETS * sizeof(map_entry_t *));
+	map->n_buckets = MPCRE2_MAP_BUCKETS;
+	map->n_entries = 0;
+
+	if (map_add_entries(map, entries->address, entries->length, entsep, keysep) < 0 ||
+		handle_encode(map, HANDLE_SUBSTITUTE_MAP, buf, sizeof(buf)) < 0) {
+		map_free(map);
+		return "0";
+	}
 
+	return buf;
+}
 
 /**
- * @brief Wrap the pcre2_set_match_limit() function
+ * @brief Add entries to a substitute map
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle for a pcre2 match context
- * @param value Value for the match limit field in the match context
+ * An M string can only hold 1M, so a large table is built with several calls.
+ * A key which is already in the map gets the new value.
  *
- * @return 0 in all cases
+ * @param count Count of parameters from the M API
+ * @param map_str A map handle
+ * @param entries Entries, as for pcre2mapcreate
+ * @param delims Separators, as for pcre2mapcreate
+ *
+ * @return The number of keys in the map, or < 0 on error
  */
-gtm_long_t mpcre2_set_match_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+gtm_long_t mpcre2_map_add(int count, gtm_char_t *map_str, gtm_string_t *entries, gtm_char_t *delims) {
 
-	pcre2_match_context *mc;
+	subst_map_t *map;
+	char entsep;
+	char keysep;
+	int res;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	map = (subst_map_t *) handle_decode(map_str, HANDLE_SUBSTITUTE_MAP);
+	if (!map) {
+		return PCRE2_ERROR_NULL;
+	}
 
-	return pcre2_set_match_limit(mc, value);
-}
+	if (map_delims(delims, &entsep, &keysep) < 0) {
+		return -1;
+	}
+
+	res = map_add_entries(map, entries->address, entries->length, entsep, keysep);
+	if (res < 0) {
+		return res;
+	}
 
+	return (gtm_long_t) map->n_entries;
+}
 
 /**
- * @brief Wrap the pcre2_set_depth_limit() function
+ * @brief Add the entries in a file to a substitute map
  *
- * @param count Parameter count from the M API
- * @param mcontext_str String handle for a pcre2 depth context
- * @param value Value for the backtracking depth limit field in the match context
+ * The file holds entries in the same form as for pcre2mapcreate, normally one
+ * "key=value" per line.  Entries before a bad one are kept.
  *
- * @return 0 in all cases
+ * @param count Count of parameters from the M API
+ * @param map_str A map handle
+ * @param path Path of the file
+ * @param delims Separators, as for pcre2mapcreate
+ *
+ * @return The number of keys in the map, or < 0 on error
  */
-gtm_long_t mpcre2_set_depth_limit(int count,gtm_char_t *mcontext_str, gtm_long_t value) {
+gtm_long_t mpcre2_map_load(int count, gtm_char_t *map_str, gtm_char_t *path, gtm_char_t *delims) {
+
+	subst_map_t *map;
+	FILE *fp;
+	char *buf;
+	long size;
+	char entsep;
+	char keysep;
+	int res;
 
-	pcre2_match_context *mc;
+	map = (subst_map_t *) handle_decode(map_str, HANDLE_SUBSTITUTE_MAP);
+	if (!map) {
+		return PCRE2_ERROR_NULL;
+	}
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	if (map_delims(delims, &entsep, &keysep) < 0) {
+		return -1;
+	}
 
-	return pcre2_set_depth_limit(mc, value);
+	fp = fopen(path, "rb");
+	if (!fp) {
+		fprintf(stderr, "Unable to open map file %s\n", path);
+		return -1;
+	}
+
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+		fprintf(stderr, "Unable to read map file %s\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	buf = m_pcre2_malloc(size ? size : 1, NULL);
+	if (!buf) {
+		fclose(fp);
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	if (fread(buf, 1, size, fp) != (size_t) size) {
+		fprintf(stderr, "Unable to read map file %s\n", path);
+		m_pcre2_free(buf, NULL);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	res = map_add_entries(map, buf, size, entsep, keysep);
+	m_pcre2_free(buf, NULL);
+	if (res < 0) {
+		return res;
+	}
+
+	return (gtm_long_t) map->n_entries;
 }
 
 /**
- * @brief Wrap the pcre2_substring_copy_byname() function
- *
- * This function will return one of several PCRE2 errors on failure:
- *	PCRE2_ERROR_NOSUBSTRING   there are no groups of that name
- *	PCRE2_ERROR_UNAVAILABLE    the ovector was too small for that group
- *	PCRE2_ERROR_UNSET         the group did not participate in the match
- *	PCRE2_ERROR_NOMEMORY      the buffer is not big enough
- *
- * In C, these symbolic error codes can be used in code.  This is not the case
- * in M, and libm_pcre2 does not currently provide a translation.  The current
- * numerical values for these are, respectively: -49, -54, -55 & -48
- *
- * Note that this function does not need the "bufflen" parameter from the C
- * version because the gtm_string_t type handles that.
+ * @brief Free a substitute map
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param name Name of the captured substring
- * @param buffer to receive the string
+ * @param count Count of parameters from the M API
+ * @param map_str A map handle
  *
- * @return 0 on success non-zero on error
+ * @return None
  */
-gtm_long_t mpcre2_substring_copy_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_string_t *buffer) {
-
-	pcre2_match_data *md;
-	int res;
-	PCRE2_SIZE len;
+void mpcre2_map_free(int count, gtm_char_t *map_str) {
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	subst_map_t *map;
 
-	len = (PCRE2_SIZE) buffer->length;
-	res = pcre2_substring_copy_byname(md, (PCRE2_SPTR) name, (PCRE2_UCHAR *) buffer->address, &len);
-	buffer->length = len;
+	map = (subst_map_t *) handle_release(map_str, HANDLE_SUBSTITUTE_MAP);
+	if (!map) {
+		return;
+	}
 
-	return res;
+	map_free(map);
 }
 
-
 /**
- * @brief Wrap the pcre2_substring_copy_bynumber() function
+ * @brief Append bytes to the value buffer
  *
- * This function will return one of several PCRE2 errors on failure:
- *	PCRE2_ERROR_NOSUBSTRING   there are no groups of that number
- *	PCRE2_ERROR_UNAVAILABLE    the ovector was too small for that group
- *	PCRE2_ERROR_UNSET         the group did not participate in the match
- *	PCRE2_ERROR_NOMEMORY      the buffer is not big enough
+ * @param used Bytes of the buffer in use, updated
+ * @param bytes The bytes to append
+ * @param len Number of bytes
  *
- * In C, these symbolic error codes can be used in code.  This is not the case
- * in M, and libm_pcre2 does not currently provide a translation.  The current
- * numerical values for these are, respectively: -49, -54, -55 & -48
+ * @return 0 on success, PCRE2_ERROR_NOMEMORY if the result would be too long for M
+ */
+static int value_buffer_append(size_t *used, const char *bytes, size_t len) {
+
+	if (*used + len > MPCRE2_VALUE_MAX || !value_buffer_reserve(&value_buffer, *used + len)) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	memcpy(value_buffer.buf + *used, bytes, len);
+	*used += len;
+
+	return 0;
+}
+
+/**
+ * @brief Replace every match of a pattern through a substitute map
  *
- * Note that this function does not need the "bufflen" parameter from the C
- * version because the gtm_string_t type handles that.
+ * Each match is looked up in the map by the text of the given capture group
+ * (0 for the whole match).  If the key is in the map, the whole match is replaced
+ * by its value; otherwise, or if the group is unset, the match is left as it was.
+ * Matches are found as by pcre2matchall, so the whole subject is done in one call
+ * with no replacement strings to interpret.
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param number number of the captured substring
- * @param buffer to receive the string
+ * The output is returned as the value of the call, as for pcre2substitutevalue.
  *
- * @return 0 on success non-zero on error
+ * @param count Count of parameters from the M API
+ * @param code_str The compiled pattern from pcre2compile
+ * @param subject The subject string
+ * @param startoffset Offset in the subject at which to start matching
+ * @param options_str Match options
+ * @param mcontext_str Match context handle or profile name
+ * @param map_str A map handle from pcre2mapcreate
+ * @param group Number of the capture group to use as the key
+ * @param rcptr Set to the number of replacements made, or a PCRE2 error code
+ *
+ * @return The output, or an empty string on error
  */
-gtm_long_t mpcre2_substring_copy_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_string_t *buffer) {
+gtm_string_t *mpcre2_substitute_map(int count, gtm_char_t *code_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *mcontext_str,
+	gtm_char_t *map_str, gtm_long_t group, gtm_long_t *rcptr) {
 
-	pcre2_match_data *md;
+	static gtm_string_t ret;
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	subst_map_t *map;
+	map_entry_t *entry;
+	global_match_t gm;
+	PCRE2_SIZE *ov;
+	PCRE2_SIZE last = 0;
+	uint32_t options;
+	size_t used = 0;
+	gtm_long_t replaced = 0;
 	int res;
-	PCRE2_SIZE len;
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	ret.address = NULL;
+	ret.length = 0;
+	*rcptr = PCRE2_ERROR_NULL;
 
-	len = (PCRE2_SIZE) buffer->length;
-	res = pcre2_substring_copy_bynumber(md, (uint32_t) number, (PCRE2_UCHAR *) buffer->address, &len);
-	buffer->length = len;
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return &ret;
+	}
 
-	return res;
+	map = (subst_map_t *) handle_decode(map_str, HANDLE_SUBSTITUTE_MAP);
+	if (!map) {
+		return &ret;
+	}
+
+	if (startoffset < 0 || (PCRE2_SIZE) startoffset > (PCRE2_SIZE) subject->length) {
+		*rcptr = PCRE2_ERROR_BADOFFSET;
+		return &ret;
+	}
+
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		*rcptr = -1;
+		return &ret;
+	}
+
+	match_data = code_match_data(code, state);
+	if (!match_data) {
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return &ret;
+	}
+	if (group < 0 || (uint32_t) group >= pcre2_get_ovector_count(match_data)) {
+		*rcptr = PCRE2_ERROR_NOSUBSTRING;
+		return &ret;
+	}
+
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		*rcptr = PCRE2_ERROR_NULL;
+		return &ret;
+	}
+
+	global_match_init(&gm, code, state, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+		(PCRE2_SIZE) startoffset, options, match_data, mc);
+
+	for (;;) {
+		res = global_match_next(&gm);
+		if (res == PCRE2_ERROR_NOMATCH) {
+			break;
+		} else if (res < 0) {
+			*rcptr = res;
+			return &ret;
+		}
+
+		ov = pcre2_get_ovector_pointer(match_data);
+
+		/*
+		 * \K in a lookahead can leave a match ending before it starts
+		 */
+		if (ov[1] < ov[0]) {
+			*rcptr = PCRE2_ERROR_BADSUBSPATTERN;
+			return &ret;
+		}
+
+		if (ov[2 * group] == PCRE2_UNSET) {
+			continue;
+		}
+		entry = map_find(map, subject->address + ov[2 * group], ov[2 * group + 1] - ov[2 * group]);
+		if (!entry) {
+			continue;
+		}
+
+		if (value_buffer_append(&used, subject->address + last, ov[0] - last) < 0 ||
+			value_buffer_append(&used, entry->data + entry->klen, entry->vlen) < 0) {
+			*rcptr = PCRE2_ERROR_NOMEMORY;
+			return &ret;
+		}
+		last = ov[1];
+		replaced++;
+	}
+
+	if (value_buffer_append(&used, subject->address + last, subject->length - last) < 0) {
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return &ret;
+	}
+
+	*rcptr = replaced;
+	ret.address = value_buffer.buf;
+	ret.length = used;
+
+	return &ret;
 }
 
 /**
- * @brief Wrap the void pcre2_substring_free() function
+ * This type is one pattern and replacement in a rule set
+ */
+typedef struct rule {
+	char code_str[24];		///< Handle of the compiled pattern, decoded on each use
+	char *replacement;		///< The replacement string
+	size_t rlen;			///< Length of the replacement
+	uint32_t options;		///< Match and substitute options
+	unsigned long hits;		///< Substitutions made by this rule so far
+} rule_t;
+
+/**
+ * This type is an ordered list of substitutions applied together by pcre2rulesetapply
+ */
+typedef struct rule_set {
+	rule_t *rules;			///< The rules, in the order they are applied
+	size_t n_rules;			///< Number of rules
+	size_t cap;			///< Number of rules there is room for
+	value_buffer_t bufs[2];		///< Output of each rule goes to the buffer the input is not in
+} rule_set_t;
+
+/**
+ * @brief Create an empty rule set
  *
- * Free memory allocated by pcre2_substring_get_byname() or
- * pcre2_substring_get_bynumber().
+ * A rule set applies a list of substitutions to a subject, one after another,
+ * in a single call.  Rules are added with pcre2rulesetadd.
  *
- * @param count Parameter count from the M API
- * @param buffer_str String handle for the buffer to free
+ * @param count Count of parameters from the M API
  *
- * @return None
+ * @return A rule set handle, or "0" on error
  */
-void mpcre2_substring_free(int count, gtm_char_t *buffer_str) {
+gtm_char_t *mpcre2_rule_set_create(int count) {
 
-	PCRE2_UCHAR *buffer;
+	static char buf[80];
+	rule_set_t *rs;
 
-	buffer = (PCRE2_UCHAR *) pointer_decode(buffer_str);
+	rs = m_pcre2_malloc(sizeof(rule_set_t), NULL);
+	if (!rs) {
+		return "0";
+	}
+	memset(rs, 0, sizeof(rule_set_t));
 
-	pcre2_substring_free(buffer);
+	if (handle_encode(rs, HANDLE_RULE_SET, buf, sizeof(buf)) < 0) {
+		m_pcre2_free(rs, NULL);
+		return "0";
+	}
+
+	return buf;
 }
 
 /**
- * @brief Wrap the pcre2_substring_get_byname() function
+ * @brief Add a rule to the end of a rule set
  *
- * It is not clear that this function has any utility in an M environment.
- * It is only useful with the helper function mpcre2_get_mstring_from_buf().
+ * The pattern is held by its handle, so it must not be freed while the rule set
+ * is in use.  Options are as for pcre2substitute; PCRE2_SUBSTITUTE_GLOBAL is needed
+ * for the rule to replace more than the first match.
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param name Name of the capture group
- * @param bufferptr_str Where to store the pointer to the allocated buffer
- * @param bufflen Where to store the length of the allocated buffer
+ * @param count Count of parameters from the M API
+ * @param rule_set_str A rule set handle
+ * @param code_str The compiled pattern from pcre2compile
+ * @param replacement The replacement string
+ * @param options_str Match and substitute options
  *
- * @return 0 on success non-zero on error
+ * @return The number of the new rule, counting from 1, or < 0 on error
  */
-int mpcre2_substring_get_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_string_t *bufferptr_str, gtm_long_t *bufflen) {
-	
-	pcre2_match_data *md;
-	PCRE2_UCHAR *bufferptr;
-	PCRE2_SIZE len;
-	int res;
-	static char buf[80];
+gtm_long_t mpcre2_rule_set_add(int count, gtm_char_t *rule_set_str, gtm_char_t *code_str,
+	gtm_string_t *replacement, gtm_char_t *options_str) {
+
+	rule_set_t *rs;
+	rule_t *rule;
+	rule_t *nrules;
+	code_state_t *state;
+	size_t cap;
+	uint32_t options;
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	rs = (rule_set_t *) handle_decode(rule_set_str, HANDLE_RULE_SET);
+	if (!rs) {
+		return PCRE2_ERROR_NULL;
+	}
 
-	res = pcre2_substring_get_byname(md, (PCRE2_SPTR) name, &bufferptr, &len);
+	if (!code_decode(code_str, &state)) {
+		return PCRE2_ERROR_NULL;
+	}
 
-	pointer_encode(bufferptr, buf, sizeof(buf));
+	if (strlen(code_str) >= sizeof(rs->rules->code_str)) {
+		fprintf(stderr, "Handle too long\n");
+		return -1;
+	}
 
-	strncpy(bufferptr_str->address, buf, strlen(buf));
+	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
+		return -1;
+	}
 
-	bufferptr_str->length = strlen(buf);
+	if (rs->n_rules == rs->cap) {
+		cap = rs->cap ? rs->cap * 2 : 16;
+		nrules = m_pcre2_malloc(cap * sizeof(rule_t), NULL);
+		if (!nrules) {
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		if (rs->rules) {
+			memcpy(nrules, rs->rules, rs->n_rules * sizeof(rule_t));
+			m_pcre2_free(rs->rules, NULL);
+		}
+		rs->rules = nrules;
+		rs->cap = cap;
+	}
 
-	*bufflen = len;
+	rule = &rs->rules[rs->n_rules];
+	rule->replacement = m_pcre2_malloc(replacement->length ? replacement->length : 1, NULL);
+	if (!rule->replacement) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	memcpy(rule->replacement, replacement->address, replacement->length);
+	rule->rlen = replacement->length;
+	strcpy(rule->code_str, code_str);
+	rule->options = options | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+	rule->hits = 0;
 
-	return res;
+	return (gtm_long_t) ++rs->n_rules;
 }
 
-
 /**
- * @brief Wrap the pcre2_substring_get_bynumber() function
+ * @brief Apply every rule in a rule set to a subject
  *
- * It is not clear that this function has any utility in an M environment.
- * It is only useful with the helper function mpcre2_get_mstring_from_buf().
+ * Each rule is run with pcre2_substitute() on the output of the one before.  The
+ * intermediate strings never go back to M: each rule writes to whichever of the
+ * rule set's two buffers does not hold its input, and a rule which makes no
+ * substitutions leaves its input where it is.  The buffers are kept and grown as
+ * needed, so after the first few records nothing is allocated.
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param number Number of the capture group
- * @param bufferptr_str Where to store the pointer to the allocated buffer
- * @param bufflen Where to store the length of the allocated buffer
+ * Only the final string is returned, as the value of the call.  It stays valid
+ * until the rule set is next applied or freed.
  *
- * @return 0 on success non-zero on error
+ * @param count Count of parameters from the M API
+ * @param rule_set_str A rule set handle
+ * @param subject The subject string
+ * @param mcontext_str Match context handle or profile name, used for every rule
+ * @param rcptr Set to the total number of substitutions made, or a PCRE2 error code
+ *
+ * @return The final string, or an empty string on error
  */
-int mpcre2_substring_get_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_string_t *bufferptr_str, gtm_long_t *bufflen) {
-	
-	pcre2_match_data *md;
-	PCRE2_UCHAR *bufferptr;
-	PCRE2_SIZE len;
+gtm_string_t *mpcre2_rule_set_apply(int count, gtm_char_t *rule_set_str, gtm_string_t *subject,
+	gtm_char_t *mcontext_str, gtm_long_t *rcptr) {
+
+	static gtm_string_t ret;
+	rule_set_t *rs;
+	rule_t *rule;
+	pcre2_code *code;
+	code_state_t *state;
+	pcre2_match_data *match_data;
+	pcre2_match_context *mc;
+	value_buffer_t *out;
+	PCRE2_SPTR src;
+	PCRE2_SIZE srclen;
+	PCRE2_SIZE outputlength;
+	int cur = -1;			/* buffer holding the input, -1 for the subject */
+	gtm_long_t total = 0;
+	size_t i;
 	int res;
-	static char buf[80];
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	ret.address = NULL;
+	ret.length = 0;
+	*rcptr = PCRE2_ERROR_NULL;
 
-	res = pcre2_substring_get_bynumber(md, (uint32_t) number, &bufferptr, &len);
+	rs = (rule_set_t *) handle_decode(rule_set_str, HANDLE_RULE_SET);
+	if (!rs) {
+		return &ret;
+	}
 
-	pointer_encode(bufferptr, buf, sizeof(buf));
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return &ret;
+	}
 
-	strncpy(bufferptr_str->address, buf, strlen(buf));
+	src = (PCRE2_SPTR) subject->address;
+	srclen = subject->length;
 
-	bufferptr_str->length = strlen(buf);
+	for (i = 0; i < rs->n_rules; i++) {
+		rule = &rs->rules[i];
 
-	*bufflen = len;
+		code = code_decode(rule->code_str, &state);
+		if (!code) {
+			return &ret;
+		}
+		match_data = code_match_data(code, state);
+		if (!match_data) {
+			*rcptr = PCRE2_ERROR_NOMEMORY;
+			return &ret;
+		}
 
-	return res;
+		out = &rs->bufs[cur == 0 ? 1 : 0];
+		if (!value_buffer_reserve(out, srclen + rule->rlen + 1)) {
+			*rcptr = PCRE2_ERROR_NOMEMORY;
+			return &ret;
+		}
+
+		for (;;) {
+			code_count_match(code, state);
+			do {
+				jit_stacks.used = 0;
+				outputlength = out->size;
+				res = pcre2_substitute(code, src, srclen, 0, rule->options, match_data, mc,
+					(PCRE2_SPTR) rule->replacement, rule->rlen, (PCRE2_UCHAR *) out->buf,
+					&outputlength);
+			} while (jit_stack_retry(res));
+
+			/*
+			 * On overflow outputlength is the size needed, including the terminating zero
+			 */
+			if (res != PCRE2_ERROR_NOMEMORY || outputlength <= out->size ||
+				outputlength > MPCRE2_VALUE_MAX + 1) {
+				break;
+			}
+			if (!value_buffer_reserve(out, outputlength)) {
+				break;
+			}
+		}
+
+		/*
+		 * A buffer grown by an earlier call may hold more than M can take back
+		 */
+		if (res > 0 && outputlength > MPCRE2_VALUE_MAX) {
+			res = PCRE2_ERROR_NOMEMORY;
+		}
+		if (res < 0) {
+			*rcptr = res;
+			return &ret;
+		}
+
+		if (res > 0) {
+			rule->hits += res;
+			total += res;
+			cur = out == &rs->bufs[0] ? 0 : 1;
+			src = (PCRE2_SPTR) out->buf;
+			srclen = outputlength;
+		}
+	}
+
+	*rcptr = total;
+	ret.address = (char *) src;
+	ret.length = srclen;
+
+	return &ret;
 }
 
 /**
- * @brief Wrap the pcre2_substring_length_byname() function
+ * @brief Get the number of substitutions a rule has made
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param name Name of the capture group
- * @param length Where to store the length of the capture
+ * Counts build up over every pcre2rulesetapply call until the rule set is freed.
  *
- * @return 0 on success non-zero otherwise
+ * @param count Count of parameters from the M API
+ * @param rule_set_str A rule set handle
+ * @param number Number of the rule, counting from 1, or 0 for all the rules together
+ *
+ * @return The number of substitutions, or < 0 on error
  */
- gtm_long_t mpcre2_substring_length_byname(int count, gtm_char_t *match_data_str, gtm_char_t *name, gtm_long_t *length) {
+gtm_long_t mpcre2_rule_set_hits(int count, gtm_char_t *rule_set_str, gtm_long_t number) {
 
-	pcre2_match_data *md;
-	PCRE2_SIZE len;
-	int res;
+	rule_set_t *rs;
+	gtm_long_t hits = 0;
+	size_t i;
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	rs = (rule_set_t *) handle_decode(rule_set_str, HANDLE_RULE_SET);
+	if (!rs) {
+		return PCRE2_ERROR_NULL;
+	}
 
-	res = pcre2_substring_length_byname(md, (PCRE2_SPTR) name, &len);
+	if (number < 0 || (size_t) number > rs->n_rules) {
+		fprintf(stderr, "Invalid rule number %ld\n", (long) number);
+		return -1;
+	}
 
-	*length = len;
+	if (number > 0) {
+		return (gtm_long_t) rs->rules[number - 1].hits;
+	}
 
-	return res;
+	for (i = 0; i < rs->n_rules; i++) {
+		hits += rs->rules[i].hits;
+	}
 
- }
+	return hits;
+}
 
 /**
- * @brief Wrap the pcre2_substring_length_bynumber() function
+ * @brief Free a rule set
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param number Number of the capture group
- * @param length Where to store the length of the capture
+ * The patterns used by the rules are not freed.
  *
- * @return 0 on success non-zero otherwise
+ * @param count Count of parameters from the M API
+ * @param rule_set_str A rule set handle
+ *
+ * @return None
  */
- gtm_long_t mpcre2_substring_length_bynumber(int count, gtm_char_t *match_data_str, gtm_long_t number, gtm_long_t *length) {
+void mpcre2_rule_set_free(int count, gtm_char_t *rule_set_str) {
 
-	pcre2_match_data *md;
-	PCRE2_SIZE len;
-	int res;
+	rule_set_t *rs;
+	size_t i;
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	rs = (rule_set_t *) handle_release(rule_set_str, HANDLE_RULE_SET);
+	if (!rs) {
+		return;
+	}
 
-	res = pcre2_substring_length_bynumber(md, number, &len);
+	for (i = 0; i < rs->n_rules; i++) {
+		m_pcre2_free(rs->rules[i].replacement, NULL);
+	}
+	if (rs->rules) {
+		m_pcre2_free(rs->rules, NULL);
+	}
+	for (i = 0; i < 2; i++) {
+		if (rs->bufs[i].buf) {
+			m_pcre2_free(rs->bufs[i].buf, NULL);
+		}
+	}
+	m_pcre2_free(rs, NULL);
+}
 
-	*length = len;
+/**
+ * @brief Longest capture group name we look for, which is more than PCRE2 allows
+ */
+#define MPCRE2_NAME_MAX 255
 
-	return res;
+/**
+ * This type is one piece of a compiled replacement template
+ */
+typedef struct template_segment {
+	size_t offset;			///< Offset of literal text in the template's text
+	size_t len;			///< Length of literal text, 0 for a group reference
+	uint32_t n_groups;		///< Number of groups referred to (more than one for a duplicate name)
+	uint32_t *groups;		///< The groups, in name table order; the first one set is used
+} template_segment_t;
 
- }
+/**
+ * This type is a replacement string parsed once for pcre2templatesubstitute
+ */
+typedef struct repl_template {
+	char code_str[24];		///< Handle of the pattern the template was compiled for
+	char *text;			///< Literal text of the replacement, with escapes resolved
+	template_segment_t *segs;	///< The pieces of the replacement, in order
+	size_t n_segs;			///< Number of pieces
+	int literal;			///< Non-zero if the replacement has no group references
+} repl_template_t;
 
-/*
- * The pcre2_substring_nametable_scan() function would go here.
+/**
+ * @brief Free a compiled replacement template
  *
- * However, it seems neither straight-forward nor obviously desirable
- * to provide this function in M, so for now it is not wrapped.
+ * @param rt The template
+ *
+ * @return None
  */
+static void repl_template_free(repl_template_t *rt) {
+
+	size_t i;
+
+	if (rt->segs) {
+		for (i = 0; i < rt->n_segs; i++) {
+			if (rt->segs[i].groups) {
+				m_pcre2_free(rt->segs[i].groups, NULL);
+			}
+		}
+		m_pcre2_free(rt->segs, NULL);
+	}
+	if (rt->text) {
+		m_pcre2_free(rt->text, NULL);
+	}
+	m_pcre2_free(rt, NULL);
+}
 
 /**
- * @brief Wrap the pcre2_substring_number_from_name() function
+ * @brief Add a reference to a group, by number or by name, to a template
  *
- * @param count Parameter count from the M API
- * @param code_str String handle for a pcre2 compiled regular expression
- * @param name name of the capture group to map
+ * @param rt The template
+ * @param code The pattern
+ * @param ref The group number or name
+ * @param len Length of ref
  *
- * @return Either the number of the parentheses for the name or a negative error number (see pcre2.h)
+ * @return 0 on success or a PCRE2 error code
  */
-gtm_long_t mpcre2_substring_number_from_name(int count, gtm_char_t *code_str, gtm_char_t *name) {
+static int repl_template_add_group(repl_template_t *rt, pcre2_code *code, const char *ref, size_t len) {
+
+	template_segment_t *seg = &rt->segs[rt->n_segs];
+	PCRE2_SPTR first;
+	PCRE2_SPTR last;
+	PCRE2_SPTR entry;
+	uint32_t capture_count = 0;
+	uint32_t entry_size = 0;
+	uint32_t number = 0;
+	char name[MPCRE2_NAME_MAX + 1];
+	size_t i;
+	int res;
 
-	pcre2_code *code;
+	seg->offset = 0;
+	seg->len = 0;
+
+	if (ref[0] >= '0' && ref[0] <= '9') {
+		for (i = 0; i < len; i++) {
+			number = number * 10 + (ref[i] - '0');
+			if (number > 65535) {
+				return PCRE2_ERROR_NOSUBSTRING;
+			}
+		}
+		pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+		if (number > capture_count) {
+			return PCRE2_ERROR_NOSUBSTRING;
+		}
 
-	code = (pcre2_code *) pointer_decode(code_str);
+		seg->groups = m_pcre2_malloc(sizeof(uint32_t), NULL);
+		if (!seg->groups) {
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		seg->groups[0] = number;
+		seg->n_groups = 1;
+		rt->n_segs++;
+		return 0;
+	}
 
-	return pcre2_substring_number_from_name(code, (PCRE2_SPTR) name);
+	if (len > MPCRE2_NAME_MAX) {
+		return PCRE2_ERROR_NOSUBSTRING;
+	}
+	memcpy(name, ref, len);
+	name[len] = '\0';
+
+	res = pcre2_substring_nametable_scan(code, (PCRE2_SPTR) name, &first, &last);
+	if (res < 0) {
+		return res;
+	}
+	pcre2_pattern_info(code, PCRE2_INFO_NAMEENTRYSIZE, &entry_size);
+
+	seg->n_groups = (uint32_t) ((last - first) / entry_size + 1);
+	seg->groups = m_pcre2_malloc(seg->n_groups * sizeof(uint32_t), NULL);
+	if (!seg->groups) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	for (i = 0, entry = first; entry <= last; i++, entry += entry_size) {
+		seg->groups[i] = (entry[0] << 8) | entry[1];
+	}
+	rt->n_segs++;
+
+	return 0;
 }
 
 /**
- * @brief Wrap the pcre2_substring_list_free() function.
+ * @brief Parse a replacement string into a template
  *
- * @param count Parameter count from the M API
- * @param list_str String handle for a pcre2 substring list
+ * This takes the same replacement syntax as pcre2_substitute() without
+ * PCRE2_SUBSTITUTE_EXTENDED: "$$" for a dollar sign, and "$n", "${n}", "$name"
+ * or "${name}" for a capture group.
  *
- * @return None
+ * @param rt The template, with code_str set and everything else zero
+ * @param code The pattern
+ * @param repl The replacement string
+ * @param len Length of the replacement
  *
+ * @return 0 on success, or a PCRE2 error code
  */
-void mpcre2_substring_list_free(int count, gtm_char_t *list_str) {
-	
-	PCRE2_SPTR *list;
+static int repl_template_parse(repl_template_t *rt, pcre2_code *code, const char *repl, size_t len) {
 
-	list = (PCRE2_SPTR *) pointer_decode(list_str);
+	size_t i = 0;
+	size_t start;
+	size_t tlen = 0;
+	size_t max_segs = 1;
+	int res;
 
-	pcre2_substring_list_free(list);
+	/*
+	 * There can't be more pieces than twice the number of dollar signs, plus one
+	 */
+	for (i = 0; i < len; i++) {
+		if (repl[i] == '$') {
+			max_segs += 2;
+		}
+	}
+
+	rt->text = m_pcre2_malloc(len ? len : 1, NULL);
+	rt->segs = m_pcre2_malloc(max_segs * sizeof(template_segment_t), NULL);
+	if (!rt->text || !rt->segs) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+	memset(rt->segs, 0, max_segs * sizeof(template_segment_t));
+
+	i = 0;
+	while (i < len) {
+		if (repl[i] != '$' || (i + 1 < len && repl[i + 1] == '$')) {
+			/*
+			 * Literal text, which runs on into the previous piece when that was literal too
+			 */
+			if (rt->n_segs == 0 || rt->segs[rt->n_segs - 1].len == 0) {
+				rt->segs[rt->n_segs].offset = tlen;
+				rt->segs[rt->n_segs].len = 0;
+				rt->segs[rt->n_segs].n_groups = 0;
+				rt->n_segs++;
+			}
+			rt->text[tlen++] = repl[i];
+			rt->segs[rt->n_segs - 1].len++;
+			i += repl[i] == '$' ? 2 : 1;
+			continue;
+		}
+
+		i++;
+		if (i < len && repl[i] == '{') {
+			/*
+			 * As in pcre2_substitute(), the reference is all digits or all name
+			 * characters, and anything else before the '}' is a missing brace
+			 */
+			start = ++i;
+			if (i < len && repl[i] >= '0' && repl[i] <= '9') {
+				while (i < len && repl[i] >= '0' && repl[i] <= '9') {
+					i++;
+				}
+			} else {
+				while (i < len && (isalnum((unsigned char) repl[i]) || repl[i] == '_')) {
+					i++;
+				}
+			}
+			if (i == start) {
+				return PCRE2_ERROR_BADREPLACEMENT;
+			}
+			if (i >= len || repl[i] != '}') {
+				return PCRE2_ERROR_REPMISSINGBRACE;
+			}
+			res = repl_template_add_group(rt, code, repl + start, i - start);
+			i++;
+		} else if (i < len && repl[i] >= '0' && repl[i] <= '9') {
+			start = i;
+			while (i < len && repl[i] >= '0' && repl[i] <= '9') {
+				i++;
+			}
+			res = repl_template_add_group(rt, code, repl + start, i - start);
+		} else if (i < len && (isalpha((unsigned char) repl[i]) || repl[i] == '_')) {
+			start = i;
+			while (i < len && (isalnum((unsigned char) repl[i]) || repl[i] == '_')) {
+				i++;
+			}
+			res = repl_template_add_group(rt, code, repl + start, i - start);
+		} else {
+			return PCRE2_ERROR_BADREPLACEMENT;
+		}
+
+		if (res < 0) {
+			return res;
+		}
+		rt->literal = 0;
+	}
+
+	return 0;
 }
 
 /**
- * @brief Wrap the pcre2_substring_list_get() function.
+ * @brief Compile a replacement string for a pattern
  *
- * To be useful from M, this function must be used in conjunction with the
- * utilitiy functions pcre2_get_substring_list_count() & pcre2_get_mstring_from_substring_list().
+ * pcre2_substitute() parses its replacement string again for every match.  A
+ * template is parsed once, into literal text and references to capture groups,
+ * with group names looked up in the pattern up front, so pcre2templatesubstitute
+ * only has to copy bytes.  The syntax is that of pcre2_substitute() without
+ * PCRE2_SUBSTITUTE_EXTENDED; a mark reference such as "$*MARK" is not supported.
  *
- * On the C side, we can pass NULL for lengthsptr.  We don't accept that here.
+ * The template belongs to the pattern it was compiled for, and can't be used
+ * once that pattern is freed.
  *
- * @param count Parameter count from the M API
- * @param match_data_str String handle for pcre2 match data
- * @param listptr_str Variable to hold the handle for the substring list
- * @param lengthsptr_str Variable to hold the handle for the lengths list
+ * @param count Count of parameters from the M API
+ * @param code_str The compiled pattern from pcre2compile
+ * @param replacement The replacement string
+ * @param rcptr Set to 0 on success, or a PCRE2 error code such as PCRE2_ERROR_NOSUBSTRING
  *
- * @return 0 on success, non-zero on error
+ * @return A template handle, or "0" on error
  */
-gtm_long_t mpcre2_substring_list_get(int count, gtm_char_t *match_data_str, gtm_string_t *listptr_str, gtm_string_t *lengthsptr_str) {
+gtm_char_t *mpcre2_template_compile(int count, gtm_char_t *code_str, gtm_string_t *replacement,
+	gtm_long_t *rcptr) {
 
-	pcre2_match_data *md;
-	PCRE2_UCHAR **listptr;
-	PCRE2_SIZE *lengthsptr;
-	char buf[80];
+	static char buf[80];
+	pcre2_code *code;
+	code_state_t *state;
+	repl_template_t *rt;
 	int res;
 
-	md = (pcre2_match_data *) pointer_decode(match_data_str);
+	*rcptr = PCRE2_ERROR_NULL;
 
-	res = pcre2_substring_list_get(md, &listptr, &lengthsptr);
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return "0";
+	}
 
-	pointer_encode(listptr, buf, sizeof(buf));
-	strncpy(listptr_str->address, buf, strlen(buf));
-	listptr_str->length = strlen(buf);
+	if (strlen(code_str) >= sizeof(rt->code_str)) {
+		fprintf(stderr, "Handle too long\n");
+		*rcptr = -1;
+		return "0";
+	}
 
-	pointer_encode(lengthsptr, buf, sizeof(buf));
-	strncpy(lengthsptr_str->address, buf, strlen(buf));
-	lengthsptr_str->length = strlen(buf);
+	rt = m_pcre2_malloc(sizeof(repl_template_t), NULL);
+	if (!rt) {
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return "0";
+	}
+	memset(rt, 0, sizeof(repl_template_t));
+	strcpy(rt->code_str, code_str);
+	rt->literal = 1;
 
-	return res;
-}
+	res = repl_template_parse(rt, code, replacement->address, replacement->length);
+	if (res < 0) {
+		*rcptr = res;
+		repl_template_free(rt);
+		return "0";
+	}
+
+	if (handle_encode(rt, HANDLE_TEMPLATE, buf, sizeof(buf)) < 0) {
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		repl_template_free(rt);
+		return "0";
+	}
+
+	*rcptr = 0;
 
+	return buf;
+}
 
 /**
- * @brief Wrap the pcre2_substitute() function
- *
- * @param count M API argument count
- * @param code_str String handle for a compiled PCRE2 regular expression
- * @param subject The string in which to make the substitution
- * @param startoffset The byte offset in the subject to start checking for substitutions
- * @param options_str Match options as in pcre2_match()
- * @param match_data_str String handle for match data as in pcre2_match()
- * @param mcontext_str String handle for Pcre2 match context
- * @param replacement The string to substitute for matched text
- * @param outputbuffer Where to put the copy of the subject with the replacement(s)
- * @param outputlengthptr Where to store the length of the copy of the subject with replacement(s)
+ * @brief Substitute using a compiled replacement template
  *
- * @return The number of substitutions or < 0 on error
+ * This does what pcre2substitutevalue does with the template's replacement
+ * string, but the output is built straight from the match's output vector.  A
+ * replacement with no group references is copied without looking at the output
+ * vector at all.  Of the substitute options only PCRE2_SUBSTITUTE_GLOBAL and
+ * PCRE2_SUBSTITUTE_UNSET_EMPTY apply; PCRE2_SUBSTITUTE_EXTENDED is refused.
  *
+ * @param count Count of parameters from the M API
+ * @param template_str A template handle from pcre2templatecompile
+ * @param subject The subject string
+ * @param startoffset Offset in the subject at which to start matching
+ * @param options_str Match and substitute options
+ * @param mcontext_str Match context handle or profile name
+ * @param rcptr Set to the number of substitutions made, or a PCRE2 error code
+ *
+ * @return The output, or an empty string on error
  */
-gtm_long_t mpcre2_substitute(int count, gtm_char_t *code_str, gtm_string_t *subject,
-	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *match_data_str,
-	gtm_char_t *mcontext_str, gtm_string_t *replacement, gtm_string_t *outputbuffer, gtm_long_t *outputlengthptr) {
+gtm_string_t *mpcre2_template_substitute(int count, gtm_char_t *template_str, gtm_string_t *subject,
+	gtm_long_t startoffset, gtm_char_t *options_str, gtm_char_t *mcontext_str, gtm_long_t *rcptr) {
 
+	static gtm_string_t ret;
+	repl_template_t *rt;
+	template_segment_t *seg;
 	pcre2_code *code;
+	code_state_t *state;
 	pcre2_match_data *match_data;
 	pcre2_match_context *mc;
+	global_match_t gm;
+	PCRE2_SIZE *ov;
+	PCRE2_SIZE last = 0;
 	uint32_t options;
-	PCRE2_SIZE outputlength;
-	int must_free;
+	uint32_t group;
+	uint32_t g;
+	size_t used = 0;
+	size_t i;
+	gtm_long_t substituted = 0;
+	int matched;
 	int res;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	ret.address = NULL;
+	ret.length = 0;
+	*rcptr = PCRE2_ERROR_NULL;
+
+	rt = (repl_template_t *) handle_decode(template_str, HANDLE_TEMPLATE);
+	if (!rt) {
+		return &ret;
+	}
+
+	code = code_decode(rt->code_str, &state);
+	if (!code) {
+		return &ret;
+	}
+
+	if (startoffset < 0 || (PCRE2_SIZE) startoffset > (PCRE2_SIZE) subject->length) {
+		*rcptr = PCRE2_ERROR_BADOFFSET;
+		return &ret;
+	}
 
 	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
-		return -1;
+		*rcptr = -1;
+		return &ret;
+	}
+	if (options & PCRE2_SUBSTITUTE_EXTENDED) {
+		fprintf(stderr, "PCRE2_SUBSTITUTE_EXTENDED is not supported with templates\n");
+		*rcptr = -1;
+		return &ret;
 	}
 
-	/*
-	 * If match_data_str is "0" set it to NULL
-	 */
-	if (strcmp(match_data_str, "0") == 0) {
-		match_data = NULL;
-	} else {
-		match_data = (pcre2_match_data *) pointer_decode(match_data_str);
+	match_data = code_match_data(code, state);
+	if (!match_data) {
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return &ret;
 	}
 
-	mc = get_match_context(mcontext_str, &must_free);
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		*rcptr = PCRE2_ERROR_NULL;
+		return &ret;
+	}
 
-	outputlength = outputbuffer->length;
-	res = pcre2_substitute(code, (PCRE2_SPTR)subject->address, (PCRE2_SIZE) subject->length,
-		(PCRE2_SIZE) startoffset, options, match_data, mc, (PCRE2_SPTR) replacement->address,
-		(PCRE2_SIZE) replacement->length, (PCRE2_UCHAR *) outputbuffer->address, &outputlength);
+	global_match_init(&gm, code, state, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+		(PCRE2_SIZE) startoffset, options & ~(PCRE2_SUBSTITUTE_GLOBAL | PCRE2_SUBSTITUTE_UNSET_EMPTY |
+		PCRE2_SUBSTITUTE_UNKNOWN_UNSET | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH), match_data, mc);
 
-	if (res < 0) {
-		outputbuffer->length = 0;
-	} else {
-		outputbuffer->length = outputlength;
+	do {
+		matched = global_match_next(&gm);
+		if (matched == PCRE2_ERROR_NOMATCH) {
+			break;
+		} else if (matched < 0) {
+			*rcptr = matched;
+			return &ret;
+		}
+
+		ov = pcre2_get_ovector_pointer(match_data);
+
+		/*
+		 * \K in a lookahead can leave a match ending before it starts
+		 */
+		if (ov[1] < ov[0]) {
+			*rcptr = PCRE2_ERROR_BADSUBSPATTERN;
+			return &ret;
+		}
+
+		if (value_buffer_append(&used, subject->address + last, ov[0] - last) < 0) {
+			*rcptr = PCRE2_ERROR_NOMEMORY;
+			return &ret;
+		}
+
+		if (rt->literal) {
+			if (rt->n_segs && value_buffer_append(&used, rt->text, rt->segs[0].len) < 0) {
+				*rcptr = PCRE2_ERROR_NOMEMORY;
+				return &ret;
+			}
+		} else {
+			for (i = 0, seg = rt->segs; i < rt->n_segs; i++, seg++) {
+				if (seg->len) {
+					res = value_buffer_append(&used, rt->text + seg->offset, seg->len);
+				} else {
+					/*
+					 * Groups after the highest one set are unset, whatever the
+					 * output vector still holds from an earlier match
+					 */
+					for (g = 0; g < seg->n_groups; g++) {
+						group = seg->groups[g];
+						if ((int) group < matched && ov[2 * group] != PCRE2_UNSET) {
+							break;
+						}
+					}
+					if (g < seg->n_groups) {
+						res = value_buffer_append(&used, subject->address + ov[2 * group],
+							ov[2 * group + 1] - ov[2 * group]);
+					} else if (options & PCRE2_SUBSTITUTE_UNSET_EMPTY) {
+						res = 0;
+					} else {
+						*rcptr = PCRE2_ERROR_UNSET;
+						return &ret;
+					}
+				}
+				if (res < 0) {
+					*rcptr = PCRE2_ERROR_NOMEMORY;
+					return &ret;
+				}
+			}
+		}
+
+		last = ov[1];
+		substituted++;
+	} while (options & PCRE2_SUBSTITUTE_GLOBAL);
+
+	if (value_buffer_append(&used, subject->address + last, subject->length - last) < 0) {
+		*rcptr = PCRE2_ERROR_NOMEMORY;
+		return &ret;
 	}
 
-	*outputlengthptr = (gtm_long_t) outputlength;
+	*rcptr = substituted;
+	ret.address = value_buffer.buf;
+	ret.length = used;
+
+	return &ret;
+}
+
+/**
+ * @brief Free a compiled replacement template
+ *
+ * @param count Count of parameters from the M API
+ * @param template_str A template handle
+ *
+ * @return None
+ */
+void mpcre2_template_free(int count, gtm_char_t *template_str) {
 
-	if (must_free) {
-		pcre2_match_context_free(mc);
+	repl_template_t *rt;
+
+	rt = (repl_template_t *) handle_release(template_str, HANDLE_TEMPLATE);
+	if (!rt) {
+		return;
 	}
 
-	return res ;
+	repl_template_free(rt);
 }
 
 /**
@@ -2004,15 +8802,48 @@ gtm_long_t mpcre2_substitute(int count, gtm_char_t *code_str, gtm_string_t *subj
 gtm_long_t mpcre2_jit_compile(int count, gtm_char_t *code_str, gtm_char_t *options_str) {
 
 	pcre2_code *code;
+	code_state_t *state;
 	uint32_t options;
+	int res;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	code = code_decode(code_str, &state);
 
 	if (parse_pcre2_options(jit_opts, n_jit_opts, "jit", options_str, &options) < 0) {
 		return -1;
 	}
 
-	return pcre2_jit_compile(code, options);
+	res = pcre2_jit_compile(code, options);
+
+	if (res == 0 && state) {
+		state->jit = 1;
+		state->jit_tried = 1;
+	}
+
+	return res;
+}
+
+/**
+ * @brief Set how many matches make a pattern hot enough to JIT compile
+ *
+ * Patterns matched with pcre2match or pcre2substitute are counted, and once a
+ * pattern reaches the threshold it is JIT compiled for complete matching.  A
+ * threshold of 0 turns this off, which is the default.  Passing a negative
+ * value leaves the threshold alone, which is a way to query it.
+ *
+ * @param count Parameter count from the M API
+ * @param threshold Number of matches before a pattern is JIT compiled
+ *
+ * @return The previous threshold
+ */
+gtm_long_t mpcre2_set_jit_threshold(int count, gtm_long_t threshold) {
+
+	gtm_long_t old = (gtm_long_t) jit_threshold;
+
+	if (threshold >= 0) {
+		jit_threshold = (unsigned long) threshold;
+	}
+
+	return old;
 }
 
 /**
@@ -2026,8 +8857,8 @@ gtm_long_t mpcre2_jit_compile(int count, gtm_char_t *code_str, gtm_char_t *optio
  * @param subject The string to search for matches
  * @param startoffset The byte offset at which to start the match search
  * @param options_str Pcre2 match options in string form
- * @param match_data_str A Pcre2 match data pointer in string format
- * @param mcontext_str A Pcre2 match context pointer in string format, or "0"
+ * @param match_data_str A Pcre2 match data pointer in string format, or "AUTO" for the pattern's own match data
+ * @param mcontext_str A Pcre2 match context pointer in string format, "0", or a profile name
  *
  * @return < 0 on error or no match, 0 vector offests too small, else one more than the highest numbered capturing pair that has been set
  */
@@ -2036,29 +8867,34 @@ gtm_long_t mpcre2_jit_match(int count, gtm_char_t *code_str, gtm_string_t *subje
 	gtm_char_t *mcontext_str) {
 
 	pcre2_code *code;
+	code_state_t *state;
 	pcre2_match_data *match_data;
 	pcre2_match_context *mc;
 	uint32_t options;
-	int must_free;
 	gtm_long_t res;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	code = code_decode(code_str, &state);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
 
 	if (parse_pcre2_options(match_opts, n_match_opts, "match", options_str, &options) < 0) {
 		return -1;
 	}
 
-	match_data = (pcre2_match_data *) pointer_decode(match_data_str);
-
-	mc = get_match_context(mcontext_str, &must_free);
-
-	res = pcre2_jit_match(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
-		(PCRE2_SIZE) startoffset, options, match_data, mc);
+	match_data = match_data_decode(match_data_str, code, state);
 
-	if (must_free) {
-		pcre2_match_context_free(mc);
+	mc = get_match_context(mcontext_str);
+	if (!mc && !handle_is_null(mcontext_str)) {
+		return PCRE2_ERROR_NULL;
 	}
 
+	do {
+		jit_stacks.used = 0;
+		res = pcre2_jit_match(code, (PCRE2_SPTR) subject->address, (PCRE2_SIZE) subject->length,
+			(PCRE2_SIZE) startoffset, options, match_data, mc);
+	} while (jit_stack_retry(res));
+
 	return res;
 }
 
@@ -2102,7 +8938,7 @@ gtm_char_t *mpcre2_jit_stack_create(int count, gtm_long_t startsize, gtm_long_t
 
 	sptr = pcre2_jit_stack_create((PCRE2_SIZE) startsize, (PCRE2_SIZE) maxsize, gc);
 
-	pointer_encode(sptr, buf, sizeof(buf));
+	handle_encode(sptr, HANDLE_JIT_STACK, buf, sizeof(buf));
 
 	return buf;
 }
@@ -2128,7 +8964,10 @@ void mpcre2_jit_stack_assign(int count, gtm_char_t *mcontext_str, gtm_char_t *ca
 	pcre2_jit_callback cbf;
 	void *cbd;
 
-	mc = (pcre2_match_context *) pointer_decode(mcontext_str);
+	mc = (pcre2_match_context *) handle_decode(mcontext_str, HANDLE_MATCH_CONTEXT);
+	if (!mc) {
+		return;
+	}
 
 	if (strcmp(callback_function_str, "NULL") == 0) {
 		cbf = NULL;
@@ -2136,8 +8975,14 @@ void mpcre2_jit_stack_assign(int count, gtm_char_t *mcontext_str, gtm_char_t *ca
 		cbf = (pcre2_jit_callback) pointer_decode(callback_function_str);
 	}
 
+	/*
+	 * Without a callback, the data is a JIT stack from pcre2jitstackcreate.
+	 * With one, it is whatever the callback's plugin wants it to be.
+	 */
 	if (strcmp(callback_data_str, "NULL") == 0) {
 		cbd = NULL;
+	} else if (!cbf) {
+		cbd = handle_decode(callback_data_str, HANDLE_JIT_STACK);
 	} else {
 		cbd = pointer_decode(callback_data_str);
 	}
@@ -2145,6 +8990,152 @@ void mpcre2_jit_stack_assign(int count, gtm_char_t *mcontext_str, gtm_char_t *ca
 	pcre2_jit_stack_assign(mc, cbf, cbd);
 }
 
+/**
+ * @brief Define (or redefine) a named match profile
+ *
+ * A profile is a match context set up once with limits and, optionally, its own
+ * JIT stack.  The profile name can then be passed anywhere a match context handle
+ * is expected, so limits can be set in one place, and no context is created per
+ * call.  Pass a negative value for any limit which should be left at the PCRE2
+ * default, and 0 for jitstacksize to use the shared JIT stack (see pcre2jitstackconfig).
+ *
+ * Redefining a profile replaces its context, so this should not be done while a
+ * match using it is running (for instance, from a callout).
+ *
+ * @param count Parameter count from the M API
+ * @param name The profile name
+ * @param matchlimit Value for pcre2_set_match_limit()
+ * @param depthlimit Value for pcre2_set_depth_limit()
+ * @param heaplimit Value for pcre2_set_heap_limit(), in kibibytes
+ * @param offsetlimit Value for pcre2_set_offset_limit()
+ * @param jitstacksize Maximum size of the profile's JIT stack in bytes
+ *
+ * @return 0 on success, < 0 on error
+ */
+gtm_long_t mpcre2_define_profile(int count, gtm_char_t *name, gtm_long_t matchlimit,
+	gtm_long_t depthlimit, gtm_long_t heaplimit, gtm_long_t offsetlimit, gtm_long_t jitstacksize) {
+
+	match_profile_t *prof;
+	pcre2_general_context *gc;
+	pcre2_match_context *mc;
+	pcre2_jit_stack *jit_stack = NULL;
+
+	if (name[0] == '\0' || strlen(name) >= sizeof(prof->name) || strcmp(name, "0") == 0 ||
+		strcmp(name, "NULL") == 0 || handle_lookup(name, HANDLE_MATCH_CONTEXT)) {
+		fprintf(stderr, "Invalid profile name %s\n", name);
+		return -1;
+	}
+
+	gc = get_general_context("0");
+
+	mc = pcre2_match_context_create(gc);
+	if (!mc) {
+		return PCRE2_ERROR_NOMEMORY;
+	}
+
+	if (matchlimit >= 0) {
+		pcre2_set_match_limit(mc, (uint32_t) matchlimit);
+	}
+	if (depthlimit >= 0) {
+		pcre2_set_depth_limit(mc, (uint32_t) depthlimit);
+	}
+	if (heaplimit >= 0) {
+		pcre2_set_heap_limit(mc, (uint32_t) heaplimit);
+	}
+	if (offsetlimit >= 0) {
+		pcre2_set_offset_limit(mc, (PCRE2_SIZE) offsetlimit);
+	}
+	if (jitstacksize > 0) {
+		jit_stack = pcre2_jit_stack_create(32 * 1024 < jitstacksize ? 32 * 1024 : jitstacksize,
+			(PCRE2_SIZE) jitstacksize, gc);
+		if (!jit_stack) {
+			pcre2_match_context_free(mc);
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		pcre2_jit_stack_assign(mc, NULL, jit_stack);
+	} else {
+		pcre2_jit_stack_assign(mc, jit_stack_callback, NULL);
+	}
+
+	prof = match_profile_find(name);
+	if (prof) {
+		pcre2_match_context_free(prof->mc);
+		pcre2_jit_stack_free(prof->jit_stack);
+	} else {
+		prof = m_pcre2_malloc(sizeof(match_profile_t), NULL);
+		if (!prof) {
+			pcre2_match_context_free(mc);
+			pcre2_jit_stack_free(jit_stack);
+			return PCRE2_ERROR_NOMEMORY;
+		}
+		strcpy(prof->name, name);
+		prof->next = match_profiles;
+		match_profiles = prof;
+	}
+
+	prof->mc = mc;
+	prof->jit_stack = jit_stack;
+	prof->match_limit = matchlimit;
+	prof->depth_limit = depthlimit;
+	prof->heap_limit = heaplimit;
+	prof->offset_limit = offsetlimit;
+	prof->jit_stack_size = jitstacksize;
+
+	return 0;
+}
+
+/**
+ * @brief Configure the shared JIT stack
+ *
+ * The default match context, and profiles without a JIT stack of their own, use a
+ * process-wide JIT stack.  It starts as PCRE2's 32K machine stack and is doubled
+ * whenever a match runs out of it, up to the ceiling.  Giving a starting size
+ * replaces the stack with one of that size straight away, which saves the
+ * failed matches it takes to grow it; the high-water mark from pcre2jitstackstats
+ * is a good starting size.  Pass a negative value to leave either setting alone.
+ *
+ * @param count Parameter count from the M API
+ * @param size Size in bytes to make the stack now
+ * @param ceiling Size in bytes beyond which the stack is not grown
+ *
+ * @return 0 on success, < 0 on error
+ */
+gtm_long_t mpcre2_jit_stack_config(int count, gtm_long_t size, gtm_long_t ceiling) {
+
+	if (ceiling >= 0) {
+		jit_stacks.ceiling = ceiling < MPCRE2_JIT_STACK_MIN ? MPCRE2_JIT_STACK_MIN : (size_t) ceiling;
+	}
+
+	if (size >= 0) {
+		if (size < MPCRE2_JIT_STACK_MIN) {
+			size = MPCRE2_JIT_STACK_MIN;
+		}
+		return jit_stack_resize((size_t) size);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Return statistics for the shared JIT stack
+ *
+ * @param count Parameter count from the M API
+ * @param size Where to put the current size of the stack
+ * @param ceiling Where to put the size beyond which the stack is not grown
+ * @param high_water Where to put the largest stack a match has had to grow it to, to the nearest doubling
+ * @param grows Where to put the number of times the stack has been grown
+ *
+ * @return None
+ */
+void mpcre2_jit_stack_stats(int count, gtm_ulong_t *size, gtm_ulong_t *ceiling, gtm_ulong_t *high_water,
+	gtm_ulong_t *grows) {
+
+	*size = jit_stacks.size;
+	*ceiling = jit_stacks.ceiling;
+	*high_water = jit_stacks.high_water;
+	*grows = jit_stacks.grows;
+}
+
 /**
  * @brief Wrap the pcre2_jit_stack_free() function
  *
@@ -2157,7 +9148,7 @@ void mpcre2_jit_stack_free(int count, gtm_char_t *jit_stack_str) {
 
 	pcre2_jit_stack *jit;
 
-	jit = (pcre2_jit_stack *) pointer_decode(jit_stack_str);
+	jit = (pcre2_jit_stack *) handle_release(jit_stack_str, HANDLE_JIT_STACK);
 
 	pcre2_jit_stack_free(jit);
 }
@@ -2183,11 +9174,12 @@ gtm_long_t mpcre2_serialize_decode(int count, gtm_string_t *codes_str, gtm_long_
 	const uint8_t *bytes;
 
 	gc = get_general_context(gcontext_str);
-	bytes = (uint8_t *) pointer_decode(bytes_str);
+	bytes = (uint8_t *) handle_decode(bytes_str, HANDLE_SERIALIZED);
+	codes = NULL;
 
 	res = pcre2_serialize_decode(&codes, (int32_t) number_of_codes, bytes, gc);
 
-	pointer_encode(codes, buf, sizeof(buf));
+	handle_encode(codes, HANDLE_CODE, buf, sizeof(buf));
 	strncpy(codes_str->address, buf, strlen(buf));
 	codes_str->length = strlen(buf);
 
@@ -2218,12 +9210,16 @@ gtm_long_t mpcre2_serialize_encode(int count, gtm_char_t *codes_str, gtm_long_t
 	PCRE2_SIZE get_serialized_size;
 	static char buf[80];
 
-	codes = (pcre2_code *) pointer_decode(codes_str);
+	codes = (pcre2_code *) handle_decode(codes_str, HANDLE_CODE);
+	if (!codes) {
+		return PCRE2_ERROR_NULL;
+	}
 	gc = get_general_context(gcontext_str);
+	serialized_bytes = NULL;
 
 	res = pcre2_serialize_encode(&codes, (int32_t) number_of_codes, &serialized_bytes, &get_serialized_size, gc);
 
-	pointer_encode(serialized_bytes, buf, sizeof(buf));
+	handle_encode(serialized_bytes, HANDLE_SERIALIZED, buf, sizeof(buf));
 	strncpy(serialized_bytes_str->address, buf, strlen(buf));
 	serialized_bytes_str->length = strlen(buf);
 	*serialized_size = get_serialized_size;
@@ -2246,7 +9242,7 @@ gtm_long_t mpcre2_serialize_encode(int count, gtm_char_t *codes_str, gtm_long_t
 
  	uint8_t *bytes;
 
-	bytes = (uint8_t *) pointer_decode(bytes_str);
+	bytes = (uint8_t *) handle_release(bytes_str, HANDLE_SERIALIZED);
 
 	pcre2_serialize_free(bytes);
  }
@@ -2264,7 +9260,10 @@ gtm_long_t mpcre2_serialize_get_number_of_codes(int count, gtm_char_t *bytes_str
 	
 	uint8_t *bytes;
 
-	bytes = (uint8_t *) pointer_decode(bytes_str);
+	bytes = (uint8_t *) handle_decode(bytes_str, HANDLE_SERIALIZED);
+	if (!bytes) {
+		return PCRE2_ERROR_NULL;
+	}
 
 	return pcre2_serialize_get_number_of_codes(bytes);
 }
@@ -2284,11 +9283,11 @@ gtm_char_t *mpcre2_code_copy(int count, gtm_char_t *code_str) {
 	pcre2_code *new_code;
 	static char buf[80];
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
 
 	new_code = pcre2_code_copy(code);
 
-	pointer_encode(new_code, buf, sizeof(buf));
+	handle_encode(new_code, HANDLE_CODE, buf, sizeof(buf));
 
 	return buf;
 }
@@ -2308,11 +9307,11 @@ gtm_char_t *mpcre2_code_copy_with_tables(int count, gtm_char_t *code_str) {
 	pcre2_code *new_code;
 	static char buf[80];
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
 
 	new_code = pcre2_code_copy_with_tables(code);
 
-	pointer_encode(new_code, buf, sizeof(buf));
+	handle_encode(new_code, HANDLE_CODE, buf, sizeof(buf));
 
 	return buf;
 }
@@ -2395,7 +9394,7 @@ gtm_long_t mpcre2_pattern_info(int count, gtm_char_t *code_str, gtm_char_t *what
 		PCRE2_SPTR pcre2sptr_val;
 	} what;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
 
 	/*
 	 * Now we have to get the query
@@ -2519,7 +9518,10 @@ gtm_long_t mpcre2_pattern_info(int count, gtm_char_t *code_str, gtm_char_t *what
 	callback_t callback;
 	void *user_data;
 
-	code = (pcre2_code *) pointer_decode(code_str);
+	code = (pcre2_code *) handle_decode(code_str, HANDLE_CODE);
+	if (!code) {
+		return PCRE2_ERROR_NULL;
+	}
 	callback = (callback_t) pointer_decode(callback_str);
 	user_data = (void *) pointer_decode(user_data_str);
 
@@ -0,0 +1,16 @@
+mpcre2ci	; Call-in routines used by the mpcre2 plugin (see mpcre2.ci)
+	quit
+	;
+	; Kill the local array which is about to be filled with captures.
+	; The formal parameters have unusual names because the array is
+	; reached through indirection, and must not be hidden by them.
+	;
+kill(%mpcre2v)
+	kill @%mpcre2v
+	quit
+	;
+	; Set one capture: @%mpcre2v@(%mpcre2s)=%mpcre2x
+	;
+setcap(%mpcre2v,%mpcre2s,%mpcre2x)
+	set @%mpcre2v@(%mpcre2s)=%mpcre2x
+	quit
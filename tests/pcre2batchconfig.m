@@ -0,0 +1,29 @@
+;
+; pcre2batchconfig.m
+;
+; A batch split across threads gives the same result, in the same order,
+; as one matched in the calling thread.
+;
+	new code,ecode,eoffset,subjects,i,s,old,serial,parallel,res1,res2
+	set code=$&pcre2compile("(\w+)@(\w+)\.com\b","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set subjects=""
+	for i=1:1:5000 set s=$select(i#3=0:"user"_i_"@host.com",i#3=1:"none "_i,1:""),subjects=subjects_$length(s)_":"_s
+
+	set old=$&pcre2batchconfig(1,0)
+	set res1=$&pcre2matchbatch(code,subjects,"0","0",.serial)
+	if res1'=1666 write "Unexpected serial match count: ",res1,! quit
+
+	set old=$&pcre2batchconfig(4,500)
+	if old'=1 write "Unexpected previous thread count: ",old,! quit
+	set res2=$&pcre2matchbatch(code,subjects,"0","0",.parallel)
+	if res2'=res1 write "Unexpected parallel match count: ",res2,! quit
+	if parallel'=serial write "Parallel result differs",! quit
+
+	set old=$&pcre2batchconfig(1,1000)
+	if old'=4 write "Unexpected previous thread count: ",old,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,21 @@
+;
+; Set the pattern cache budget.  Shrinking the budget to nothing should
+; evict everything but a pattern being returned.
+;
+	new ecode,eoffset,code,old,hits,misses,evictions,entries,bytes
+	set code=$&pcre2cachedcompile("abc","0",.ecode,.eoffset,"NULL")
+	set code=$&pcre2cachedcompile("def","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set old=$&pcre2cacheconfig(-1)
+	if old'>0 write "Bad default budget ",old,! quit
+
+	if $&pcre2cacheconfig(0)'=old write "Budget query and set disagree",! quit
+	do &pcre2cachestats(.hits,.misses,.evictions,.entries,.bytes)
+	if entries'=0 write "Entries left after shrinking budget: ",entries,! quit
+	if evictions<2 write "Evictions not counted",! quit
+
+	if $&pcre2cacheconfig(old)'=0 write "Budget not updated",! quit
+
+	write 0,!
+	quit
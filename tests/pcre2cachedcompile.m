@@ -0,0 +1,43 @@
+;
+; Compile through the pattern cache.  Compiling the same pattern twice
+; should give back the same handle, and the handle should match like
+; one from pcre2compile.
+;
+	new ecode,eoffset,code,code2,code3,mdata,mv,cc
+	set code=$&pcre2cachedcompile("^.*(Fox J.*zy)","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set code2=$&pcre2cachedcompile("^.*(Fox J.*zy)","0",.ecode,.eoffset,"NULL")
+	if code2'=code write "Cache miss on identical pattern",! quit
+
+	; Different options must not share the entry
+	set code3=$&pcre2cachedcompile("^.*(Fox J.*zy)","PCRE2_CASELESS",.ecode,.eoffset,"NULL")
+	if code3=code write "Cache hit with different options",! quit
+
+	set mdata=$&pcre2matchdatacreatefrompattern(code,"0")
+	set mv=$&pcre2match(code,"The Quick Brown Fox Jumped Over The Lazy Dog",0,0,mdata,0)
+	if mv'=2 write "Unexpected match count ",mv,! quit
+	do &pcre2matchdatafree(mdata)
+
+	; Changing the compile context must not leave its old patterns in the cache
+	set cc=$&pcre2compilecontextcreate("NULL")
+	set code=$&pcre2cachedcompile("^b","PCRE2_MULTILINE",.ecode,.eoffset,cc)
+	set mdata=$&pcre2matchdatacreatefrompattern(code,"0")
+	set mv=$&pcre2match(code,"a"_$char(13)_"b",0,0,mdata,0)
+	if mv'=-1 write "Unexpected match with LF newlines ",mv,! quit
+	do &pcre2matchdatafree(mdata)
+	set mv=$&pcre2setnewline(cc,"PCRE2_NEWLINE_CR")
+	set code2=$&pcre2cachedcompile("^b","PCRE2_MULTILINE",.ecode,.eoffset,cc)
+	if code2=code write "Cache hit after the compile context changed",! quit
+	set mdata=$&pcre2matchdatacreatefrompattern(code2,"0")
+	set mv=$&pcre2match(code2,"a"_$char(13)_"b",0,0,mdata,0)
+	if mv'=1 write "Unexpected match count with CR newlines ",mv,! quit
+	do &pcre2matchdatafree(mdata)
+	do &pcre2compilecontextfree(cc)
+
+	; A bad pattern is reported just as pcre2compile would
+	set code=$&pcre2cachedcompile("(unclosed","0",.ecode,.eoffset,"NULL")
+	if code'=0 write "Bad pattern compiled",! quit
+
+	write 0,!
+	quit
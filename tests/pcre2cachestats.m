@@ -0,0 +1,16 @@
+;
+; Check the pattern cache hit and miss counters
+;
+	new ecode,eoffset,code,hits,misses,evictions,entries,bytes,hits2,misses2
+	do &pcre2cachestats(.hits,.misses,.evictions,.entries,.bytes)
+	set code=$&pcre2cachedcompile("[0-9]+-stats","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set code=$&pcre2cachedcompile("[0-9]+-stats","0",.ecode,.eoffset,"NULL")
+	do &pcre2cachestats(.hits2,.misses2,.evictions,.entries,.bytes)
+	if misses2'=(misses+1) write "Miss not counted",! quit
+	if hits2'=(hits+1) write "Hit not counted",! quit
+	if entries<1 write "No entries cached",! quit
+	if bytes'>0 write "No bytes charged",! quit
+
+	write 0,!
+	quit
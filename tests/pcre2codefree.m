@@ -1,11 +1,22 @@
 ;
 ; Free a compiled RE.  There is not really any good check for whether this
 ; worked, although crashing the runtime would be an indication it did not.
+; A freed handle should be refused (PCRE2_ERROR_NULL, -51) rather than used,
+; and so should a handle whose generation has been pushed past 32 bits.
 ;
-	new ecode,eoffset,code,good
+	new ecode,eoffset,code,good,mdata,mv,alias
 	set good="^.*Fox\.$"
 	set code=$&pcre2compile(good,"PCRE2_CASELESS|PCRE2_DOTALL",.ecode,.eoffset,"NULL")
 	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set mdata=$&pcre2matchdatacreatefrompattern(code,"0")
+	set alias=$piece(code,".")_"."_($piece(code,".",2)+4294967296)
+	set mv=$&pcre2match(alias,"The Fox.",0,0,mdata,0)
+	if mv'=-51 write "Wrapped handle not refused: ",mv,! quit
+	set mv=$&pcre2match(code,"The Fox.",0,0,mdata,0)
+	if mv'=1 write "Live handle not matched: ",mv,! quit
 	do &pcre2codefree(code)
+	set mv=$&pcre2match(code,"The Fox.",0,0,mdata,0)
+	if mv'=-51 write "Stale handle not refused: ",mv,! quit
+	do &pcre2matchdatafree(mdata)
 	write 0,!
 	quit
@@ -13,5 +13,13 @@
 	; no return value, so just don't blow up the M runtime..
 	do &pcre2compilecontextfree(cc2)
 
+	; a freed context is refused rather than quietly replaced by the defaults
+	set code=$&pcre2compile("fox","0",.ecode,.eoffset,cc2)
+	if code'=0 write "Compiled with a freed compile context",! quit
+	if ecode'=-51 write "Freed compile context gave error ",ecode,! quit
+	set code=$&pcre2cachedcompile("fox","0",.ecode,.eoffset,cc2)
+	if code'=0 write "Cached a compile with a freed compile context",! quit
+	if ecode'=-51 write "Freed compile context gave cached error ",ecode,! quit
+
 	write "0",!
 	quit
@@ -0,0 +1,31 @@
+;
+; pcre2defineprofile.m
+;
+; Define a profile with a low match limit and pass it by name where a
+; match context would go.
+;
+	new code,ecode,eoffset,res,subject
+	set code=$&pcre2compile("(a+)+$","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set subject=$translate($justify("",28)," ","a")_"b"
+
+	set res=$&pcre2defineprofile("strict",1000,-1,-1,-1,0)
+	if res'=0 write "Unable to define profile: ",res,! quit
+
+	set res=$&pcre2match(code,subject,0,"0","AUTO","strict")
+	if res'=-47 write "Match limit not applied, got ",res,! quit
+
+	; redefine it with no limits but a JIT stack
+	set res=$&pcre2defineprofile("strict",-1,-1,-1,-1,65536)
+	if res'=0 write "Unable to redefine profile: ",res,! quit
+	set res=$&pcre2match(code,"aaab",0,"0","AUTO","strict")
+	if res'=-1 write "Unexpected result after redefining: ",res,! quit
+
+	set res=$&pcre2match(code,"aaa",0,"0","AUTO","strict")
+	if res'=2 write "Unexpected match result: ",res,! quit
+
+	if $&pcre2defineprofile("NULL",1,1,1,1,0)'=-1 write "Reserved name accepted",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
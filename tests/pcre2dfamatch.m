@@ -24,5 +24,12 @@
 
 	if mv'=-1 write "Unexpected match return value: ",mv,! quit
 
+	; A pattern which needs more than 1000 ints of workspace.  With a
+	; workspace count of 0 the workspace is grown until it is big enough.
+	set code=$&pcre2compile("(?:a?){400}b","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set mv=$&pcre2dfamatch(code,$translate($justify("",400)," ","a")_"b",0,"0","AUTO","NULL",0)
+	if mv'=1 write "Unexpected match count with automatic workspace: ",mv,! quit
+
 	write 0,!
 	quit
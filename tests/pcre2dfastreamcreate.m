@@ -0,0 +1,19 @@
+;
+; pcre2dfastreamcreate.m
+;
+; Create a DFA stream, and check that bad arguments are refused.
+;
+	new code,ecode,eoffset,stream
+	set code=$&pcre2compile("abc","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set stream=$&pcre2dfastreamcreate(code,"0","0")
+	if stream=0 write "Unable to create DFA stream",! quit
+	do &pcre2dfastreamfree(stream)
+
+	if $&pcre2dfastreamcreate("0","0","0")'=0 write "Stream created without a pattern",! quit
+	if $&pcre2dfastreamcreate(code,"PCRE2_BOGUS","0")'=0 write "Stream created with a bad option",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,82 @@
+;
+; pcre2dfastreamfeed.m
+;
+; Feed a subject to a DFA stream in chunks.  Matches running over chunk
+; boundaries must be found, with offsets into the whole subject, even when
+; a chunk is empty or ends part way through a UTF-8 character.  ^, \A, \b
+; and lookbehinds must see the end of the chunk before.
+;
+	new code,ecode,eoffset,stream,res,result,all,chunk,i,chunks,euro,cases,c,err
+	set code=$&pcre2compile("a\d+z","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set stream=$&pcre2dfastreamcreate(code,"0","0")
+	if stream=0 write "Unable to create DFA stream",! quit
+
+	set chunks="xxa1|23|4z a9z a|77",all=""
+	for i=1:1:$length(chunks,"|") do  quit:res<0
+	. set chunk=$piece(chunks,"|",i)
+	. set res=$&pcre2dfastreamfeed(stream,chunk,i=$length(chunks,"|"),.result)
+	. if result'="" set all=all_$select(all="":"",1:" ")_result
+	if res<0 write "Feed failed: ",res,! quit
+	if all'="2,8 9,12" write "Unexpected matches: ",all,! quit
+
+	; nothing can be fed after the last chunk
+	set res=$&pcre2dfastreamfeed(stream,"a1z",1,.result)
+	if res'=-51 write "Feed after last chunk accepted: ",res,! quit
+
+	do &pcre2dfastreamfree(stream)
+
+	; an empty chunk does not end a partial match
+	set stream=$&pcre2dfastreamcreate(code,"0","0")
+	if stream=0 write "Unable to create DFA stream",! quit
+	set res=$&pcre2dfastreamfeed(stream,"a1",0,.result)
+	set res=$&pcre2dfastreamfeed(stream,"",0,.result)
+	if res'=0 write "Empty chunk failed: ",res,! quit
+	set res=$&pcre2dfastreamfeed(stream,"2z",1,.result)
+	if (res'=1)!(result'="0,4") write "Partial match lost over an empty chunk: ",res," ",result,! quit
+	do &pcre2dfastreamfree(stream)
+	do &pcre2codefree(code)
+
+	; a UTF-8 character split across chunks, one of which holds no whole character
+	set euro=$zchar(226,130,172)
+	set code=$&pcre2compile("a"_euro_"+b","PCRE2_UTF",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set stream=$&pcre2dfastreamcreate(code,"0","0")
+	if stream=0 write "Unable to create DFA stream",! quit
+	set chunks="xa"_$zchar(226)_"|"_$zchar(130)_"|"_$zchar(172)_euro_"|b",all=""
+	for i=1:1:$length(chunks,"|") do  quit:res<0
+	. set chunk=$piece(chunks,"|",i)
+	. set res=$&pcre2dfastreamfeed(stream,chunk,i=$length(chunks,"|"),.result)
+	. if result'="" set all=all_$select(all="":"",1:" ")_result
+	if res<0 write "Feed of split character failed: ",res,! quit
+	if all'="1,9" write "Unexpected matches over a split character: ",all,! quit
+	do &pcre2dfastreamfree(stream)
+	do &pcre2codefree(code)
+
+	; pattern~chunks~matches, for assertions at the start of a chunk
+	set cases(1)="^b~ab|bb~"
+	set cases(2)="\Ab~ab|bb~"
+	set cases(3)="\bb~ab|bb~"
+	set cases(4)="(?m)^b~ab|bb~"
+	set cases(5)="(?m)^b~a"_$char(10)_"|bx~2,3"
+	set cases(6)="\bb~a |b~2,3"
+	set cases(7)="(?<=a)b~xa|b~2,3"
+	set cases(8)="(?<=ab)c~xa|b|c~3,4"
+	set err=""
+	for c=1:1:8 do  quit:err'=""
+	. set code=$&pcre2compile($piece(cases(c),"~"),"0",.ecode,.eoffset,"NULL")
+	. if code=0 set err="Compile of case "_c_" failed" quit
+	. set stream=$&pcre2dfastreamcreate(code,"0","0")
+	. set chunks=$piece(cases(c),"~",2),all=""
+	. for i=1:1:$length(chunks,"|") do  quit:res<0
+	. . set res=$&pcre2dfastreamfeed(stream,$piece(chunks,"|",i),i=$length(chunks,"|"),.result)
+	. . if result'="" set all=all_$select(all="":"",1:" ")_result
+	. if res<0 set err="Feed of case "_c_" failed: "_res
+	. if res'<0,all'=$piece(cases(c),"~",3) set err="Unexpected matches for case "_c_": "_all
+	. do &pcre2dfastreamfree(stream)
+	. do &pcre2codefree(code)
+	if err'="" write err,! quit
+
+	write 0,!
+	quit
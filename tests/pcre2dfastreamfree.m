@@ -0,0 +1,19 @@
+;
+; pcre2dfastreamfree.m
+;
+; A freed DFA stream handle must no longer be usable.
+;
+	new code,ecode,eoffset,stream,res,result
+	set code=$&pcre2compile("abc","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set stream=$&pcre2dfastreamcreate(code,"0","0")
+	if stream=0 write "Unable to create DFA stream",! quit
+	do &pcre2dfastreamfree(stream)
+
+	set res=$&pcre2dfastreamfeed(stream,"abc",1,.result)
+	if res'=-51 write "Freed stream still usable: ",res,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,27 @@
+;
+; pcre2getmatchdata.m
+;
+; Match with "AUTO" match data, then look at the last match through the
+; handle of the match data kept with the pattern.
+;
+	new code,ecode,eoffset,res,mdata,ov,i
+	set code=$&pcre2compile("(F\w+) (J\w+)","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	for i=1:1:3 set res=$&pcre2match(code,"The Fox Jumped",0,"0","AUTO","NULL") quit:res'=3
+	if res'=3 write "Unexpected match result: ",res,! quit
+
+	set mdata=$&pcre2getmatchdata(code)
+	if mdata=0 write "No match data for pattern",! quit
+	if $&pcre2getmatchdata(code)'=mdata write "Match data handle changed",! quit
+
+	set res=$&pcre2getovector(mdata,.ov)
+	if ov'="4,14;4,7;8,14" write "Unexpected output vector: ",ov,! quit
+
+	; freeing it directly is refused; it goes with the pattern
+	do &pcre2matchdatafree(mdata)
+	if $&pcre2getovector(mdata,.ov)'=3 write "Pattern match data was freed",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
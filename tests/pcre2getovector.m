@@ -0,0 +1,25 @@
+;
+; pcre2getovector.m
+;
+; Fetch the whole output vector in one call and check it against
+; pcre2getovpair.
+;
+	new code,ecode,eoffset,mdata,res,ov,ovp,i,p0,p1
+	set code=$&pcre2compile("(F\w+)|(J\w+)( X)?","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set mdata=$&pcre2matchdatacreatefrompattern(code,"NULL")
+
+	set res=$&pcre2match(code,"The Jumped",0,"0",mdata,"NULL")
+	if res'=3 write "Unexpected match result: ",res,! quit
+
+	set res=$&pcre2getovector(mdata,.ov)
+	if res'=4 write "Unexpected pair count: ",res,! quit
+	if ov'="4,10;-;4,10;-" write "Unexpected output vector: ",ov,! quit
+
+	set ovp=$&pcre2getovectorpointer(mdata)
+	for i=0,2 do &pcre2getovpair(ovp,i,.p0,.p1) if $piece(ov,";",i+1)'=(p0_","_p1) write "Pair ",i," differs",! quit
+
+	do &pcre2matchdatafree(mdata)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
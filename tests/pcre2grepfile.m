@@ -0,0 +1,64 @@
+;
+; pcre2grepfile.m
+;
+; Search the lines of a file, returning the matching lines or writing
+; them to another file, and search gzip compressed files: one with a line
+; longer than a decompression buffer, one of two gzip members, a truncated
+; one and one with a line too long to search.
+;
+	new code,ecode,eoffset,file,outfile,res,result,line,gzfile
+	set code=$&pcre2compile("^ERROR","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set file="pcre2grepfile.txt",outfile="pcre2grepfile.out"
+	open file:newversion use file
+	write "INFO start",!,"ERROR disk",!,"",!,"WARN ERROR late",!,"ERROR net"
+	close file
+
+	set res=$&pcre2grepfile(code,file,"0","0","",.result)
+	if res'=2 write "Unexpected line count: ",res,! quit
+	if result'="2,11;5,39" write "Unexpected result: ",result,! quit
+
+	set res=$&pcre2grepfile(code,file,"0","0",outfile,.result)
+	if res'=2 write "Unexpected line count writing a file: ",res,! quit
+	open outfile:readonly use outfile read line close outfile
+	if line'="2,11" write "Unexpected output file line: ",line,! quit
+	open outfile close outfile:delete
+
+	set gzfile=file_".gz"
+	zsystem "gzip -c "_file_" > "_gzfile
+	set res=$&pcre2grepfile(code,gzfile,"0","0","",.result)
+	if res'=2 write "Unexpected line count for gzip: ",res,! quit
+	if result'="2,11;5,39" write "Unexpected result for gzip: ",result,! quit
+	open gzfile close gzfile:delete
+	open file close file:delete
+
+	do &pcre2codefree(code)
+	set code=$&pcre2compile("ERROR","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	zsystem "(echo start; head -c 300000 /dev/zero | tr '\0' ' '; echo ERROR; echo ERROR end) > "_file
+	zsystem "gzip -c "_file_" > "_gzfile
+	set res=$&pcre2grepfile(code,gzfile,"0","0","",.result)
+	if (res'=2)!(result'="2,6;3,300012") write "Unexpected result for a long gzip line: ",res," ",result,! quit
+
+	zsystem "gzip -c "_file_" >> "_gzfile
+	set res=$&pcre2grepfile(code,gzfile,"0","0","",.result)
+	if (res'=4)!(result'="2,6;3,300012;5,300028;6,600034") write "Unexpected result for two gzip members: ",res," ",result,! quit
+
+	zsystem "head -c 100 "_gzfile_" > "_gzfile_".part && mv "_gzfile_".part "_gzfile
+	set res=$&pcre2grepfile(code,gzfile,"0","0","",.result)
+	if res'=-1 write "Truncated gzip file not reported: ",res,! quit
+
+	zsystem "(echo ERROR first; head -c 17825792 /dev/zero | tr '\0' ' '; echo ERROR) > "_file
+	zsystem "gzip -c "_file_" > "_gzfile
+	set res=$&pcre2grepfile(code,gzfile,"0","0","",.result)
+	if (res'=-48)!(result'="1,0") write "Over-long gzip line not reported: ",res," ",result,! quit
+	open gzfile close gzfile:delete
+	open file close file:delete
+
+	set res=$&pcre2grepfile(code,"nosuchfile.txt","0","0","",.result)
+	if res'=-1 write "Missing file not reported: ",res,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
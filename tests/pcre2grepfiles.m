@@ -0,0 +1,53 @@
+;
+; pcre2grepfiles.m
+;
+; Search the lines of several files and a directory, returning the
+; matching lines in file and line order, including a gzip compressed file.
+;
+	new code,ecode,eoffset,dir,paths,res,result,old,serial,parallel,i,file
+	set code=$&pcre2compile("^ERROR","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set dir="pcre2grepfiles.d"
+	zsystem "mkdir -p "_dir_"/sub"
+	set file=dir_"/a.txt" open file:newversion use file write "x",!,"ERROR a",! close file
+	set file=dir_"/b.txt" open file:newversion use file write "ERROR one",!,"ok",!,"ERROR two" close file
+	set file=dir_"/sub/c.txt" open file:newversion use file write "ERROR c",! close file
+
+	set res=$&pcre2grepfiles(code,dir,"0","0","",.result)
+	if res'=4 write "Unexpected line count: ",res,! quit
+	if result'=(dir_"/a.txt:2:2"_$char(10)_dir_"/b.txt:1:0"_$char(10)_dir_"/b.txt:3:13"_$char(10)_dir_"/sub/c.txt:1:0") write "Unexpected result: ",result,! quit
+
+	set paths=dir_"/sub/c.txt"_$char(10)_dir_"/a.txt"
+	set res=$&pcre2grepfiles(code,paths,"0","0","",.result)
+	if res'=2 write "Unexpected line count for a list: ",res,! quit
+	if result'=(dir_"/sub/c.txt:1:0"_$char(10)_dir_"/a.txt:2:2") write "Unexpected result for a list: ",result,! quit
+
+	set file=dir_"/big.txt" open file:newversion use file
+	for i=1:1:300000 write i," some log line ",$select(i#997:"ok",1:"ERROR here"),!
+	close file
+	do &pcre2codefree(code)
+	set code=$&pcre2compile("ERROR","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set old=$&pcre2batchconfig(1,0)
+	set res=$&pcre2grepfiles(code,file,"0","0","",.serial)
+	if res'=300 write "Unexpected serial line count: ",res,! quit
+	set old=$&pcre2batchconfig(4,0)
+	set res=$&pcre2grepfiles(code,file,"0","0","",.parallel)
+	if res'=300 write "Unexpected parallel line count: ",res,! quit
+	if parallel'=serial write "Parallel result differs",! quit
+	set old=$&pcre2batchconfig(1,0)
+
+	set file=dir_"/small.txt" open file:newversion use file write "start",!,"an ERROR",!,"ok",!,"ERROR end",! close file
+	zsystem "gzip "_file
+	set res=$&pcre2grepfiles(code,file_".gz","0","0","",.result)
+	if (res'=2)!(result'=(file_".gz:2:6"_$char(10)_file_".gz:4:18")) write "Unexpected result for gzip: ",res," ",result,! quit
+
+	set res=$&pcre2grepfiles(code,dir_"/nosuchfile.txt","0","0","",.result)
+	if res'=-1 write "Missing file not reported: ",res,! quit
+
+	zsystem "rm -rf "_dir
+	do &pcre2codefree(code)
+	write 0,!
+	quit
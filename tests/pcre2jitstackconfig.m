@@ -0,0 +1,27 @@
+;
+; pcre2jitstackconfig.m
+;
+; With the ceiling at the minimum the shared JIT stack can't grow, so a
+; deep JIT match fails; presizing the stack makes it work again.
+;
+	new code,ecode,eoffset,res,subject,size,ceiling,highwater,grows
+	set code=$&pcre2compile("(?:(a)|b)*z","MPCRE2_AUTO_JIT",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set subject=$translate($justify("",100000)," ","ab")
+	set subject=subject_subject_"z"
+
+	do &pcre2jitstackstats(.size,.ceiling,.highwater,.grows)
+	if $&pcre2jitstackconfig(32768,32768)'=0 write "Unable to configure JIT stack",! quit
+
+	set res=$&pcre2match(code,subject,0,"0","AUTO","0")
+	if res'=-46 write "Expected a JIT stack limit error, got ",res,! quit
+
+	if $&pcre2jitstackconfig(16777216,16777216)'=0 write "Unable to presize JIT stack",! quit
+	set res=$&pcre2match(code,subject,0,"0","AUTO","0")
+	if res'=2 write "Unexpected match result: ",res,! quit
+
+	if $&pcre2jitstackconfig(-1,ceiling)'=0 write "Unable to restore ceiling",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
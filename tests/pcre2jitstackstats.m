@@ -0,0 +1,34 @@
+;
+; pcre2jitstackstats.m
+;
+; A JIT match which needs more than the default 32K JIT stack should
+; grow the shared stack and succeed, and the stats should show it.  The
+; high-water mark only records sizes which matches had to grow to.
+;
+	new code,ecode,eoffset,res,subject,size,ceiling,highwater,grows,need
+	set code=$&pcre2compile("(?:(a)|b)*z","MPCRE2_AUTO_JIT",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set subject=$translate($justify("",100000)," ","ab")
+	set subject=subject_subject_"z"
+
+	set res=$&pcre2match(code,subject,0,"0","AUTO","0")
+	if res'=2 write "Unexpected match result: ",res,! quit
+
+	do &pcre2jitstackstats(.size,.ceiling,.highwater,.grows)
+	if grows=0 write "JIT stack was not grown",! quit
+	if highwater'>32768 write "High-water mark ",highwater," shows no growth",! quit
+	if highwater>size write "High-water mark ",highwater," is beyond the stack size ",size,! quit
+	if size>ceiling write "Stack grew beyond the ceiling",! quit
+
+	; a match which fits a presized stack leaves the high-water mark alone
+	set need=highwater
+	set res=$&pcre2jitstackconfig(ceiling,-1)
+	set res=$&pcre2match(code,subject,0,"0","AUTO","0")
+	if res'=2 write "Unexpected match result: ",res,! quit
+	do &pcre2jitstackstats(.size,.ceiling,.highwater,.grows)
+	if size'=ceiling write "Stack was not presized",! quit
+	if highwater'=need write "High-water mark ",highwater," moved from ",need," without growth",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
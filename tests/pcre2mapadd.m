@@ -0,0 +1,23 @@
+;
+; pcre2mapadd.m
+;
+; Entries added later extend the map, and replace the value of a key
+; which is already there.
+;
+	new code,ecode,eoffset,map,res,rc,result
+	set code=$&pcre2compile("\b[A-Z][a-z]+\b","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set map=$&pcre2mapcreate("Mon=Monday","0")
+	if map=0 write "Unable to create map",! quit
+	set res=$&pcre2mapadd(map,"Tue=Tuesday"_$char(10)_"Mon=MONDAY","0")
+	if res'=2 write "Unexpected key count: ",res,! quit
+
+	set result=$&pcre2substitutemap(code,"Mon and Tue",0,"0","0",map,0,.rc)
+	if rc'=2 write "Unexpected replacement count: ",rc,! quit
+	if result'="MONDAY and Tuesday" write "Unexpected result: ",result,! quit
+
+	do &pcre2mapfree(map)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,24 @@
+;
+; pcre2mapcreate.m
+;
+; Build substitute maps with the default and with given separators.
+;
+	new map,res
+	set map=$&pcre2mapcreate("St=Street"_$char(10)_"Rd=Road"_$char(13,10)_"Ave=Avenue","0")
+	if map=0 write "Unable to create map",! quit
+	set res=$&pcre2mapadd(map,"","0")
+	if res'=3 write "Unexpected key count: ",res,! quit
+	do &pcre2mapfree(map)
+
+	set map=$&pcre2mapcreate("a:x=1;b:y","; :")
+	if map'=0 write "Bad delimiters accepted",! quit
+	set map=$&pcre2mapcreate("a:x=1;b:y",";:")
+	if map=0 write "Unable to create map with delimiters",! quit
+	do &pcre2mapfree(map)
+
+	; an entry without a key separator is an error
+	set map=$&pcre2mapcreate("St=Street"_$char(10)_"Rd","0")
+	if map'=0 write "Bad entry accepted",! quit
+
+	write 0,!
+	quit
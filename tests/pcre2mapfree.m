@@ -0,0 +1,15 @@
+;
+; pcre2mapfree.m
+;
+; A freed map handle must no longer be usable.
+;
+	new map,res
+	set map=$&pcre2mapcreate("a=b","0")
+	if map=0 write "Unable to create map",! quit
+	do &pcre2mapfree(map)
+
+	set res=$&pcre2mapadd(map,"c=d","0")
+	if res'=-51 write "Freed map still usable: ",res,! quit
+
+	write 0,!
+	quit
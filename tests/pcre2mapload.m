@@ -0,0 +1,31 @@
+;
+; pcre2mapload.m
+;
+; Load substitute map entries from a file.
+;
+	new code,ecode,eoffset,map,file,res,rc,result
+	set code=$&pcre2compile("\b\w+\b","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set file="pcre2mapload.txt"
+	open file:newversion use file
+	write "approx=approximately",!,"dept=department",!,"info=information",!
+	close file
+
+	set map=$&pcre2mapcreate("","0")
+	if map=0 write "Unable to create map",! quit
+	set res=$&pcre2mapload(map,file,"0")
+	open file close file:delete
+	if res'=3 write "Unexpected key count: ",res,! quit
+
+	set result=$&pcre2substitutemap(code,"dept info, approx",0,"0","0",map,0,.rc)
+	if rc'=3 write "Unexpected replacement count: ",rc,! quit
+	if result'="department information, approximately" write "Unexpected result: ",result,! quit
+
+	set res=$&pcre2mapload(map,"nosuchfile.txt","0")
+	if res'=-1 write "Missing file not reported: ",res,! quit
+
+	do &pcre2mapfree(map)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -22,5 +22,19 @@
 	set mv=$&pcre2match(code,subject2,0,0,mdata,0)
 	if mv'=-1 write "Unexpected match return value: ",mv,! quit
 
+	; The same again with a pattern JIT compiled at compile time.  Anchoring
+	; is not a JIT option, so that match has to fall back to the interpreter.
+	do &pcre2codefree(code)
+	set code=$&pcre2compile(regex,"MPCRE2_AUTO_JIT",.ecode,.eoffset,"NULL")
+	if code=0 write "Auto JIT compile failed at ",eoffset," with error ",ecode,! quit
+	set mv=$&pcre2match(code,subject,0,0,mdata,0)
+	if mv'=2 write "Unexpected auto JIT match count",! quit
+	set mv=$&pcre2match(code,subject,0,"PCRE2_ANCHORED",mdata,0)
+	if mv'=2 write "Unexpected anchored auto JIT match count",! quit
+	set mv=$&pcre2match(code,subject2,0,0,mdata,0)
+	if mv'=-1 write "Unexpected auto JIT match return value: ",mv,! quit
+	do &pcre2codefree(code)
+	do &pcre2matchdatafree(mdata)
+
 	write 0,!
 	quit
@@ -0,0 +1,30 @@
+;
+; pcre2matchall.m
+;
+; Find every match in one call, including empty matches, which must
+; not loop or be reported twice.
+;
+	new code,ecode,eoffset,res,result
+	set code=$&pcre2compile("(F\w+)|(J\w+)","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set res=$&pcre2matchall(code,"The Fox Jumped",0,"0","0",0,.result)
+	if res'=2 write "Unexpected match count: ",res,! quit
+	if result'="4,7;4,7;- 8,14;-;8,14" write "Unexpected result: ",result,! quit
+	if $piece($piece(result," ",2),";",3)'="8,14" write "Bad second match group",! quit
+
+	; a limit on the number of matches
+	set res=$&pcre2matchall(code,"The Fox Jumped",0,"0","0",1,.result)
+	if res'=1 write "Match limit not honoured: ",res,! quit
+
+	do &pcre2codefree(code)
+
+	set code=$&pcre2compile("x*","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set res=$&pcre2matchall(code,"axxb",0,"0","0",0,.result)
+	if res'=4 write "Unexpected empty match count: ",res,! quit
+	if result'="0,0 1,3 3,3 4,4" write "Unexpected empty match result: ",result,! quit
+	do &pcre2codefree(code)
+
+	write 0,!
+	quit
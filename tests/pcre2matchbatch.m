@@ -0,0 +1,30 @@
+;
+; pcre2matchbatch.m
+;
+; Match many packed subjects in one call.
+;
+	new code,ecode,eoffset,subjects,i,s,res,result
+	set code=$&pcre2compile("\d+","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set subjects=""
+	for s="abc123","none","","7" set subjects=subjects_$length(s)_":"_s
+	set res=$&pcre2matchbatch(code,subjects,"0","0",.result)
+	if res'=2 write "Unexpected match count: ",res,! quit
+	if result'="1,3;-1;-1;1,0" write "Unexpected result: ",result,! quit
+
+	; many subjects
+	set subjects=""
+	for i=1:1:1000 set s=$select(i#2:"id"_i,1:"x"),subjects=subjects_$length(s)_":"_s
+	set res=$&pcre2matchbatch(code,subjects,"0","0",.result)
+	if res'=500 write "Unexpected match count: ",res,! quit
+	if $length(result,";")'=1000 write "Unexpected result count",! quit
+	if $piece(result,";",999)'="1,2" write "Unexpected item: ",$piece(result,";",999),! quit
+
+	; a bad length is reported
+	set res=$&pcre2matchbatch(code,"3:abc9:short","0","0",.result)
+	if res'=-1 write "Bad packing accepted: ",res,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
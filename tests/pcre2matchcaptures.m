@@ -0,0 +1,28 @@
+;
+; pcre2matchcaptures.m
+;
+; Match and have every numbered and named capture set in a local array.
+; This needs mpcre2ci.m in $gtmroutines and mpcre2.ci in $MPCRE2_SRC.
+;
+	new code,ecode,eoffset,res,caps
+	set code=$&pcre2compile("(?<year>\d{4})-(?<month>\d\d)(-(?<day>\d\d))?","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set caps("stale")=1
+	set res=$&pcre2matchcaptures(code,"Due 2024-05 or so",0,"0","0","caps")
+	if res'=3 write "Unexpected match result: ",res,! quit
+	if $data(caps("stale")) write "Array not killed before setting captures",! quit
+	if caps(0)'="2024-05" write "Bad whole match: ",caps(0),! quit
+	if caps(1)'="2024" write "Bad group 1: ",caps(1),! quit
+	if caps("year")'="2024" write "Bad year: ",caps("year"),! quit
+	if caps("month")'="05" write "Bad month: ",caps("month"),! quit
+	if $data(caps("day")) write "Unset group was set",! quit
+
+	; no match leaves the array alone
+	set res=$&pcre2matchcaptures(code,"no date",0,"0","0","caps")
+	if res'=-1 write "Unexpected no match result: ",res,! quit
+	if caps("year")'="2024" write "Array changed on no match",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
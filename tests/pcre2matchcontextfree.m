@@ -13,5 +13,16 @@
 	; There is no return value for this, so we just make sure it doesn't crash the runtime
 	do &pcre2matchcontextfree(mc2)
 
+	; a freed context is refused rather than quietly replaced by the defaults
+	set code=$&pcre2compile("fox","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed",! quit
+	set mdata=$&pcre2matchdatacreatefrompattern(code,"0")
+	set mv=$&pcre2match(code,"a fox",0,0,mdata,mc2)
+	if mv'=-51 write "Matched with a freed match context: ",mv,! quit
+	set mv=$&pcre2match(code,"a fox",0,0,mdata,mc)
+	if mv'=1 write "Match with a live match context failed: ",mv,! quit
+	do &pcre2matchdatafree(mdata)
+	do &pcre2codefree(code)
+
 	write "0",!
 	quit
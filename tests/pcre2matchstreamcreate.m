@@ -0,0 +1,19 @@
+;
+; pcre2matchstreamcreate.m
+;
+; Create a match stream, and check that bad arguments are refused.
+;
+	new code,ecode,eoffset,stream
+	set code=$&pcre2compile("abc","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set stream=$&pcre2matchstreamcreate(code,"0","0")
+	if stream=0 write "Unable to create match stream",! quit
+	do &pcre2matchstreamfree(stream)
+
+	if $&pcre2matchstreamcreate("0","0","0")'=0 write "Stream created without a pattern",! quit
+	if $&pcre2matchstreamcreate(code,"PCRE2_BOGUS","0")'=0 write "Stream created with a bad option",! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
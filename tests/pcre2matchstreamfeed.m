@@ -0,0 +1,54 @@
+;
+; pcre2matchstreamfeed.m
+;
+; Feed a subject to a match stream in chunks.  Matches running over
+; chunk boundaries, and lookbehinds reaching into earlier chunks, must
+; work, with offsets into the whole subject.  ^ and \b must see the end of
+; the chunk before.
+;
+	new code,ecode,eoffset,stream,res,result,all,chunk,i,chunks,cases,c,err
+	set code=$&pcre2compile("(?<=id=)\d+","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set stream=$&pcre2matchstreamcreate(code,"0","0")
+	if stream=0 write "Unable to create match stream",! quit
+
+	set chunks="x id|=12|34 y i|d=5| id=",all=""
+	for i=1:1:$length(chunks,"|") do  quit:res<0
+	. set chunk=$piece(chunks,"|",i)
+	. set res=$&pcre2matchstreamfeed(stream,chunk,i=$length(chunks,"|"),.result)
+	. if result'="" set all=all_$select(all="":"",1:" ")_result
+	if res<0 write "Feed failed: ",res,! quit
+	if all'="5,9 15,16" write "Unexpected matches: ",all,! quit
+
+	; nothing can be fed after the last chunk
+	set res=$&pcre2matchstreamfeed(stream,"id=1",1,.result)
+	if res'=-51 write "Feed after last chunk accepted: ",res,! quit
+
+	do &pcre2matchstreamfree(stream)
+	do &pcre2codefree(code)
+
+	; pattern~chunks~matches, for assertions at the start of a chunk
+	set cases(1)="^b~ab|bb~"
+	set cases(2)="(?m)^b~ab|bb~"
+	set cases(3)="\bb~ab|bb~"
+	set cases(4)="(?m)^b~a"_$char(10)_"|bx~2,3"
+	set cases(5)="\bb~a |b~2,3"
+	set cases(6)="^b~b|b~0,1"
+	set err=""
+	for c=1:1:6 do  quit:err'=""
+	. set code=$&pcre2compile($piece(cases(c),"~"),"0",.ecode,.eoffset,"NULL")
+	. if code=0 set err="Compile of case "_c_" failed" quit
+	. set stream=$&pcre2matchstreamcreate(code,"0","0")
+	. set chunks=$piece(cases(c),"~",2),all=""
+	. for i=1:1:$length(chunks,"|") do  quit:res<0
+	. . set res=$&pcre2matchstreamfeed(stream,$piece(chunks,"|",i),i=$length(chunks,"|"),.result)
+	. . if result'="" set all=all_$select(all="":"",1:" ")_result
+	. if res<0 set err="Feed of case "_c_" failed: "_res
+	. if res'<0,all'=$piece(cases(c),"~",3) set err="Unexpected matches for case "_c_": "_all
+	. do &pcre2matchstreamfree(stream)
+	. do &pcre2codefree(code)
+	if err'="" write err,! quit
+
+	write 0,!
+	quit
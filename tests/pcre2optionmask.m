@@ -0,0 +1,30 @@
+;
+; Translate option strings to bitmasks, and check that the bitmask can be
+; passed in place of the option string.
+;
+	new ecode,eoffset,code,mdata,mask,mv
+	set mask=$&pcre2optionmask("compile","0")
+	if mask'=0 write "Bad mask for no options: ",mask,! quit
+
+	set mask=$&pcre2optionmask("compile","PCRE2_CASELESS")
+	if mask'>0 write "Bad mask for PCRE2_CASELESS: ",mask,! quit
+	set code=$&pcre2compile("fox",mask,.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set mdata=$&pcre2matchdatacreatefrompattern(code,"0")
+	set mv=$&pcre2match(code,"The Quick Brown FOX",0,0,mdata,0)
+	if mv'=1 write "Caseless bitmask not honoured: ",mv,! quit
+
+	set mask=$&pcre2optionmask("match","PCRE2_NOTBOL|PCRE2_ANCHORED")
+	if mask'>0 write "Bad mask for match options: ",mask,! quit
+	set mv=$&pcre2match(code,"The Quick Brown FOX",0,mask,mdata,0)
+	if mv'=-1 write "Anchored bitmask not honoured: ",mv,! quit
+
+	if $&pcre2optionmask("match","PCRE2_NO_SUCH_THING")'=-1 write "Bad option accepted",! quit
+	if $&pcre2optionmask("nonsense","PCRE2_NOTBOL")'=-1 write "Bad table accepted",! quit
+	if $&pcre2optionmask("match","4294967296")'=-1 write "Overflowing bitmask accepted",! quit
+	if $&pcre2optionmask("jit","8")'=-1 write "Unknown bitmask bits accepted",! quit
+	if $&pcre2optionmask("jit","7")'=7 write "Known bitmask bits rejected",! quit
+
+	write 0,!
+	quit
@@ -0,0 +1,19 @@
+;
+; pcre2resultfree.m
+;
+; A freed result handle must no longer be usable.
+;
+	new code,ecode,eoffset,rc,len,result,res,piece
+	set code=$&pcre2compile("a","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set result=$&pcre2substitutelarge(code,"abc",0,"0","0","0","x",.rc,.len)
+	if result=0 write "Substitute failed with error ",rc,! quit
+	do &pcre2resultfree(result)
+
+	set res=$&pcre2resultread(result,0,.piece)
+	if res'=-51 write "Freed result still usable: ",res,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,31 @@
+;
+; pcre2resultread.m
+;
+; Pieces follow on from each other, and never split a UTF-8 character
+; when the pattern is in UTF mode.
+;
+	new code,ecode,eoffset,rc,len,result,res,piece,all
+	set code=$&pcre2compile("x","PCRE2_UTF",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	; "x" becomes a two byte character
+	set result=$&pcre2substitutelarge(code,"axbxc",0,"PCRE2_SUBSTITUTE_GLOBAL","0","0",$char(233),.rc,.len)
+	if result=0 write "Substitute failed with error ",rc,! quit
+	if len'=7 write "Unexpected result length: ",len,! quit
+
+	; a two byte piece ending part way through a character stops short of it
+	set res=$&pcre2resultread(result,2,.piece)
+	if res'=1 write "Character split: ",res,! quit
+	set all=piece
+	for  set res=$&pcre2resultread(result,2,.piece) quit:res<1  set all=all_piece
+	if res'=0 write "Read failed with error ",res,! quit
+	if all'=("a"_$char(233)_"b"_$char(233)_"c") write "Unexpected result: ",all,! quit
+
+	; the result stays readable at its end
+	set res=$&pcre2resultread(result,2,.piece)
+	if res'=0 write "Read past the end: ",res,! quit
+	do &pcre2resultfree(result)
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
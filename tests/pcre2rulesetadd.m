@@ -0,0 +1,28 @@
+;
+; pcre2rulesetadd.m
+;
+; Rules are numbered in the order they are added, and bad options or
+; patterns are refused.
+;
+	new code,ecode,eoffset,rules,res
+	set code=$&pcre2compile("a","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set rules=$&pcre2rulesetcreate()
+	if rules=0 write "Unable to create rule set",! quit
+
+	set res=$&pcre2rulesetadd(rules,code,"b","PCRE2_SUBSTITUTE_GLOBAL")
+	if res'=1 write "Unexpected rule number: ",res,! quit
+	set res=$&pcre2rulesetadd(rules,code,"c","0")
+	if res'=2 write "Unexpected rule number: ",res,! quit
+
+	set res=$&pcre2rulesetadd(rules,code,"c","PCRE2_NOSUCH")
+	if res'=-1 write "Bad option accepted: ",res,! quit
+	set res=$&pcre2rulesetadd(rules,"c99999.1","c","0")
+	if res'=-51 write "Bad pattern accepted: ",res,! quit
+	set res=$&pcre2rulesetadd(rules,$extract(code)_"0000000000000000000000000"_$extract(code,2,$length(code)),"c","0")
+	if res'=-1 write "Over-long handle accepted: ",res,! quit
+
+	do &pcre2rulesetfree(rules)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,40 @@
+;
+; pcre2rulesetapply.m
+;
+; Rules are applied in order, each to the output of the one before.
+;
+	new c1,c2,c3,c4,ecode,eoffset,rules,big,rc,result
+	set c1=$&pcre2compile("\s+","0",.ecode,.eoffset,"NULL")
+	set c2=$&pcre2compile("^ | $","0",.ecode,.eoffset,"NULL")
+	set c3=$&pcre2compile("(\d{3})(\d{4})","0",.ecode,.eoffset,"NULL")
+	if (c1=0)!(c2=0)!(c3=0) write "Compile failed",! quit
+
+	set rules=$&pcre2rulesetcreate()
+	if rules=0 write "Unable to create rule set",! quit
+	if $&pcre2rulesetadd(rules,c1," ","PCRE2_SUBSTITUTE_GLOBAL")'=1 write "Unable to add rule",! quit
+	if $&pcre2rulesetadd(rules,c2,"","PCRE2_SUBSTITUTE_GLOBAL")'=2 write "Unable to add rule",! quit
+	if $&pcre2rulesetadd(rules,c3,"$1-$2","PCRE2_SUBSTITUTE_GLOBAL")'=3 write "Unable to add rule",! quit
+
+	set result=$&pcre2rulesetapply(rules,"  call"_$char(9)_"5551234   now ","0",.rc)
+	if result'="call 555-1234 now" write "Unexpected result: ",result,! quit
+	if rc'=7 write "Unexpected substitution count: ",rc,! quit
+
+	; a rule with nothing to do leaves the string alone
+	set result=$&pcre2rulesetapply(rules,"tidy","0",.rc)
+	if (rc'=0)!(result'="tidy") write "Unexpected result: ",rc," ",result,! quit
+
+	; a result longer than M can hold is refused, even once the buffers have grown to fit it
+	set c4=$&pcre2compile("^","0",.ecode,.eoffset,"NULL")
+	set big=$&pcre2rulesetcreate()
+	if $&pcre2rulesetadd(big,c4,$justify("",600000),"0")'=1 write "Unable to add rule",! quit
+	set result=$&pcre2rulesetapply(big,$justify("",600000),"0",.rc)
+	if rc'=-48 write "Over-long result not refused: ",rc,! quit
+	do &pcre2rulesetfree(big)
+	do &pcre2codefree(c4)
+
+	do &pcre2rulesetfree(rules)
+	do &pcre2codefree(c1)
+	do &pcre2codefree(c2)
+	do &pcre2codefree(c3)
+	write 0,!
+	quit
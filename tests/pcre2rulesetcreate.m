@@ -0,0 +1,16 @@
+;
+; pcre2rulesetcreate.m
+;
+; An empty rule set returns its subject unchanged.
+;
+	new rules,rc,result
+	set rules=$&pcre2rulesetcreate()
+	if rules=0 write "Unable to create rule set",! quit
+
+	set result=$&pcre2rulesetapply(rules,"unchanged","0",.rc)
+	if rc'=0 write "Unexpected substitution count: ",rc,! quit
+	if result'="unchanged" write "Unexpected result: ",result,! quit
+
+	do &pcre2rulesetfree(rules)
+	write 0,!
+	quit
@@ -0,0 +1,15 @@
+;
+; pcre2rulesetfree.m
+;
+; A freed rule set handle must no longer be usable.
+;
+	new rules,res
+	set rules=$&pcre2rulesetcreate()
+	if rules=0 write "Unable to create rule set",! quit
+	do &pcre2rulesetfree(rules)
+
+	set res=$&pcre2rulesethits(rules,0)
+	if res'=-51 write "Freed rule set still usable: ",res,! quit
+
+	write 0,!
+	quit
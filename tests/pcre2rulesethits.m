@@ -0,0 +1,31 @@
+;
+; pcre2rulesethits.m
+;
+; Hit counts build up per rule over several records.
+;
+	new c1,c2,ecode,eoffset,rules,rc,result,res
+	set c1=$&pcre2compile("a","0",.ecode,.eoffset,"NULL")
+	set c2=$&pcre2compile("z","0",.ecode,.eoffset,"NULL")
+	if (c1=0)!(c2=0) write "Compile failed",! quit
+
+	set rules=$&pcre2rulesetcreate()
+	set res=$&pcre2rulesetadd(rules,c1,"A","PCRE2_SUBSTITUTE_GLOBAL")
+	set res=$&pcre2rulesetadd(rules,c2,"Z","0")
+
+	set result=$&pcre2rulesetapply(rules,"banana","0",.rc)
+	set result=$&pcre2rulesetapply(rules,"pizza","0",.rc)
+
+	set res=$&pcre2rulesethits(rules,1)
+	if res'=4 write "Unexpected hits for rule 1: ",res,! quit
+	set res=$&pcre2rulesethits(rules,2)
+	if res'=1 write "Unexpected hits for rule 2: ",res,! quit
+	set res=$&pcre2rulesethits(rules,0)
+	if res'=5 write "Unexpected total hits: ",res,! quit
+	set res=$&pcre2rulesethits(rules,3)
+	if res'=-1 write "Bad rule number accepted: ",res,! quit
+
+	do &pcre2rulesetfree(rules)
+	do &pcre2codefree(c1)
+	do &pcre2codefree(c2)
+	write 0,!
+	quit
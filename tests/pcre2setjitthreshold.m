@@ -0,0 +1,32 @@
+;
+; pcre2setjitthreshold.m
+;
+; With a threshold of 3, a pattern should pick up JIT code on its third
+; match and keep matching the same way afterwards.
+;
+	new code,ecode,eoffset,md,old,res,jitsize,i
+	set code=$&pcre2compile("Fo+x","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set md=$&pcre2matchdatacreatefrompattern(code,"NULL")
+
+	set old=$&pcre2setjitthreshold(3)
+	if old'=0 write "Threshold should default to off, got ",old,! quit
+	if $&pcre2setjitthreshold(-1)'=3 write "Threshold query failed",! quit
+
+	for i=1:1:2 set res=$&pcre2match(code,"The Fooox",0,"0",md,"NULL") if res'=1 write "Match failed: ",res,! quit
+	set res=$&pcre2patterninfo(code,"PCRE2_INFO_JITSIZE",.jitsize)
+	if jitsize'=0 write "Pattern JIT compiled too early",! quit
+
+	set res=$&pcre2match(code,"The Fooox",0,"0",md,"NULL")
+	if res'=1 write "Match failed: ",res,! quit
+	set res=$&pcre2patterninfo(code,"PCRE2_INFO_JITSIZE",.jitsize)
+	if jitsize=0 write "Pattern not JIT compiled at the threshold",! quit
+
+	set res=$&pcre2match(code,"no match here",0,"0",md,"NULL")
+	if res'=-1 write "Unexpected result after JIT: ",res,! quit
+
+	set old=$&pcre2setjitthreshold(0)
+	do &pcre2matchdatafree(md)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,41 @@
+;
+; pcre2substitutefile.m
+;
+; Substitute in every line of a file, writing a new file, and then in
+; place.
+;
+	new code,ecode,eoffset,file,outfile,res,lines,line,i
+	set code=$&pcre2compile("\d{3}-\d{2}-(\d{4})","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set file="pcre2substitutefile.txt",outfile="pcre2substitutefile.out"
+	open file:newversion use file
+	write "id 123-45-6789 and 987-65-4321",!,"nothing",!,"ssn 111-22-3333",!
+	close file
+
+	set res=$&pcre2substitutefile(code,"XXX-XX-$1","PCRE2_SUBSTITUTE_GLOBAL","0",file,outfile,.lines)
+	if res'=3 write "Unexpected substitution count: ",res,! quit
+	if lines'=2 write "Unexpected changed line count: ",lines,! quit
+	open outfile:readonly use outfile
+	for i=1:1:3 read line(i)
+	close outfile
+	if line(1)'="id XXX-XX-6789 and XXX-XX-4321" write "Unexpected line 1: ",line(1),! quit
+	if line(2)'="nothing" write "Unexpected line 2: ",line(2),! quit
+	if line(3)'="ssn XXX-XX-3333" write "Unexpected line 3: ",line(3),! quit
+
+	set res=$&pcre2substitutefile(code,"XXX-XX-$1","0","0",file,file,.lines)
+	if res'=2 write "Unexpected substitution count in place: ",res,! quit
+	open file:readonly use file read line(1) close file
+	if line(1)'="id XXX-XX-6789 and 987-65-4321" write "Unexpected line in place: ",line(1),! quit
+
+	set res=$&pcre2substitutefile(code,"$9","0","0",file,outfile,.lines)
+	if res'=-49 write "Bad replacement not reported: ",res,! quit
+
+	set res=$&pcre2substitutefile(code,"","0","0","nosuchfile.txt",outfile,.lines)
+	if res'=-1 write "Missing file not reported: ",res,! quit
+
+	open outfile close outfile:delete
+	open file close file:delete
+	do &pcre2codefree(code)
+	write 0,!
+	quit
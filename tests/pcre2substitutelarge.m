@@ -0,0 +1,41 @@
+;
+; pcre2substitutelarge.m
+;
+; Substitute into a result longer than an M string parameter can hold,
+; and read it back in pieces.
+;
+	new code,ecode,eoffset,subject,rc,len,result,res,piece,total,ok
+	set code=$&pcre2compile("a","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set subject=$translate($justify("",600000)," ","a")
+	set result=$&pcre2substitutelarge(code,subject,0,"PCRE2_SUBSTITUTE_GLOBAL","AUTO","0","bb",.rc,.len)
+	if result=0 write "Substitute failed with error ",rc,! quit
+	if rc'=600000 write "Unexpected substitution count: ",rc,! quit
+	if len'=1200000 write "Unexpected result length: ",len,! quit
+
+	set total=0,ok=1
+	for  set res=$&pcre2resultread(result,500000,.piece) quit:res<1  do
+	. set total=total+$length(piece)
+	. if $translate(piece,"b")'="" set ok=0
+	if res<0 write "Read failed with error ",res,! quit
+	if total'=1200000 write "Unexpected total read: ",total,! quit
+	if 'ok write "Unexpected result contents",! quit
+	do &pcre2resultfree(result)
+
+	; a short result fits the first buffer
+	set result=$&pcre2substitutelarge(code,"banana",0,"0","0","0","A",.rc,.len)
+	if result=0 write "Substitute failed with error ",rc,! quit
+	if (rc'=1)!(len'=6) write "Unexpected short result: ",rc," ",len,! quit
+	set res=$&pcre2resultread(result,0,.piece)
+	if piece'="bAnana" write "Unexpected short result: ",piece,! quit
+	do &pcre2resultfree(result)
+
+	; errors are returned in rc
+	set result=$&pcre2substitutelarge(code,"banana",0,"0","0","0","$9",.rc,.len)
+	if result'=0 write "Bad replacement accepted",! quit
+	if rc'=-49 write "Unexpected error: ",rc,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,36 @@
+;
+; pcre2substitutemap.m
+;
+; Replace matches through a map, keyed on the whole match or on a group,
+; leaving matches which are not in the map alone.  The first call matches at
+; offset 0, which must work before the process has used any value buffer.
+;
+	new code,ecode,eoffset,map,rc,result
+	set map=$&pcre2mapcreate("ICU=intensive care unit"_$char(10)_"ER=emergency room","0")
+	if map=0 write "Unable to create map",! quit
+
+	set code=$&pcre2compile("\b[A-Z]{2,}\b","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set result=$&pcre2substitutemap(code,"ER first",0,"0","0",map,0,.rc)
+	if rc'=1 write "Unexpected count for a match at offset 0: ",rc,! quit
+	if result'="emergency room first" write "Unexpected result for a match at offset 0: ",result,! quit
+	set result=$&pcre2substitutemap(code,"",0,"0","0",map,0,.rc)
+	if (rc'=0)!(result'="") write "Unexpected result for an empty subject: ",rc," ",result,! quit
+	set result=$&pcre2substitutemap(code,"From ER to ICU via OR",0,"0","0",map,0,.rc)
+	if rc'=2 write "Unexpected replacement count: ",rc,! quit
+	if result'="From emergency room to intensive care unit via OR" write "Unexpected result: ",result,! quit
+	do &pcre2codefree(code)
+
+	; the key is group 1, and the whole match is replaced
+	set code=$&pcre2compile("<([A-Z]+)>","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set result=$&pcre2substitutemap(code,"<ER> then <ICU>",0,"0","0",map,1,.rc)
+	if result'="emergency room then intensive care unit" write "Unexpected group result: ",result,! quit
+
+	set result=$&pcre2substitutemap(code,"<ER>",0,"0","0",map,2,.rc)
+	if rc'=-49 write "Missing group not reported: ",rc,! quit
+	do &pcre2codefree(code)
+
+	do &pcre2mapfree(map)
+	write 0,!
+	quit
@@ -0,0 +1,33 @@
+;
+; pcre2substitutevalue.m
+;
+; Substitute returning the output as the value of the call, for results
+; both shorter and longer than the buffer kept between calls.
+;
+	new code,ecode,eoffset,rc,result,subject,i
+	set code=$&pcre2compile("(\w+)@(\w+)","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set result=$&pcre2substitutevalue(code,"mail bob@example now",0,"0","0","0","$2!$1",.rc)
+	if rc'=1 write "Unexpected substitution count: ",rc,! quit
+	if result'="mail example!bob now" write "Unexpected result: ",result,! quit
+
+	; output much longer than the input
+	set subject="" for i=1:1:1000 set subject=subject_"a@b "
+	set result=$&pcre2substitutevalue(code,subject,0,"PCRE2_SUBSTITUTE_GLOBAL","AUTO","0",$justify("",100),.rc)
+	if rc'=1000 write "Unexpected substitution count: ",rc,! quit
+	if $length(result)'=101000 write "Unexpected result length: ",$length(result),! quit
+
+	; output longer than M can hold, after the buffer has grown to fit it
+	set result=$&pcre2substitutevalue(code,"a@b"_$justify("",599997),0,"0","0","0",$justify("",600000),.rc)
+	if rc'=-48 write "Over-long result not refused: ",rc,! quit
+	if result'="" write "Unexpected result on error: ",$length(result),! quit
+
+	; errors give an empty result
+	set result=$&pcre2substitutevalue(code,"bob@example",0,"0","0","0","$9",.rc)
+	if rc'=-49 write "Unexpected error: ",rc,! quit
+	if result'="" write "Unexpected result on error: ",result,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,28 @@
+;
+; pcre2substringvaluebyname.m
+;
+; Return named captured substrings as the value of the call.
+;
+	new code,ecode,eoffset,md,res,rc,value
+	set code=$&pcre2compile("(?<user>\w+)@(?<host>\w+)(?<port>:\d+)?","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set md=$&pcre2matchdatacreatefrompattern(code,"NULL")
+
+	set res=$&pcre2match(code,"mail bob@example now",0,"0",md,"NULL")
+	if res<1 write "Match failed with error ",res,! quit
+
+	set value=$&pcre2substringvaluebyname(md,"host",.rc)
+	if rc'=0 write "Unexpected error: ",rc,! quit
+	if value'="example" write "Unexpected value: ",value,! quit
+
+	set value=$&pcre2substringvaluebyname(md,"port",.rc)
+	if rc'=-55 write "Unset group not reported: ",rc,! quit
+	if value'="" write "Unexpected value for unset group: ",value,! quit
+
+	set value=$&pcre2substringvaluebyname(md,"nosuch",.rc)
+	if rc'=-49 write "Unknown name not reported: ",rc,! quit
+
+	do &pcre2matchdatafree(md)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,25 @@
+;
+; pcre2substringvaluebynumber.m
+;
+; Return numbered captured substrings as the value of the call.
+;
+	new code,ecode,eoffset,md,res,rc,value
+	set code=$&pcre2compile("(\w+)@(\w+)","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set md=$&pcre2matchdatacreatefrompattern(code,"NULL")
+
+	set res=$&pcre2match(code,"mail bob@example now",0,"0",md,"NULL")
+	if res<1 write "Match failed with error ",res,! quit
+
+	set value=$&pcre2substringvaluebynumber(md,0,.rc)
+	if (rc'=0)!(value'="bob@example") write "Unexpected group 0: ",rc," ",value,! quit
+	set value=$&pcre2substringvaluebynumber(md,1,.rc)
+	if (rc'=0)!(value'="bob") write "Unexpected group 1: ",rc," ",value,! quit
+
+	set value=$&pcre2substringvaluebynumber(md,3,.rc)
+	if rc'=-49 write "Missing group not reported: ",rc,! quit
+
+	do &pcre2matchdatafree(md)
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,37 @@
+;
+; pcre2templatecompile.m
+;
+; Compile replacement templates, with group references checked against
+; the pattern up front.
+;
+	new code,ecode,eoffset,tmpl,rc
+	set code=$&pcre2compile("(?<user>\w+)@(\w+)","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+
+	set tmpl=$&pcre2templatecompile(code,"${user} at $2 for $$5",.rc)
+	if (tmpl=0)!(rc'=0) write "Template compile failed with error ",rc,! quit
+	do &pcre2templatefree(tmpl)
+
+	set tmpl=$&pcre2templatecompile(code,"$3",.rc)
+	if (tmpl'=0)!(rc'=-49) write "Missing group not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile(code,"${nosuch}",.rc)
+	if (tmpl'=0)!(rc'=-49) write "Missing name not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile(code,"${1",.rc)
+	if (tmpl'=0)!(rc'=-58) write "Missing brace not reported: ",rc,! quit
+	; as with pcre2substitute, a braced reference is all digits or all name characters
+	set tmpl=$&pcre2templatecompile(code,"${1-}",.rc)
+	if (tmpl'=0)!(rc'=-58) write "Bad braced number not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile(code,"${1a}",.rc)
+	if (tmpl'=0)!(rc'=-58) write "Bad braced number not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile(code,"${0x}",.rc)
+	if (tmpl'=0)!(rc'=-58) write "Bad braced number not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile(code,"${user-}",.rc)
+	if (tmpl'=0)!(rc'=-58) write "Bad braced name not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile(code,"cost $",.rc)
+	if (tmpl'=0)!(rc'=-35) write "Bad replacement not reported: ",rc,! quit
+	set tmpl=$&pcre2templatecompile($extract(code)_"0000000000000000000000000"_$extract(code,2,$length(code)),"$1",.rc)
+	if (tmpl'=0)!(rc'=-1) write "Over-long handle accepted: ",rc,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,18 @@
+;
+; pcre2templatefree.m
+;
+; A freed template handle must no longer be usable.
+;
+	new code,ecode,eoffset,tmpl,rc,result
+	set code=$&pcre2compile("a","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set tmpl=$&pcre2templatecompile(code,"b",.rc)
+	if tmpl=0 write "Template compile failed with error ",rc,! quit
+	do &pcre2templatefree(tmpl)
+
+	set result=$&pcre2templatesubstitute(tmpl,"abc",0,"0","0",.rc)
+	if rc'=-51 write "Freed template still usable: ",rc,! quit
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit
@@ -0,0 +1,39 @@
+;
+; pcre2templatesubstitute.m
+;
+; Substitution through a template gives the same result as pcre2substitute.
+; The first substitution matches at offset 0, which must work before the
+; process has used any value buffer.
+;
+	new code,ecode,eoffset,tmpl,rc,result,expect,len,subject
+	set code=$&pcre2compile("(?<user>\w+)@(\w+)(:\d+)?","0",.ecode,.eoffset,"NULL")
+	if code=0 write "Compile failed at ",eoffset," with error ",ecode,! quit
+	set tmpl=$&pcre2templatecompile(code,"<$2/${user}$3>",.rc)
+	if tmpl=0 write "Template compile failed with error ",rc,! quit
+
+	set result=$&pcre2templatesubstitute(tmpl,"al@host:80 first",0,"0","0",.rc)
+	if rc'=1 write "Unexpected count for a match at offset 0: ",rc,! quit
+	if result'="<host/al:80> first" write "Unexpected result for a match at offset 0: ",result,! quit
+	set result=$&pcre2templatesubstitute(tmpl,"",0,"0","0",.rc)
+	if (rc'=0)!(result'="") write "Unexpected result for an empty subject: ",rc," ",result,! quit
+
+	set subject="mail bob@example:25 and al@host"
+	set result=$&pcre2templatesubstitute(tmpl,subject,0,"PCRE2_SUBSTITUTE_GLOBAL|PCRE2_SUBSTITUTE_UNSET_EMPTY","0",.rc)
+	if rc'=2 write "Unexpected substitution count: ",rc,! quit
+	set rc=$&pcre2substitute(code,subject,0,"PCRE2_SUBSTITUTE_GLOBAL|PCRE2_SUBSTITUTE_UNSET_EMPTY","0","0","<$2/${user}$3>",.expect,.len)
+	if result'=expect write "Unexpected result: ",result,! quit
+
+	; an unset group is an error without PCRE2_SUBSTITUTE_UNSET_EMPTY
+	set result=$&pcre2templatesubstitute(tmpl,"al@host",0,"0","0",.rc)
+	if rc'=-55 write "Unset group not reported: ",rc,! quit
+	do &pcre2templatefree(tmpl)
+
+	; a replacement without group references
+	set tmpl=$&pcre2templatecompile(code,"[addr]",.rc)
+	set result=$&pcre2templatesubstitute(tmpl,subject,0,"PCRE2_SUBSTITUTE_GLOBAL","0",.rc)
+	if result'="mail [addr] and [addr]" write "Unexpected literal result: ",result,! quit
+	do &pcre2templatefree(tmpl)
+
+	do &pcre2codefree(code)
+	write 0,!
+	quit